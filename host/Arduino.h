@@ -0,0 +1,175 @@
+/**
+ * @file Arduino.h
+ * @brief Minimal stand-in for the Arduino/FreeRTOS core used by the native environment
+ *
+ * Only what the driver, the simulator and the benchmarks use is provided: the
+ * clock functions, vTaskDelay/vTaskDelayUntil, tasks on top of detached
+ * std::threads, critical sections and mutexes on top of std::mutex, queues of
+ * fixed size items on top of a condition variable, and a Stream
+ * base class with the same virtual interface as the Arduino one. Time comes from
+ * the host steady clock, one tick is one millisecond like the ESP32 Arduino core.
+ * Priorities and core affinity are ignored, and vTaskDelete(NULL) returns so the
+ * task function can end its thread.
+ */
+
+#ifndef host_arduino_h
+#define host_arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+typedef uint32_t TickType_t;
+#define portTICK_PERIOD_MS    1
+#define pdMS_TO_TICKS(ms)     ((TickType_t)(ms))
+
+inline uint64_t host_clock_us(){
+  static const auto epoch = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+inline uint32_t micros(){return (uint32_t) host_clock_us();}
+inline uint32_t millis(){return (uint32_t) (host_clock_us() / 1000);}
+inline void delay(uint32_t ms){std::this_thread::sleep_for(std::chrono::milliseconds(ms));}
+inline void delayMicroseconds(uint32_t us){std::this_thread::sleep_for(std::chrono::microseconds(us));}
+inline void vTaskDelay(TickType_t ticks){delay(ticks * portTICK_PERIOD_MS);}
+inline TickType_t xTaskGetTickCount(){return millis() / portTICK_PERIOD_MS;}
+
+#define portMAX_DELAY         ((TickType_t) 0xFFFFFFFF)
+#define pdTRUE                1
+#define pdFALSE               0
+#define pdPASS                pdTRUE
+#define tskNO_AFFINITY        0x7FFFFFFF
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+inline void vTaskDelayUntil(TickType_t *previous_wake, TickType_t increment){
+  *previous_wake += increment;
+  int64_t wait_us = ((int64_t) *previous_wake * portTICK_PERIOD_MS * 1000) - (int64_t) host_clock_us();
+  if (wait_us > 0) std::this_thread::sleep_for(std::chrono::microseconds(wait_us));
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *, uint32_t, void *param, UBaseType_t, TaskHandle_t *handle, BaseType_t){
+  std::thread thread(task, param);
+  if (handle) *handle = (TaskHandle_t) 1;
+  thread.detach();
+  return pdPASS;
+}
+inline void vTaskDelete(TaskHandle_t){}
+
+// spinlock critical sections, recursive on the same core like the ESP32 port
+typedef struct {std::recursive_mutex lock;} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED  {}
+#define portENTER_CRITICAL(mux)       ((mux)->lock.lock())
+#define portEXIT_CRITICAL(mux)        ((mux)->lock.unlock())
+
+typedef std::timed_mutex *SemaphoreHandle_t;
+inline SemaphoreHandle_t xSemaphoreCreateMutex(){return new std::timed_mutex();}
+inline void vSemaphoreDelete(SemaphoreHandle_t sem){delete sem;}
+inline int xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks){
+  if (ticks == portMAX_DELAY){
+    sem->lock();
+    return pdTRUE;
+  }
+  return sem->try_lock_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS)) ? pdTRUE : pdFALSE;
+}
+inline int xSemaphoreGive(SemaphoreHandle_t sem){
+  sem->unlock();
+  return pdTRUE;
+}
+
+// copy-in copy-out queue of fixed size items
+typedef struct {
+    std::mutex lock;
+    std::condition_variable changed;
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    UBaseType_t head;
+    UBaseType_t count;
+} tHostQueue;
+typedef tHostQueue *QueueHandle_t;
+#define errQUEUE_FULL         pdFALSE
+#define errQUEUE_EMPTY        pdFALSE
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size){
+  QueueHandle_t queue = new tHostQueue();
+  queue->items = new uint8_t[length * item_size];
+  queue->length = length;
+  queue->itemSize = item_size;
+  queue->head = 0;
+  queue->count = 0;
+  return queue;
+}
+inline void vQueueDelete(QueueHandle_t queue){
+  delete[] queue->items;
+  delete queue;
+}
+inline std::chrono::steady_clock::time_point host_deadline(TickType_t ticks){
+  return std::chrono::steady_clock::now() + std::chrono::milliseconds(ticks == portMAX_DELAY ? 1000000000UL : ticks * portTICK_PERIOD_MS);
+}
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks){
+  std::unique_lock<std::mutex> guard(queue->lock);
+  if (!queue->changed.wait_until(guard, host_deadline(ticks), [queue]{return queue->count < queue->length;})) return errQUEUE_FULL;
+  memcpy(&queue->items[((queue->head + queue->count) % queue->length) * queue->itemSize], item, queue->itemSize);
+  queue->count++;
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+inline BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks){
+  std::unique_lock<std::mutex> guard(queue->lock);
+  if (!queue->changed.wait_until(guard, host_deadline(ticks), [queue]{return queue->count > 0;})) return errQUEUE_EMPTY;
+  memcpy(item, &queue->items[queue->head * queue->itemSize], queue->itemSize);
+  queue->head = (queue->head + 1) % queue->length;
+  queue->count--;
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue){
+  std::lock_guard<std::mutex> guard(queue->lock);
+  return queue->count;
+}
+
+class Stream {
+  public:
+    virtual ~Stream(){}
+
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual size_t write(uint8_t data) = 0;
+    virtual size_t write(const uint8_t *buf, size_t size){
+      size_t n = 0;
+      while (n < size && write(buf[n])) n++;
+      return n;
+    }
+    virtual void flush(){}
+
+    void setTimeout(unsigned long timeout){_timeout = timeout;}
+
+    size_t readBytes(uint8_t *buf, size_t length){
+      size_t count = 0;
+      uint32_t start = millis();
+      while (count < length && millis() - start < _timeout){
+        int c = read();
+        if (c < 0){
+          std::this_thread::yield();
+          continue;
+        }
+        buf[count++] = (uint8_t) c;
+      }
+      return count;
+    }
+
+  protected:
+    unsigned long _timeout = 1000;
+};
+
+#endif
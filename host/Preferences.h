@@ -0,0 +1,76 @@
+/**
+ * @file Preferences.h
+ * @brief File backed stand-in for the NVS Preferences library of the ESP32 Arduino core
+ *
+ * Each key of a namespace is one file, <directory>/<namespace>.<key>, written to
+ * a temporary file and renamed over the old one, so a crash never leaves half a
+ * value behind, like an NVS commit. Only the blob functions are provided. The
+ * directory is the current one unless set_directory() chose another (host only).
+ */
+
+#ifndef host_preferences_h
+#define host_preferences_h
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+class Preferences {
+  public:
+    static void set_directory(const char *dir){directory() = dir;}
+
+    bool begin(const char *name, bool readOnly = false){
+      _name = name;
+      _read_only = readOnly;
+      _open = true;
+      return true;
+    }
+    void end(){_open = false;}
+
+    size_t putBytes(const char *key, const void *value, size_t len){
+      if (!_open || _read_only) return 0;
+      std::string path = file(key), tmp = path + ".tmp";
+      FILE *f = fopen(tmp.c_str(), "wb");
+      if (!f) return 0;
+      size_t written = fwrite(value, 1, len, f);
+      bool ok = fclose(f) == 0 && written == len && rename(tmp.c_str(), path.c_str()) == 0;
+      if (!ok) ::remove(tmp.c_str());
+      return ok ? len : 0;
+    }
+
+    size_t getBytesLength(const char *key){
+      FILE *f = _open ? fopen(file(key).c_str(), "rb") : nullptr;
+      if (!f) return 0;
+      fseek(f, 0, SEEK_END);
+      long len = ftell(f);
+      fclose(f);
+      return len > 0 ? len : 0;
+    }
+
+    size_t getBytes(const char *key, void *buf, size_t maxLen){
+      size_t len = getBytesLength(key);
+      if (!len || len > maxLen) return 0;
+      FILE *f = fopen(file(key).c_str(), "rb");
+      if (!f) return 0;
+      size_t got = fread(buf, 1, len, f);
+      fclose(f);
+      return got == len ? len : 0;
+    }
+
+    bool remove(const char *key){
+      return _open && !_read_only && ::remove(file(key).c_str()) == 0;
+    }
+
+  private:
+    static std::string &directory(){
+      static std::string dir = ".";
+      return dir;
+    }
+    std::string file(const char *key){return directory() + "/" + _name + "." + key;}
+
+    std::string _name;
+    bool _read_only = false;
+    bool _open = false;
+};
+
+#endif
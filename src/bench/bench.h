@@ -0,0 +1,52 @@
+/**
+ * @file bench.h
+ * @brief Host side benchmark suites, built by the native environment only
+ *
+ * Run all suites with `pio run -e native -t exec`, or a single one by passing
+ * its name to the program (i.e. .pio/build/native/program crc16). Suites also
+ * verify what they measure; the program exits non-zero if any check failed.
+ */
+
+#ifndef bench_h
+#define bench_h
+
+#include <stdint.h>
+#include <chrono>
+
+typedef struct {
+  const char *name;
+  void (*run)();
+} tBenchSuite;
+
+inline uint64_t bench_now_ns(){
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Records the outcome of a check
+ * @return ok, so the verdict can be printed from it
+ */
+bool bench_check(bool ok);
+
+void bench_crc16();
+void bench_transactions();
+void bench_polling();
+void bench_bus();
+void bench_snapshot();
+void bench_presets();
+void bench_history();
+void bench_metrics();
+void bench_profile();
+void bench_guard();
+void bench_frames();
+void bench_watch();
+void bench_comm();
+void bench_stream();
+void bench_console();
+void bench_link();
+void bench_gateway();
+void bench_capture();
+void bench_boot();
+void bench_discover();
+
+#endif
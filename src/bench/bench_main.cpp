@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+
+static const tBenchSuite suites[] = {
+  {"crc16", bench_crc16},
+  {"transactions", bench_transactions},
+  {"polling", bench_polling},
+  {"bus", bench_bus},
+  {"snapshot", bench_snapshot},
+  {"presets", bench_presets},
+  {"history", bench_history},
+  {"metrics", bench_metrics},
+  {"profile", bench_profile},
+  {"guard", bench_guard},
+  {"frames", bench_frames},
+  {"watch", bench_watch},
+  {"comm", bench_comm},
+  {"stream", bench_stream},
+  {"console", bench_console},
+  {"link", bench_link},
+  {"gateway", bench_gateway},
+  {"capture", bench_capture},
+  {"boot", bench_boot},
+  {"discover", bench_discover},
+};
+
+static uint32_t failed_checks = 0;
+
+bool bench_check(bool ok){
+  if (!ok) failed_checks++;
+  return ok;
+}
+
+int main(int argc, char **argv){
+  const char *only = argc > 1 ? argv[1] : nullptr;
+  bool ran = false;
+  uint8_t failed_suites = 0;
+
+  for (const tBenchSuite &suite : suites){
+    if (only && strcmp(only, suite.name) != 0) continue;
+    printf("=== %s ===\n", suite.name);
+    uint32_t before = failed_checks;
+    suite.run();
+    if (failed_checks != before){
+      printf("=== %s FAILED, %u checks ===\n", suite.name, failed_checks - before);
+      failed_suites++;
+    }
+    printf("\n");
+    ran = true;
+  }
+
+  if (!ran){
+    printf("unknown suite '%s', available:", only);
+    for (const tBenchSuite &suite : suites) printf(" %s", suite.name);
+    printf("\n");
+    return 1;
+  }
+  if (failed_suites) printf("%u suites failed\n", failed_suites);
+  return failed_suites ? 1 : 0;
+}
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <Preferences.h>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../components/xy_persist.h"
+#include "../sim/xy6020l_sim.h"
+
+#define BOOT_BENCH_VOLT     1250    // setpoints the application applies
+#define BOOT_BENCH_CURRENT  300
+
+enum BootCase { BOOT_OLD_SETUP, BOOT_COLD, BOOT_WARM, BOOT_SETPOINT_LOST, BOOT_PANEL_EDIT, BOOT_CORRUPT, BOOT_NEW_FIRMWARE };
+
+// a device that kept its state while the controller rebooted
+static void prepare_device(xy6020l_sim &sim, uint32_t baud){
+  tSimConfig config = xy6020l_sim::default_config();
+  config.baud = baud;
+  sim.set_config(config);
+  for (uint8_t num = 0; num < PRESET_COUNT; num++){
+    sim.set_register(HREG_IDX_M0 + (num * HREG_IDX_M_OFFSET) + HREG_IDX_M_VSET, 500 + (num * 100));
+  }
+  sim.set_register(HREG_IDX_CV, BOOT_BENCH_VOLT);
+  sim.set_register(HREG_IDX_CC, BOOT_BENCH_CURRENT);
+  sim.set_register(HREG_IDX_MEMORY, 2);
+}
+
+// what setup() did before: read everything, then write the setpoints one blocking write each
+static bool old_setup(xy6020l &psu){
+  bool ok = psu.get_all_hold_regs() && psu.load_presets();
+  ok = ok && psu.set_volt(BOOT_BENCH_VOLT) && psu.flush_writes(true);
+  ok = ok && psu.set_current(BOOT_BENCH_CURRENT) && psu.flush_writes(true);
+  return ok;
+}
+
+// every preset the driver serves must match the device
+static bool presets_match(xy6020l &psu, xy6020l_sim &sim){
+  for (uint8_t num = 0; num < PRESET_COUNT; num++){
+    uint8_t words[MEM_REGS * 2];
+    if (!psu.get_preset_words(num, words)) return false;
+    for (uint8_t reg = 0; reg < MEM_REGS; reg++){
+      uint16_t value = (words[reg * 2] << 8) | words[(reg * 2) + 1];
+      if (value != sim.get_register(HREG_IDX_M0 + (num * HREG_IDX_M_OFFSET) + reg)) return false;
+    }
+  }
+  return true;
+}
+
+static char image_path[64];
+
+static void run_case(const char *name, BootCase boot, uint32_t baud){
+  // the image a previous run of the controller left behind
+  {
+    xy6020l_sim sim;
+    prepare_device(sim, baud);
+    xy6020l psu(&sim);
+    psu.begin(baud);
+    xy_persist persist(&psu);
+    persist.erase();
+    if (boot != BOOT_OLD_SETUP && boot != BOOT_COLD){
+      old_setup(psu);
+      persist.save();
+    }
+  }
+  if (boot == BOOT_CORRUPT){
+    FILE *f = fopen(image_path, "r+b");
+    if (f){
+      fseek(f, 40, SEEK_SET);
+      fputc(0x5A, f);
+      fclose(f);
+    }
+  }
+
+  xy6020l_sim sim;
+  prepare_device(sim, baud);
+  if (boot == BOOT_SETPOINT_LOST) sim.set_register(HREG_IDX_CV, 500);
+  if (boot == BOOT_PANEL_EDIT) sim.set_register(HREG_IDX_M0 + (2 * HREG_IDX_M_OFFSET) + HREG_IDX_M_ISET, 150);
+  if (boot == BOOT_NEW_FIRMWARE) sim.set_register(HREG_IDX_VERSION, 0x72);
+  xy6020l psu(&sim);
+  psu.begin(baud);
+  sim.reset_stats();
+
+  tBootReport report = {};
+  bool ok;
+  uint32_t start = millis();
+  if (boot == BOOT_OLD_SETUP){
+    ok = old_setup(psu);
+    report.readyMs = millis() - start;
+  } else {
+    xy_persist persist(&psu);
+    ok = persist.restore(report);
+  }
+  const tSimStats &stats = sim.stats();
+  bool consistent = ok && sim.get_register(HREG_IDX_CV) == BOOT_BENCH_VOLT && (boot == BOOT_COLD || presets_match(psu, sim));
+  printf("%-26s %6u %7u %8u %8u %8u %8u  %s\n", name, baud, report.readyMs, stats.requests, stats.bytesIn + stats.bytesOut,
+         report.presetsRestored, stats.requests - stats.replies, bench_check(consistent) ? "ok" : "MISMATCH");
+}
+
+void bench_boot(){
+  // the file backed Preferences of the host build keep the image in a scratch directory
+  char dir[] = "/tmp/xy_boot_XXXXXX";
+  if (!mkdtemp(dir)){
+    printf("no scratch directory\n");
+    return;
+  }
+  Preferences::set_directory(dir);
+  snprintf(image_path, sizeof(image_path), "%s/%s.%s", dir, PERSIST_NAMESPACE, PERSIST_KEY);
+
+  const uint32_t bauds[] = {115200, 9600};
+  for (uint32_t baud : bauds){
+    printf("%-26s %6s %7s %8s %8s %8s %8s  %s\n", "boot", "baud", "ms", "requests", "bytes", "presets", "failed", "state");
+    run_case("old setup(), full scan", BOOT_OLD_SETUP, baud);
+    run_case("restore, no image", BOOT_COLD, baud);
+    run_case("restore, warm", BOOT_WARM, baud);
+    run_case("restore, setpoint lost", BOOT_SETPOINT_LOST, baud);
+    run_case("restore, panel edit", BOOT_PANEL_EDIT, baud);
+    run_case("restore, corrupted image", BOOT_CORRUPT, baud);
+    run_case("restore, new firmware", BOOT_NEW_FIRMWARE, baud);
+    printf("\n");
+  }
+  printf("presets: copies taken from flash; state: setpoints and every cached preset match the device\n");
+  remove(image_path);
+  rmdir(dir);
+  Preferences::set_directory(".");
+}
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../components/xy_bus.h"
+#include "../sim/xy6020l_sim.h"
+
+#define BUS_RUN_MS  2000
+
+static void device_task(xy6020l *psu, std::atomic<bool> *running, uint32_t *ok, uint32_t *writes){
+  uint32_t i = 0;
+  while (running->load()){
+    // a telemetry task that also adjusts its setpoint every tenth cycle
+    if (psu->get_all_hold_regs()) (*ok)++;
+    if (++i % 10 == 0 && psu->set_volt(1000 + (i % 100)) && psu->flush_writes(true)) (*writes)++;
+  }
+}
+
+static void count_done(const tTxnResult &, void *ctx){
+  (*(uint32_t *) ctx)++;
+}
+
+// a unit asking for a longer silence than its neighbour, the bus waits for it without counting a transaction
+static void run_mixed_gaps(){
+  xy6020l_sim sims[2] = {xy6020l_sim(1), xy6020l_sim(2)};
+  xy6020l_sim_bus wire;
+  xy_bus bus(&wire);
+  xy6020l psus[2] = {xy6020l(nullptr, 1), xy6020l(nullptr, 2)};
+  for (uint8_t i = 0; i < 2; i++){
+    wire.add(&sims[i]);
+    bus.attach(&psus[i]);
+  }
+  bus.begin(115200);
+  psus[1].set_inter_frame_gap_us(5000);
+
+  uint32_t done[2] = {0, 0};
+  uint32_t end = millis() + 500;
+  while (millis() < end){
+    for (uint8_t i = 0; i < 2; i++) if (psus[i].get_pending_transactions() < 2) psus[i].submit_read(HREG_IDX_CV, 4, count_done, &done[i]);
+    bus.process();
+  }
+  while (!psus[0].is_idle() || !psus[1].is_idle()) bus.process();
+
+  bool ok = bus.get_device_transactions(0) == done[0] && bus.get_device_transactions(1) == done[1];
+  printf("mixed frame gaps: %u + %u transactions, bus counted %u + %u -> %s\n", done[0], done[1], bus.get_device_transactions(0),
+         bus.get_device_transactions(1), bench_check(ok) ? "ok" : "MISCOUNTED");
+}
+
+void bench_bus(){
+  const uint8_t device_counts[] = {1, 2, 4, 8};
+
+  printf("%-8s %10s %10s %8s %10s  %s\n", "devices", "reads/s", "writes/s", "limit", "bus used", "share per device (%)");
+
+  for (uint8_t devices : device_counts){
+    xy6020l_sim *sims[BUS_MAX_DEVICES];
+    xy6020l *psus[BUS_MAX_DEVICES];
+    xy6020l_sim_bus wire;
+    xy_bus bus(&wire);
+
+    for (uint8_t i = 0; i < devices; i++){
+      sims[i] = new xy6020l_sim(i + 1);
+      wire.add(sims[i]);
+      psus[i] = new xy6020l(nullptr, i + 1);
+      bus.attach(psus[i]);
+    }
+    bus.begin(115200);
+
+    std::atomic<bool> running(true);
+    uint32_t ok[BUS_MAX_DEVICES] = {0}, writes[BUS_MAX_DEVICES] = {0};
+    std::thread tasks[BUS_MAX_DEVICES];
+    uint64_t start = bench_now_ns();
+    bus.reset_stats();
+
+    for (uint8_t i = 0; i < devices; i++) tasks[i] = std::thread(device_task, psus[i], &running, &ok[i], &writes[i]);
+    delay(BUS_RUN_MS);
+    running = false;
+    for (uint8_t i = 0; i < devices; i++) tasks[i].join();
+
+    double seconds = (bench_now_ns() - start) / 1e9;
+    uint32_t total_ok = 0, total_writes = 0;
+    for (uint8_t i = 0; i < devices; i++){
+      total_ok += ok[i];
+      total_writes += writes[i];
+    }
+
+    // request + turnaround + reply + gap of one full poll is the wire limit
+    uint32_t poll_us = (8 + 65) * psus[0]->get_char_time_us() + psus[0]->get_srtt_us() + psus[0]->get_t35_us();
+    printf("%-8u %10.0f %10.0f %7.0f/s %9.1f%% ", devices, total_ok / seconds, total_writes / seconds,
+           1e6 / poll_us, bus.get_utilization() / 10.0);
+    for (uint8_t i = 0; i < devices; i++) printf(" %4.1f", bus.get_device_bus_share(i) / 10.0);
+    printf("\n");
+
+    for (uint8_t i = 0; i < devices; i++){
+      delete psus[i];
+      delete sims[i];
+    }
+  }
+
+  run_mixed_gaps();
+}
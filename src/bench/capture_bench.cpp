@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../components/xy_capture.h"
+#include "../sim/xy6020l_sim.h"
+#include "../sim/xy6020l_replay.h"
+
+#define CAPTURE_BENCH_ADDS      1000000
+#define CAPTURE_BENCH_TXNS      30      // two records each, the whole conversation fits the ring
+
+static void bench_add(const char *name, bool enabled, uint8_t len){
+  static xy_capture capture;
+  uint8_t frame[CAPTURE_FRAME_MAX];
+  for (uint8_t i = 0; i < len; i++) frame[i] = i;
+  capture.clear();
+  capture.set_enabled(enabled);
+
+  uint64_t t0 = bench_now_ns();
+  for (uint32_t i = 0; i < CAPTURE_BENCH_ADDS; i++) capture.add(CAPTURE_RX, TXN_OK, frame, len, i);
+  uint64_t t1 = bench_now_ns();
+  printf("%-34s %8.1f ns\n", name, (double)(t1 - t0) / CAPTURE_BENCH_ADDS);
+}
+
+typedef struct {
+  volatile bool done;
+  TxnStatus status;
+} tBenchTxn;
+
+static void bench_txn_done(const tTxnResult &result, void *ctx){
+  tBenchTxn *txn = (tBenchTxn *) ctx;
+  txn->status = result.status;
+  txn->done = true;
+}
+
+// the same mix of reads and setpoint writes, one transaction at a time
+static void run_conversation(xy6020l &psu, TxnStatus *statuses){
+  for (uint8_t i = 0; i < CAPTURE_BENCH_TXNS; i++){
+    tBenchTxn txn = {false, TXN_PENDING};
+    if (i % 5 == 4) psu.submit_write_single(HREG_IDX_CV, 1200 + i, bench_txn_done, &txn);
+    else if (i % 5 == 3) psu.submit_read(HREG_IDX_CV, 30, bench_txn_done, &txn);
+    else psu.submit_read(HREG_IDX_ACT_V, 3, bench_txn_done, &txn);
+    while (!txn.done) psu.process();
+    statuses[i] = txn.status;
+  }
+}
+
+static void bench_round_trip(){
+  // a bad link: lost bytes and corrupted replies
+  xy6020l_sim sim;
+  tSimConfig config = xy6020l_sim::default_config();
+  config.dropBytePpm = 5000;
+  config.crcCorruptPpm = 100000;
+  config.seed = 7;
+  sim.set_config(config);
+
+  xy6020l psu(&sim);
+  xy_capture capture;
+  capture.set_enabled(true);
+  psu.set_capture(&capture);
+  TxnStatus recorded[CAPTURE_BENCH_TXNS];
+  run_conversation(psu, recorded);
+  tSnapshot original;
+  psu.get_snapshot(original);
+
+  // through the text export, as from the console of a rig
+  xy6020l_replay replay;
+  tCaptureRecord record;
+  char line[CAPTURE_LINE_MAX];
+  size_t text_bytes = 0;
+  for (uint16_t i = 0; capture.get(i, record); i++){
+    text_bytes += xy_capture::format(record, line, sizeof(line));
+    replay.load_line(line);
+  }
+
+  xy6020l replayed_psu(&replay);
+  TxnStatus replayed[CAPTURE_BENCH_TXNS];
+  uint32_t start = millis();
+  run_conversation(replayed_psu, replayed);
+  uint32_t replay_ms = millis() - start;
+  tSnapshot copy;
+  replayed_psu.get_snapshot(copy);
+
+  uint8_t failed = 0, matched = 0;
+  for (uint8_t i = 0; i < CAPTURE_BENCH_TXNS; i++){
+    if (recorded[i] != TXN_OK) failed++;
+    if (recorded[i] == replayed[i]) matched++;
+  }
+  bool same_regs = memcmp(original.regs, copy.regs, sizeof(original.regs)) == 0;
+  bench_check(matched == CAPTURE_BENCH_TXNS && replay.stats().mismatched == 0 && replay.finished());
+  printf("recorded %u transactions (%u failed) as %u records, %u bytes of text\n", CAPTURE_BENCH_TXNS, failed, capture.count(),
+         (unsigned) text_bytes);
+  printf("replayed in %u ms: %u/%u statuses match, registers %s, %u requests differ, recording %s\n", replay_ms, matched,
+         CAPTURE_BENCH_TXNS, bench_check(same_regs) ? "match" : "DIFFER", replay.stats().mismatched, replay.finished() ? "used up" : "left over");
+}
+
+static void bench_freeze(){
+  xy6020l_sim sim;
+  tSimConfig config = xy6020l_sim::default_config();
+  config.crcCorruptPpm = 20000;
+  config.seed = 3;
+  sim.set_config(config);
+
+  xy6020l psu(&sim);
+  xy_capture capture;
+  capture.freeze_after_error(6);
+  capture.set_enabled(true);
+  psu.set_capture(&capture);
+
+  uint32_t txns = 0;
+  while (capture.is_enabled() && txns < 5000){
+    tBenchTxn txn = {false, TXN_PENDING};
+    psu.submit_read(HREG_IDX_ACT_V, 3, bench_txn_done, &txn);
+    while (!txn.done) psu.process();
+    txns++;
+  }
+
+  tCaptureStats stats;
+  capture.get_stats(stats);
+  tCaptureRecord record;
+  int16_t fault = -1;
+  for (uint16_t i = 0; capture.get(i, record); i++) if (fault < 0 && record.status != TXN_OK) fault = i;
+  printf("freeze after error: %s after %u transactions, first failed record at %d of %u\n", bench_check(stats.frozen) ? "frozen" : "NOT frozen",
+         txns, fault, capture.count());
+}
+
+void bench_capture(){
+  printf("%-34s %11s\n", "capture add()", "per record");
+  bench_add("off", false, 11);
+  bench_add("on, 8 byte request", true, 8);
+  bench_add("on, 11 byte reply", true, 11);
+  bench_add("on, 65 byte reply", true, 65);
+  printf("\n");
+  bench_round_trip();
+  bench_freeze();
+}
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../components/xy_comm.h"
+#include "../sim/xy6020l_sim.h"
+
+#define COMM_BENCH_PERIOD_MS    10
+#define COMM_BENCH_WORK_US      1000    // application work per loop pass
+#define COMM_BENCH_RUN_MS       3000
+#define COMM_BENCH_MAX_LOOPS    ((COMM_BENCH_RUN_MS / COMM_BENCH_PERIOD_MS) + 16)
+
+enum CommBenchMode { MODE_BLOCKING, MODE_PROCESS, MODE_COMM_TASK };
+
+typedef struct {
+  uint32_t jitter[COMM_BENCH_MAX_LOOPS];   // distance of each pass start from one period after the previous
+  uint32_t loops;
+  uint32_t frames;          // telemetry frames the application received
+} tLoopRun;
+
+static void busy_wait_us(uint32_t us){
+  uint32_t start = micros();
+  while (micros() - start < us);
+}
+
+static void run_mode(const char *name, CommBenchMode mode){
+  xy6020l_sim sim;
+  xy6020l psu(&sim);
+  xy_comm comm(&psu);
+  // asks for more than the link can carry: about 270 reads/s against some 180
+  psu.add_poll_group(HREG_IDX_ACT_V, 3, 5);
+  psu.add_poll_group(HREG_IDX_PROTECT, 3, 20);
+  psu.add_poll_group(HREG_IDX_IN_V, 10, 50);
+  if (mode != MODE_BLOCKING) psu.start_polling();
+  if (mode == MODE_COMM_TASK) comm.start();
+
+  static tLoopRun run;
+  run = {};
+  uint32_t last_seq = 0;
+  uint16_t volt = 1200;
+
+  // loop() of the application: a fixed period, some work, telemetry in, a setpoint out now and then
+  TickType_t last_wake = xTaskGetTickCount();
+  vTaskDelayUntil(&last_wake, 1);
+  uint32_t base_us = micros();
+  uint32_t pass_us = base_us;
+  sim.reset_stats();
+
+  while (run.loops < COMM_BENCH_MAX_LOOPS && micros() - base_us < COMM_BENCH_RUN_MS * 1000UL){
+    uint32_t now = micros();
+    int32_t off = (int32_t)(now - pass_us) - (COMM_BENCH_PERIOD_MS * 1000);
+    if (run.loops) run.jitter[run.loops - 1] = off > 0 ? off : -off;
+    pass_us = now;
+    run.loops++;
+
+    busy_wait_us(COMM_BENCH_WORK_US);
+    bool setpoint = run.loops % 10 == 0;
+    if (setpoint) volt = volt == 1200 ? 1201 : 1200;
+
+    if (mode == MODE_BLOCKING){
+      if (psu.get_all_hold_regs()) run.frames++;
+      if (setpoint){
+        psu.set_volt(volt);
+        psu.flush_writes(true);
+      }
+    } else if (mode == MODE_PROCESS){
+      psu.process();
+      uint32_t seq = psu.get_snapshot_sequence();
+      if (seq != last_seq) run.frames++;
+      last_seq = seq;
+      if (setpoint){
+        psu.set_volt(volt);
+        psu.flush_writes();
+      }
+    } else {
+      tCommTelemetry telemetry;
+      while (comm.receive_telemetry(telemetry)) run.frames++;
+      if (setpoint){
+        comm.set_register(HREG_IDX_CV, volt);
+        comm.flush();
+      }
+    }
+
+    // a pass that overran starts the next one right away, like vTaskDelayUntil does
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(COMM_BENCH_PERIOD_MS));
+  }
+
+  uint32_t elapsed_ms = (micros() - base_us) / 1000;
+  uint32_t replies = sim.stats().replies;
+  uint64_t bus_us = sim.stats().busTimeUs;
+  comm.stop();
+
+  uint32_t periods = run.loops - 1;
+  std::sort(run.jitter, run.jitter + periods);
+  printf("%-24s %6u %8u %8u %8u %8u %9.1f %8.1f%%\n", name, run.loops, run.jitter[periods / 2], run.jitter[(periods * 99) / 100],
+         run.jitter[periods - 1], (replies * 1000) / elapsed_ms, (run.frames * 1000.0) / elapsed_ms, (bus_us / 10.0) / elapsed_ms);
+}
+
+static void bench_queue(){
+  // raw hand-over cost between two threads, the way the comm task and loop() use it
+  static xy_spsc_queue<tCommTelemetry, 64> queue;
+  const uint32_t items = 1000000;
+  uint64_t t0 = bench_now_ns();
+
+  std::thread consumer([&]{
+    tCommTelemetry item;
+    uint32_t got = 0, last = 0;
+    bool ordered = true;
+    while (got < items){
+      if (!queue.pop(item)){
+        std::this_thread::yield();
+        continue;
+      }
+      if (got && item.seq != last + 1) ordered = false;
+      last = item.seq;
+      got++;
+    }
+    if (!ordered) printf("spsc queue: items out of order\n");
+  });
+
+  tCommTelemetry item = {};
+  for (uint32_t i = 0; i < items; i++){
+    item.seq = i;
+    while (!queue.push(item)) std::this_thread::yield();
+  }
+  consumer.join();
+  uint64_t ns = bench_now_ns() - t0;
+  printf("spsc hand-over of %u %u byte items between two threads: %.1f ns per item (%u cpus)\n", items, (unsigned) sizeof(item),
+         (double) ns / items, std::thread::hardware_concurrency());
+
+  // the cost each side pays when the other one is not running
+  t0 = bench_now_ns();
+  for (uint32_t i = 0; i < items; i++){
+    item.seq = i;
+    queue.push(item);
+    queue.pop(item);
+  }
+  ns = bench_now_ns() - t0;
+  printf("push + pop on one thread: %.1f ns per item\n", (double) ns / items);
+}
+
+void bench_comm(){
+  printf("application loop every %u ms with %u us of work, %u s per design\n", COMM_BENCH_PERIOD_MS, COMM_BENCH_WORK_US, COMM_BENCH_RUN_MS / 1000);
+  printf("%-24s %6s %8s %8s %8s %8s %9s %9s\n", "design", "loops", "jit p50", "jit p99", "jit max", "txn/s", "frames/s", "bus used");
+  run_mode("one task, blocking", MODE_BLOCKING);
+  run_mode("one task, process()", MODE_PROCESS);
+  run_mode("comm task + spsc", MODE_COMM_TASK);
+  printf("jitter in us, distance of the pass start from one period after the previous pass\n\n");
+  bench_queue();
+}
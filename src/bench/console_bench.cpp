@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../components/xy_comm.h"
+#include "../components/xy_console.h"
+#include "../sim/xy6020l_sim.h"
+
+#define CONSOLE_BENCH_KEY_MS      60      // typing speed
+#define CONSOLE_BENCH_COMMANDS    8
+#define CONSOLE_BENCH_MAX_PASSES  2000
+
+// a user typing a script: each character becomes readable CONSOLE_BENCH_KEY_MS after the previous one
+class typing_port : public Stream
+{
+  public:
+    void type(const char *script){
+      _script = script;
+      _pos = 0;
+      _next_ms = millis() + CONSOLE_BENCH_KEY_MS;
+    }
+    bool done(){return !_script[_pos];}
+    uint32_t enter_ms = 0;              // when the last line end became readable
+    uint32_t replies = 0;
+    uint32_t latency[CONSOLE_BENCH_COMMANDS * 2];
+
+    int available() override {return _script && _script[_pos] && (int32_t)(millis() - _next_ms) >= 0;}
+    int peek() override {return available() ? _script[_pos] : -1;}
+    int read() override {
+      if (!available()) return -1;
+      char c = _script[_pos++];
+      _next_ms += CONSOLE_BENCH_KEY_MS;
+      if (c == '\n') enter_ms = millis();
+      return c;
+    }
+    size_t write(uint8_t data) override {return write(&data, 1);}
+    size_t write(const uint8_t *, size_t size) override {
+      // the first output after a line end is its reply
+      if (enter_ms){
+        if (replies < CONSOLE_BENCH_COMMANDS * 2) latency[replies++] = millis() - enter_ms;
+        enter_ms = 0;
+      }
+      return size;
+    }
+
+  private:
+    const char *_script = nullptr;
+    size_t _pos = 0;
+    uint32_t _next_ms = 0;
+};
+
+// Stream::parseInt() of the Arduino core: skips to a digit, waits up to the timeout for every character
+static long parse_int(Stream *port){
+  auto timed_peek = [port]{
+    uint32_t start = millis();
+    do {
+      int c = port->peek();
+      if (c >= 0) return c;
+      delay(1);
+    } while (millis() - start < 1000);
+    return -1;
+  };
+
+  int c;
+  while ((c = timed_peek()) >= 0 && c != '-' && (c < '0' || c > '9')) port->read();
+  if (c < 0) return 0;
+
+  long value = 0;
+  while (c >= '0' && c <= '9'){
+    value = (value * 10) + (c - '0');
+    port->read();
+    c = timed_peek();
+  }
+  return value;
+}
+
+typedef struct {
+  uint32_t gap[CONSOLE_BENCH_MAX_PASSES];
+  uint32_t passes;
+} tPasses;
+
+static void print_run(const char *name, tPasses &passes, uint32_t period_ms, typing_port &port){
+  std::sort(passes.gap, passes.gap + passes.passes);
+  std::sort(port.latency, port.latency + port.replies);
+  uint32_t p50 = passes.gap[passes.passes / 2];
+  uint32_t max = passes.gap[passes.passes - 1];
+  printf("%-28s %6u %8u %8u %8u %10u %10u\n", name, period_ms, p50, max, port.replies,
+         port.replies ? port.latency[port.replies / 2] : 0, port.replies ? port.latency[port.replies - 1] : 0);
+}
+
+static void run_parse_int(){
+  xy6020l_sim sim;
+  xy6020l psu(&sim);
+  psu.use_default_poll_plan();
+  psu.start_polling();
+
+  // the loop() this replaces: parseInt, a blocking read of the registers, delay(50)
+  static char script[CONSOLE_BENCH_COMMANDS * 8];
+  script[0] = '\0';
+  for (uint8_t i = 0; i < CONSOLE_BENCH_COMMANDS; i++) strcat(script, i % 2 ? "12\n" : "2\n");
+  typing_port port;
+  port.type(script);
+
+  static tPasses passes;
+  passes = {};
+  uint32_t last = millis();
+  while (!port.done() && passes.passes < CONSOLE_BENCH_MAX_PASSES){
+    uint32_t now = millis();
+    passes.gap[passes.passes++] = now - last;
+    last = now;
+
+    psu.process();
+    if (port.available()){
+      long reg = parse_int(&port);
+      if (reg >= 0 && reg < 30 && psu.get_all_hold_regs()) port.write('.');
+    }
+    delay(50);
+  }
+  print_run("parseInt + blocking read", passes, 50, port);
+}
+
+static void run_console(){
+  xy6020l_sim sim;
+  xy6020l psu(&sim);
+  xy_comm comm(&psu);
+  psu.use_default_poll_plan();
+  psu.start_polling();
+  comm.start();
+
+  static char script[CONSOLE_BENCH_COMMANDS * 16];
+  script[0] = '\0';
+  for (uint8_t i = 0; i < CONSOLE_BENCH_COMMANDS; i++) strcat(script, i % 2 ? "read 12 3\n" : "status\n");
+  typing_port port;
+  xy_console console(&port, &comm, &psu);
+  delay(200);
+  port.type(script);
+
+  static tPasses passes;
+  passes = {};
+  uint32_t last = millis();
+  uint64_t poll_ns = 0;
+  while ((!port.done() || port.enter_ms) && passes.passes < CONSOLE_BENCH_MAX_PASSES){
+    uint32_t now = millis();
+    passes.gap[passes.passes++] = now - last;
+    last = now;
+
+    uint64_t t0 = bench_now_ns();
+    console.poll();
+    poll_ns += bench_now_ns() - t0;
+    delay(10);
+  }
+  comm.stop();
+  print_run("console.poll() + comm task", passes, 10, port);
+  printf("console.poll() takes %.1f us on average\n", poll_ns / (1000.0 * passes.passes));
+}
+
+void bench_console(){
+  printf("%u commands typed at %u ms per key, loop pass gaps and the time from Enter to the reply in ms\n",
+         CONSOLE_BENCH_COMMANDS, CONSOLE_BENCH_KEY_MS);
+  printf("%-28s %6s %8s %8s %8s %10s %10s\n", "loop()", "period", "gap p50", "gap max", "replies", "reply p50", "reply max");
+  run_parse_int();
+  run_console();
+}
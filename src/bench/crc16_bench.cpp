@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "../components/crc16.h"
+
+// the bit at a time implementation the driver used before the table version
+static uint16_t crc16_bitwise(const uint8_t *data, size_t length){
+  uint16_t crc = 0xFFFF;
+
+  for (size_t i = 0; i < length; i++){
+    crc ^= data[i];
+
+    for (uint8_t j = 0; j < 8; j++){
+      if (crc & 0x0001){
+        crc >>= 1;
+        crc ^= 0xA001;
+      } else {
+        crc >>= 1;
+      }
+    }
+  }
+  return crc;
+}
+
+static uint16_t crc16_table(const uint8_t *data, size_t length){
+  uint16_t crc = CRC16_MODBUS_INIT;
+  for (size_t i = 0; i < length; i++) crc = crc16_update_table(crc, data[i]);
+  return crc;
+}
+
+static uint16_t crc16_nibble(const uint8_t *data, size_t length){
+  uint16_t crc = CRC16_MODBUS_INIT;
+  for (size_t i = 0; i < length; i++) crc = crc16_update_nibble(crc, data[i]);
+  return crc;
+}
+
+typedef struct {
+  const char *name;
+  uint16_t (*calc)(const uint8_t *, size_t);
+} tCrcVariant;
+
+static const tCrcVariant variants[] = {
+  {"bitwise", crc16_bitwise},
+  {"table256", crc16_table},
+  {"nibble16", crc16_nibble},
+};
+
+void bench_crc16(){
+  // request frame, FC 0x10 preset body, full 30 register poll reply
+  const size_t frame_sizes[] = {8, 28, 65};
+  const uint32_t iterations = 2000000;
+
+  uint8_t frame[65];
+  srand(1);
+  for (uint8_t &b : frame) b = rand() & 0xFF;
+
+  printf("%-10s %6s %12s %12s %9s\n", "variant", "bytes", "ns/frame", "MB/s", "speedup");
+
+  for (size_t length : frame_sizes){
+    const uint8_t first_byte = frame[0];
+    uint16_t reference = crc16_bitwise(frame, length);
+    double baseline_ns = 0;
+
+    for (const tCrcVariant &variant : variants){
+      if (!bench_check(variant.calc(frame, length) == reference)){
+        printf("%-10s %6zu MISMATCH\n", variant.name, length);
+        continue;
+      }
+
+      volatile uint16_t sink = 0;
+      uint64_t start = bench_now_ns();
+      for (uint32_t i = 0; i < iterations; i++){
+        frame[0] = (uint8_t) i;   // defeat hoisting of the loop invariant
+        sink = sink ^ variant.calc(frame, length);
+      }
+      double ns = (double)(bench_now_ns() - start) / iterations;
+      frame[0] = first_byte;
+      if (baseline_ns == 0) baseline_ns = ns;
+
+      printf("%-10s %6zu %12.1f %12.1f %8.2fx\n", variant.name, length, ns, length / ns * 1000.0, baseline_ns / ns);
+    }
+  }
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../components/xy_discover.h"
+#include "../sim/xy6020l_sim.h"
+
+#define DISCOVER_BENCH_READS    20      // full block reads timed at each rate
+
+static bool sim_port_baud(uint32_t baud, void *ctx){
+  ((xy6020l_sim *) ctx)->set_port_baud(baud);
+  return true;
+}
+
+static bool bus_port_baud(uint32_t baud, void *ctx){
+  ((xy6020l_sim_bus *) ctx)->set_port_baud(baud);
+  return true;
+}
+
+static void setup_unit(xy6020l_sim &sim, uint32_t baud, uint32_t max_baud){
+  tSimConfig config = xy6020l_sim::default_config();
+  config.baud = baud;
+  config.maxBaud = max_baud;
+  sim.set_config(config);
+}
+
+// full holding register reads per second at the rate the driver talks now
+static uint32_t read_rate(xy6020l &psu){
+  uint32_t start = millis();
+  for (uint8_t i = 0; i < DISCOVER_BENCH_READS; i++) if (!psu.get_all_hold_regs()) return 0;
+  uint32_t elapsed = millis() - start;
+  return elapsed ? (DISCOVER_BENCH_READS * 1000UL) / elapsed : 0;
+}
+
+static void print_report(const char *name, const tDiscoverReport &report, bool upgraded, uint32_t before, uint32_t after){
+  if (!report.count) printf("%-26s %4s %7s %7s %5s %7s %7u  nothing found, %u probes\n", name, "-", "-", "-", "-", "-", report.scanMs,
+                            report.probes);
+  for (uint8_t n = 0; n < report.count; n++){
+    const tDiscovered &device = report.devices[n];
+    printf("%-26s %4u %7u %7u %5u %7u", n ? "" : name, device.address, device.foundBaud, device.baud, device.rejectedRates, device.foundMs);
+    if (n == 0){
+      printf(" %7u  %u probes, %u switches, upgrade %u ms%s", report.scanMs, report.probes, report.baudSwitches, report.upgradeMs,
+             bench_check(upgraded) ? "" : ", unit LOST");
+      if (after) printf(", %u -> %u reads/s", before, after);
+    }
+    printf("\n");
+  }
+}
+
+static void run_unit(const char *name, uint8_t address, uint32_t baud, uint32_t max_baud){
+  xy6020l_sim sim(address);
+  setup_unit(sim, baud, max_baud);
+  xy6020l psu(&sim);
+  psu.begin(115200);
+
+  xy_discover discover(&psu, sim_port_baud, &sim);
+  tDiscoverReport report;
+  uint32_t before = 0, after = 0;
+  bool upgraded = true;
+  if (discover.scan(report)){
+    before = read_rate(psu);
+    upgraded = discover.upgrade(report);
+    after = read_rate(psu);
+  }
+  print_report(name, report, upgraded, before, after);
+  // an empty scan hands back the link begin() set up
+  if (!report.count) printf("%-26s link left at %u baud, address %u%s\n", "", psu.get_link_baud(), psu.get_slave_address(),
+                            bench_check(psu.get_link_baud() == 115200 && psu.get_slave_address() == 1) ? "" : ", NOT RESTORED");
+}
+
+static void run_bus(){
+  xy6020l_sim units[3] = {xy6020l_sim(1), xy6020l_sim(3), xy6020l_sim(6)};
+  setup_unit(units[0], 115200, 0);
+  setup_unit(units[1], 9600, 0);
+  setup_unit(units[2], 19200, 57600);
+  xy6020l_sim_bus bus;
+  for (xy6020l_sim &unit : units) bus.add(&unit);
+
+  xy6020l psu(&bus);
+  xy_discover discover(&psu, bus_port_baud, &bus);
+  discover.set_expected(3);
+  tDiscoverReport report;
+  bool upgraded = discover.scan(report) && discover.upgrade(report);
+  print_report("bus, 3 units", report, upgraded, 0, 0);
+}
+
+void bench_discover(){
+  // what setup() did so far: 115200 at address 1, whatever the unit is set to
+  xy6020l_sim sim;
+  setup_unit(sim, 9600, 0);
+  xy6020l psu(&sim);
+  psu.begin(115200);
+  uint32_t start = millis();
+  bool answered = psu.get_all_hold_regs();
+  printf("hard-coded 115200/1 against a unit at 9600: %s after %u ms\n\n", answered ? "answered" : "no answer",
+         millis() - start);
+
+  printf("%-26s %4s %7s %7s %5s %7s %7s\n", "discover", "addr", "found", "baud", "rej", "at ms", "scan ms");
+  run_unit("factory, 115200/1", 1, 115200, 0);
+  run_unit("left at 9600/1", 1, 9600, 0);
+  run_unit("left at 19200/4", 4, 19200, 0);
+  run_unit("left at 2400/5", 5, 2400, 0);
+  run_unit("9600/2, cable max 38400", 2, 9600, 38400);
+  run_unit("nothing on 1..8", 20, 9600, 0);
+  run_bus();
+  printf("\nfound: rate the unit answered at; baud: after upgrade(); rej: faster rates that failed verification\n");
+}
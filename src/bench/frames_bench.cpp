@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../sim/xy6020l_sim.h"
+
+#define FRAMES_BENCH_ROUNDS   2000000
+
+static void bench_build(){
+  volatile uint8_t addr = DEFAULT_SLAVE_ADDRESS;
+  volatile uint16_t start = HREG_IDX_CV;
+  volatile uint16_t count = 30;
+  volatile uint8_t sink = 0;
+
+  uint64_t t0 = bench_now_ns();
+  for (uint32_t i = 0; i < FRAMES_BENCH_ROUNDS; i++){
+    tRequestFrame frame = make_read_frame(addr, start, count);
+    sink = sink + frame.bytes[7];
+  }
+  uint64_t built = bench_now_ns() - t0;
+
+  uint8_t frame[REQUEST_FRAME_LEN];
+  t0 = bench_now_ns();
+  for (uint32_t i = 0; i < FRAMES_BENCH_ROUNDS; i++){
+    memcpy(frame, XY_DEFAULT_FRAMES.frame[i & 1].bytes, REQUEST_FRAME_LEN);
+    sink = sink + frame[7];
+  }
+  uint64_t copied = bench_now_ns() - t0;
+
+  printf("%-34s %8.1f ns\n", "assemble + crc per request", (double) built / FRAMES_BENCH_ROUNDS);
+  printf("%-34s %8.1f ns\n", "copy of a ready frame", (double) copied / FRAMES_BENCH_ROUNDS);
+}
+
+static void run_polling(xy6020l &psu, uint32_t ms){
+  uint32_t start = millis();
+  while (millis() - start < ms) psu.process();
+  while (!psu.is_idle()) psu.process();
+}
+
+static void bench_cache(){
+  xy6020l_sim sim;
+  xy6020l psu(&sim);
+  psu.use_default_poll_plan();
+  psu.start_polling();
+  run_polling(psu, 1000);
+
+  uint32_t hits = psu.get_frame_cache_hits();
+  uint32_t misses = psu.get_frame_cache_misses();
+  printf("%-34s %6u hits %4u misses, %u sim replies\n", "default poll plan, 1 s", hits, misses, sim.stats().replies);
+
+  for (uint8_t num = 0; num < PRESET_COUNT; num++){
+    tMemory preset;
+    preset.num = num;
+    psu.fetch_preset(preset);
+  }
+  psu.get_all_hold_regs();
+  printf("%-34s %6u hits %4u misses\n", "+ fetch_preset x10, read-all", psu.get_frame_cache_hits() - hits, psu.get_frame_cache_misses() - misses);
+
+  // the cache follows the device to its new address
+  bool moved = psu.set_address(7);
+  hits = psu.get_frame_cache_hits();
+  misses = psu.get_frame_cache_misses();
+  uint32_t replies = sim.stats().replies;
+  sim.reset_stats();
+  run_polling(psu, 1000);
+  tMetricsSnapshot metrics;
+  psu.get_metrics(metrics);
+  printf("%-34s %6u hits %4u misses, %u sim replies, %u timeouts %s\n", "after set_address(7), 1 s", psu.get_frame_cache_hits() - hits,
+         psu.get_frame_cache_misses() - misses, sim.stats().replies, metrics.status[TXN_TIMEOUT], bench_check(moved && psu.get_slave_address() == 7 && replies) ? "ok" : "FAILED");
+}
+
+void bench_frames(){
+  bench_build();
+  bench_cache();
+}
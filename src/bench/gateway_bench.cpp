@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../components/xy_gateway.h"
+#include "../sim/xy6020l_sim.h"
+
+#define GATEWAY_BENCH_RUN_MS    2000
+
+static int connect_client(uint16_t port){
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0){
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  struct timeval tv = {1, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  return fd;
+}
+
+// one request, blocking until its answer; returns the PDU length of the answer, 0 on failure
+static uint16_t mb_request(int fd, uint16_t transaction, const uint8_t *pdu, uint16_t len, uint8_t *reply){
+  uint8_t adu[GATEWAY_ADU_MAX];
+  adu[0] = transaction >> 8;
+  adu[1] = transaction & 0xFF;
+  adu[2] = 0;
+  adu[3] = 0;
+  adu[4] = (len + 1) >> 8;
+  adu[5] = (len + 1) & 0xFF;
+  adu[6] = 1;
+  memcpy(adu + 7, pdu, len);
+  if (send(fd, adu, len + 7, 0) != len + 7) return 0;
+
+  uint16_t got = 0, want = 7;
+  while (got < want){
+    ssize_t n = recv(fd, adu + got, want - got, 0);
+    if (n <= 0) return 0;
+    got += n;
+    if (got == 7) want = 6 + ((adu[4] << 8) | adu[5]);
+  }
+  if (((adu[0] << 8) | adu[1]) != transaction) return 0;
+  memcpy(reply, adu + 7, want - 7);
+  return want - 7;
+}
+
+typedef struct {
+  uint32_t clientReads;
+  uint32_t failed;
+  uint32_t rtuReplies;
+  uint32_t elapsedMs;
+  tGatewayStats gateway;
+} tGatewayRun;
+
+// the device task and the gateway task of the firmware, and clients polling the actual V/I/P back to back
+static tGatewayRun run_clients(uint8_t clients, uint32_t max_age_ms, bool polling){
+  xy6020l_sim sim;
+  xy6020l psu(&sim);
+  xy_gateway gateway(&psu);
+  gateway.set_max_age(max_age_ms);
+  tGatewayRun run = {};
+  if (!gateway.begin(0)) return run;
+
+  if (polling){
+    psu.add_poll_group(HREG_IDX_ACT_V, 3, 20);
+    psu.start_polling();
+  }
+
+  std::atomic<bool> running(true), clients_done(false);
+  std::thread device([&]{
+    while (running){
+      psu.process();
+      if (psu.get_rx_state() == IDLE) delayMicroseconds(200);
+      else delayMicroseconds(20);
+    }
+  });
+  std::thread server([&]{
+    while (!clients_done) gateway.poll(5);
+  });
+
+  sim.reset_stats();
+  std::atomic<uint32_t> reads(0), failed(0);
+  uint32_t start = millis();
+  std::thread workers[GATEWAY_MAX_CLIENTS];
+  for (uint8_t c = 0; c < clients; c++){
+    workers[c] = std::thread([&]{
+      int fd = connect_client(gateway.get_port());
+      if (fd < 0){
+        failed++;
+        return;
+      }
+      const uint8_t pdu[] = {0x03, 0x00, HREG_IDX_ACT_V, 0x00, 0x03};
+      uint8_t reply[GATEWAY_ADU_MAX];
+      uint16_t transaction = 0;
+      while (millis() - start < GATEWAY_BENCH_RUN_MS){
+        if (mb_request(fd, ++transaction, pdu, sizeof(pdu), reply) == 8 && reply[0] == 0x03) reads++;
+        else failed++;
+      }
+      close(fd);
+    });
+  }
+  for (uint8_t c = 0; c < clients; c++) workers[c].join();
+  run.elapsedMs = millis() - start;
+  run.rtuReplies = sim.stats().replies;
+
+  clients_done = true;
+  server.join();
+  gateway.end();
+  running = false;
+  device.join();
+
+  run.clientReads = reads;
+  run.failed = failed;
+  gateway.get_stats(run.gateway);
+  return run;
+}
+
+static void check_protocol(){
+  xy6020l_sim sim;
+  xy6020l psu(&sim);
+  xy_gateway gateway(&psu);
+  if (!gateway.begin(0)){
+    printf("cannot listen on loopback\n");
+    return;
+  }
+  std::atomic<bool> running(true);
+  std::thread device([&]{
+    while (running){
+      psu.process();
+      gateway.poll(1);
+    }
+  });
+
+  int fd = connect_client(gateway.get_port());
+  uint8_t reply[GATEWAY_ADU_MAX];
+  const uint8_t write_cv[] = {0x06, 0x00, HREG_IDX_CV, 0x04, 0xB0};
+  const uint8_t write_two[] = {0x10, 0x00, HREG_IDX_CV, 0x00, 0x02, 0x04, 0x04, 0xB1, 0x00, 0x64};
+  const uint8_t read_set[] = {0x03, 0x00, HREG_IDX_CV, 0x00, 0x02};
+  const uint8_t read_long[] = {0x03, 0x00, 0x00, 0x00, 0x1F};
+  const uint8_t read_input[] = {0x04, 0x00, 0x00, 0x00, 0x01};
+
+  bool ok = fd >= 0;
+  ok = ok && mb_request(fd, 1, write_cv, sizeof(write_cv), reply) == 5 && memcmp(reply, write_cv, 5) == 0;
+  ok = ok && mb_request(fd, 2, read_set, sizeof(read_set), reply) == 6 && reply[2] == 0x04 && reply[3] == 0xB0;
+  ok = ok && mb_request(fd, 3, write_two, sizeof(write_two), reply) == 5 && memcmp(reply, write_two, 5) == 0;
+  ok = ok && mb_request(fd, 4, read_set, sizeof(read_set), reply) == 6 && reply[3] == 0xB1 && reply[5] == 0x64;
+  ok = ok && mb_request(fd, 5, read_long, sizeof(read_long), reply) == 2 && reply[0] == 0x83 && reply[1] == MB_EX_ILLEGAL_DATA_VALUE;
+  ok = ok && mb_request(fd, 6, read_input, sizeof(read_input), reply) == 2 && reply[0] == 0x84 && reply[1] == MB_EX_ILLEGAL_FUNCTION;
+  printf("protocol: FC 0x06 / 0x10 writes echoed and read back, exceptions 03 and 01: %s\n\n", bench_check(ok) ? "ok" : "FAILED");
+
+  if (fd >= 0) close(fd);
+  gateway.end();
+  running = false;
+  device.join();
+}
+
+void bench_gateway(){
+  check_protocol();
+
+  printf("Modbus TCP clients on loopback reading the actual V/I/P (3 registers) back to back for %u s, simulated XY6020L at 115200 baud\n",
+         GATEWAY_BENCH_RUN_MS / 1000);
+  printf("%-34s %7s %10s %8s %10s %8s %8s %7s\n", "mode", "clients", "client r/s", "RTU r/s", "r/s per RTU", "cached", "merged", "failed");
+
+  const struct {
+    const char *name;
+    uint32_t maxAgeMs;
+    bool polling;
+  } modes[] = {
+    {"every read to the bus, merged", 0, false},
+    {"snapshot <= 100 ms, 20 ms polling", GATEWAY_DEFAULT_AGE_MS, true},
+  };
+  for (const auto &mode : modes){
+    for (uint8_t clients = 1; clients <= GATEWAY_MAX_CLIENTS; clients *= 2){
+      tGatewayRun run = run_clients(clients, mode.maxAgeMs, mode.polling);
+      if (!run.elapsedMs){
+        printf("cannot listen on loopback\n");
+        return;
+      }
+      float client_rate = (run.clientReads * 1000.0) / run.elapsedMs;
+      float rtu_rate = (run.rtuReplies * 1000.0) / run.elapsedMs;
+      printf("%-34s %7u %10.1f %8.1f %10.2f %8u %8u %7u\n", mode.name, clients, client_rate, rtu_rate,
+             rtu_rate > 0 ? client_rate / rtu_rate : 0, run.gateway.cacheHits, run.gateway.merged, run.failed);
+    }
+  }
+  printf("RTU r/s counts every reply of the slave, the 20 ms poll group included\n");
+}
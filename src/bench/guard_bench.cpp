@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../components/xy_guard.h"
+#include "../sim/xy6020l_sim.h"
+
+#define GUARD_BENCH_TRIPS       40
+#define GUARD_BENCH_LIMIT       300     // 3 A
+#define GUARD_BENCH_FAULT_MOHM  2000    // 12 V over 2 ohm runs into the 5 A current limit
+
+// injects the fault from inside the driver's own calls and notes when the output went off
+class fault_sim : public xy6020l_sim
+{
+  public:
+    void arm_fault(uint32_t delay_us){
+      set_register(HREG_IDX_OUTPUT_ON, 1);
+      _fault_at = micros() + delay_us;
+      _faulted = false;
+      _off_at = 0;
+    }
+    bool output_off(){return _off_at != 0;}
+    uint32_t reaction_us(){return _off_at - _fault_at;}
+
+    int available() override {
+      if (!_faulted && (int32_t)(micros() - _fault_at) >= 0){
+        _faulted = true;
+        config().loadMilliOhm = GUARD_BENCH_FAULT_MOHM;
+        set_register(HREG_IDX_OUTPUT_ON, get_register(HREG_IDX_OUTPUT_ON));
+      }
+      return xy6020l_sim::available();
+    }
+    size_t write(uint8_t data) override {
+      size_t n = xy6020l_sim::write(data);
+      if (_faulted && !_off_at && get_register(HREG_IDX_OUTPUT_ON) == 0) _off_at = micros();
+      return n;
+    }
+    using Stream::write;
+
+    void clear_fault(){
+      config().loadMilliOhm = 10000;
+      set_register(HREG_IDX_OUTPUT_ON, 1);
+    }
+
+  private:
+    uint32_t _fault_at = 0;
+    bool _faulted = true;
+    uint32_t _off_at = 0;
+};
+
+static void setup_sim(fault_sim &sim){
+  sim.set_register(HREG_IDX_CV, 1200);
+  sim.set_register(HREG_IDX_CC, 500);
+  sim.clear_fault();
+}
+
+static void print_row(const char *name, uint32_t *us, uint8_t count, uint32_t extra_us, const char *extra){
+  std::sort(us, us + count);
+  uint64_t sum = 0;
+  for (uint8_t i = 0; i < count; i++) sum += us[i];
+  printf("%-34s %5u %8llu %8u %8u %8u  %s %u\n", name, count, (unsigned long long)(count ? sum / count : 0), count ? us[count / 2] : 0,
+         count ? us[(count * 99) / 100] : 0, count ? us[count - 1] : 0, extra, extra_us);
+}
+
+// the loop main.cpp used: read everything, compare, switch off through the write ring and wait
+static void run_blocking(){
+  fault_sim sim;
+  setup_sim(sim);
+  xy6020l psu(&sim);
+  uint32_t reaction[GUARD_BENCH_TRIPS];
+  uint8_t done = 0;
+  srand(7);
+
+  for (uint8_t trip = 0; trip < GUARD_BENCH_TRIPS; trip++){
+    sim.arm_fault(5000 + (rand() % 45000));
+    uint32_t start = millis();
+    while (!sim.output_off() && millis() - start < 1000){
+      if (!psu.get_all_hold_regs()) continue;
+      if (psu.get_actual_current() > GUARD_BENCH_LIMIT){
+        psu.set_switch_state(false);
+        psu.flush_writes(true);
+      }
+    }
+    if (sim.output_off()) reaction[done++] = sim.reaction_us();
+    sim.clear_fault();
+  }
+  print_row("blocking read-all + write ring", reaction, done, 0, "-");
+}
+
+static void run_guard(bool background){
+  fault_sim sim;
+  setup_sim(sim);
+  xy6020l psu(&sim);
+  xy_guard guard(&psu);
+  guard.add_rule(GUARD_ABOVE, GUARD_CURRENT, GUARD_BENCH_LIMIT);
+  if (background){
+    psu.use_default_poll_plan();
+    psu.start_polling();
+  }
+
+  uint32_t reaction[GUARD_BENCH_TRIPS];
+  uint32_t worst_ack = 0;
+  uint32_t last_setpoint = 0;
+  uint16_t volt = 1200;
+  uint8_t done = 0;
+  srand(7);
+
+  for (uint8_t trip = 0; trip < GUARD_BENCH_TRIPS; trip++){
+    guard.rearm();
+    sim.arm_fault(5000 + (rand() % 45000));
+    uint32_t start = millis();
+    while (guard.get_state() != GUARD_TRIPPED && millis() - start < 1000){
+      psu.process();
+      guard.process();
+      // setpoint traffic of a 10 ms profile tick, the trip has to overtake it
+      if (background && millis() - last_setpoint >= 10){
+        last_setpoint = millis();
+        volt = volt == 1200 ? 1201 : 1200;
+        psu.set_volt(volt);
+        psu.flush_writes();
+      }
+    }
+    while (!sim.output_off() && millis() - start < 1000) psu.process();
+    if (sim.output_off()) reaction[done++] = sim.reaction_us();
+    sim.clear_fault();
+  }
+  guard.disarm();
+  while (!psu.is_idle()) psu.process();
+
+  tGuardStats stats;
+  guard.get_stats(stats);
+  worst_ack = stats.worstTripUs;
+  print_row(background ? "guard + polling + setpoint writes" : "guard only", reaction, done, worst_ack, "worst detect->ack us");
+  printf("%-34s samples %u, one every %u us\n", "", stats.samples, stats.samplePeriodUs);
+}
+
+void bench_guard(){
+  printf("fault (5 A into a 3 A limit) to output off, %u trips at 115200 baud\n", GUARD_BENCH_TRIPS);
+  printf("%-34s %5s %8s %8s %8s %8s\n", "path", "trips", "mean us", "p50 us", "p99 us", "max us");
+  run_blocking();
+  run_guard(false);
+  run_guard(true);
+}
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../components/xy_history.h"
+#include "../sim/xy6020l_sim.h"
+
+#define HISTORY_SIM_HOURS   2
+#define HISTORY_POLL_MS     50
+
+static xy_history history;
+
+void bench_history(){
+  printf("ram: %u bytes (raw %u x %u, seconds %u x %u, minutes %u x %u)\n", (unsigned) HISTORY_RAM_BYTES,
+         HISTORY_RAW_LEN, (unsigned) sizeof(tHistSample), HISTORY_SECOND_LEN, (unsigned) sizeof(tHistBucket),
+         HISTORY_MINUTE_LEN, (unsigned) sizeof(tHistBucket));
+
+  // synthetic 20 Hz telemetry: voltage sawtooth per minute, current steps, temperature creeping up
+  const uint32_t samples = HISTORY_SIM_HOURS * 3600 * (1000 / HISTORY_POLL_MS);
+  uint64_t boundary_ns = 0;
+  uint32_t boundaries = 0;
+  uint64_t start = bench_now_ns();
+  for (uint32_t i = 0; i < samples; i++){
+    uint32_t ms = i * HISTORY_POLL_MS;
+    uint16_t values[HISTORY_CHANNELS] = {(uint16_t)(1200 - ((ms / 1000) % 60)), (uint16_t)(((ms / 10000) % 2) ? 300 : 100),
+                                         0, (uint16_t)(250 + (ms / 60000)), 0};
+    values[HIST_POWER] = (values[HIST_VOLT] * values[HIST_CURRENT]) / 1000;
+
+    // the first sample of a minute closes a 1 s and a 1 min bucket, the most work a sample can cause
+    if (ms % 60000 == 0 && i){
+      uint64_t t0 = bench_now_ns();
+      history.add(ms, values);
+      boundary_ns += bench_now_ns() - t0;
+      boundaries++;
+    } else {
+      history.add(ms, values);
+    }
+  }
+  double add_ns = (double)(bench_now_ns() - start) / samples;
+  printf("add: %u samples over %u h, %.1f ns/sample average, %.1f ns when closing a minute\n", samples, HISTORY_SIM_HOURS,
+         add_ns, (double) boundary_ns / boundaries);
+
+  // each minute bucket of the sawtooth spans 1141..1200 V, mean 1170.5
+  uint32_t end_ms = samples * HISTORY_POLL_MS;
+  tHistSpan<tHistBucket> minutes = history.query(HIST_MINUTE, 0, end_ms);
+  bool ok = minutes.size() == HISTORY_MINUTE_LEN || minutes.size() == HISTORY_SIM_HOURS * 60 - 1;
+  for (uint16_t i = 0; i < minutes.size(); i++){
+    const tHistBucket &bucket = minutes[i];
+    if (bucket.min[HIST_VOLT] != 1141 || bucket.max[HIST_VOLT] != 1200 || bucket.count != 1200) ok = false;
+    if (bucket.mean[HIST_VOLT] < 1170 || bucket.mean[HIST_VOLT] > 1171) ok = false;
+  }
+  printf("minute buckets: %u, aggregates %s\n", minutes.size(), bench_check(ok) ? "ok" : "MISMATCH");
+
+  const uint32_t queries = 100000;
+  uint32_t total = 0;
+  start = bench_now_ns();
+  for (uint32_t i = 0; i < queries; i++){
+    tHistSpan<tHistSample> raw = history.query_raw(end_ms - 5000 - (i % 1000), end_ms);
+    total += raw.size();
+  }
+  printf("query_raw last 5 s: %u entries, %.1f ns/query (no copy)\n", total / queries, (double)(bench_now_ns() - start) / queries);
+
+  start = bench_now_ns();
+  for (uint32_t i = 0; i < queries; i++){
+    tHistSpan<tHistBucket> span = history.query(HIST_SECOND, end_ms - 60000, end_ms);
+    total += span.size();
+  }
+  printf("query 1 s buckets, last minute: %.1f ns/query\n", (double)(bench_now_ns() - start) / queries);
+
+  // fed by the driver from the default poll plan
+  xy6020l_sim sim;
+  xy6020l psu(&sim);
+  history.reset();
+  psu.set_history(&history);
+  psu.use_default_poll_plan();
+  psu.start_polling();
+  start = bench_now_ns();
+  while (bench_now_ns() - start < 2000000000ULL) psu.process();
+
+  tHistBucket open;
+  tHistSpan<tHistBucket> seconds = history.query(HIST_SECOND, 0, millis());
+  printf("driver: %u samples in 2 s, %u closed 1 s buckets (%u samples each), open minute %s\n", history.get_sample_count(),
+         seconds.size(), seconds.size() ? seconds[seconds.size() - 1].count : 0,
+         history.get_open_bucket(HIST_MINUTE, open) ? "collecting" : "empty");
+}
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../posix/posix_link.h"
+#include "../sim/xy6020l_sim.h"
+#include "../sim/xy6020l_sim_link.h"
+
+#define LINK_BENCH_RUN_MS   2000
+
+// back to back reads of the actual V/I/P, as a logger polling as fast as the link allows
+static void run_reads(const char *name, Stream *port){
+  xy6020l psu(port);
+  psu.reset_metrics();
+
+  uint32_t start = millis();
+  while (millis() - start < LINK_BENCH_RUN_MS){
+    if (psu.get_pending_transactions() < 2) psu.submit_read(HREG_IDX_ACT_V, 3);
+    psu.process();
+    if (psu.get_rx_state() == IDLE) continue;
+    delayMicroseconds(20);
+  }
+  while (!psu.is_idle()) psu.process();
+  uint32_t elapsed_ms = millis() - start;
+
+  tMetricsSnapshot metrics;
+  psu.get_metrics(metrics);
+  const tLatencyHist &hist = metrics.latency[METRICS_FC_READ];
+  uint32_t failed = hist.count - metrics.status[TXN_OK];
+  printf("%-26s %8.1f %8u %8u %8u %8u %8u\n", name, (metrics.status[TXN_OK] * 1000.0) / elapsed_ms, hist.minUs,
+         metrics_percentile(hist, 50), metrics_percentile(hist, 99), hist.maxUs, failed);
+}
+
+void bench_link(){
+  printf("FC 0x03 of 3 registers back to back at 115200 baud for %u s, 2 ms response latency of the slave\n", LINK_BENCH_RUN_MS / 1000);
+  printf("%-26s %8s %8s %8s %8s %8s %8s\n", "transport", "reads/s", "min us", "p50 us", "p99 us", "max us", "failed");
+
+  {
+    xy6020l_sim sim;
+    run_reads("in process Stream", &sim);
+  }
+
+  {
+    xy6020l_sim sim;
+    xy6020l_sim_link link(&sim);
+    fd_stream driver_end, sim_end;
+    if (!open_socket_pair(driver_end, sim_end)){
+      printf("socketpair failed\n");
+      return;
+    }
+    link.start(&sim_end);
+    run_reads("socket pair + sim thread", &driver_end);
+    link.stop();
+  }
+
+  {
+    xy6020l_sim sim;
+    xy6020l_sim_link link(&sim);
+    fd_stream master;
+    posix_serial port;
+    char path[64];
+    if (!open_pty(master, path, sizeof(path)) || !port.begin(path, 115200)){
+      printf("pty not available here\n");
+      return;
+    }
+    link.start(&master);
+    run_reads("pty + termios + sim thread", &port);
+    link.stop();
+  }
+  printf("floor: 8 + 11 bytes of wire time (1.65 ms) and the 2 ms response latency, the inter-frame gap is added between reads\n");
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../components/xy_metrics.h"
+#include "../sim/xy6020l_sim.h"
+
+#ifndef XY6020L_NO_METRICS
+static const char *status_names[METRICS_STATUS_COUNT] = {"pending", "ok", "timeout", "short frame", "crc error", "exception", "tx error", "bad frame"};
+static const char *func_names[METRICS_FUNC_CODES] = {"FC 0x03", "FC 0x06", "FC 0x10"};
+#endif
+
+void bench_metrics(){
+#ifdef XY6020L_NO_METRICS
+  printf("built with XY6020L_NO_METRICS\n");
+#else
+  // cost of the hot path record
+  static xy_metrics metrics;
+  const uint32_t records = 10000000;
+  uint64_t start = bench_now_ns();
+  for (uint32_t i = 0; i < records; i++) metrics.record(i % 3, 1, 0, 2000 + (i & 0xFFF), 8, 65, 6000);
+  printf("record: %.1f ns per transaction\n", (double)(bench_now_ns() - start) / records);
+
+  // mixed traffic on a lossy link, with a few illegal requests
+  tSimConfig config = xy6020l_sim::default_config();
+  config.byteGapUs = 50;
+  config.dropBytePpm = 500;
+  config.crcCorruptPpm = 10000;
+  xy6020l_sim sim;
+  sim.set_config(config);
+  xy6020l psu(&sim);
+  psu.reset_metrics();
+
+  start = bench_now_ns();
+  uint32_t i = 0;
+  while (bench_now_ns() - start < 2000000000ULL){
+    if (psu.get_pending_transactions() < 4){
+      uint32_t step = i++;
+      switch (step % 8){
+        case 0: psu.submit_write_single(HREG_IDX_CV, 1000 + (i % 100)); break;
+        case 1: {
+          uint8_t values[4] = {0x03, 0xE8, 0x00, 0xC8};
+          psu.submit_write_multiple(HREG_IDX_CV, 2, values);
+          break;
+        }
+        case 2: if (step % 16 == 2) psu.submit_read(0x200, 4); else psu.submit_read(HREG_IDX_ACT_V, 3); break;   // 0x200 is not mapped
+        default: psu.submit_read(HREG_IDX_CV, 30); break;
+      }
+    }
+    psu.process();
+  }
+
+  tMetricsSnapshot snapshot;
+  psu.get_metrics(snapshot);
+  printf("%-8s %8s %8s %8s %8s %8s %8s\n", "func", "count", "min us", "p50 us", "p90 us", "p99 us", "max us");
+  for (uint8_t fc = 0; fc < METRICS_FUNC_CODES; fc++){
+    const tLatencyHist &hist = snapshot.latency[fc];
+    printf("%-8s %8u %8u %8u %8u %8u %8u\n", func_names[fc], hist.count, hist.minUs, metrics_percentile(hist, 50),
+           metrics_percentile(hist, 90), metrics_percentile(hist, 99), hist.maxUs);
+  }
+  printf("outcomes:");
+  for (uint8_t s = 1; s < METRICS_STATUS_COUNT; s++) printf(" %s %u,", status_names[s], snapshot.status[s]);
+  printf(" illegal address exceptions %u\n", snapshot.exception[ILLEGAL_DATA_ADDRESS]);
+  printf("wire: %u bytes out, %u bytes in, busy %u of %u ms (%.1f%%, byte gaps included), simulator counts %.1f%% of byte times\n", snapshot.bytesTx, snapshot.bytesRx,
+         snapshot.busyMs, snapshot.windowMs, metrics_utilization(snapshot) / 10.0, sim.stats().busTimeUs / (snapshot.windowMs * 10.0));
+#endif
+}
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../sim/xy6020l_sim.h"
+
+#define PRESET_STEPS  200
+
+// a test sequence: check the preset, tweak one protection limit, now and then new setpoints
+static bool run_step(xy6020l &psu, uint32_t step, bool full_rewrite){
+  tMemory preset = {};
+  preset.num = step % PRESET_COUNT;
+  if (full_rewrite) psu.invalidate_presets();
+  if (!psu.fetch_preset(preset)) return false;
+
+  if (step % 2) preset.sOCP = 1000 + step;
+  else preset.sOVP = 3000 + step;
+  if (step % 5 == 0){
+    preset.VSet = 500 + step;
+    preset.ISet = 100 + step;
+  }
+
+  if (full_rewrite) psu.invalidate_presets();
+  return psu.set_preset(preset);
+}
+
+void bench_presets(){
+  const char *names[] = {"full rewrite", "preset cache"};
+
+  printf("%d steps of fetch_preset, one or two changed fields, set_preset\n", PRESET_STEPS);
+  printf("%-16s %8s %8s %8s %12s %10s %8s\n", "mode", "fail", "frames", "bytes", "wire us", "us/step", "check");
+
+  for (uint8_t cached = 0; cached < 2; cached++){
+    xy6020l_sim sim;
+    xy6020l psu(&sim);
+    uint32_t failures = 0;
+
+    if (cached) psu.load_presets();
+    sim.reset_stats();
+
+    uint64_t start = bench_now_ns();
+    for (uint32_t step = 0; step < PRESET_STEPS; step++){
+      if (!run_step(psu, step, !cached)) failures++;
+    }
+    uint64_t elapsed_us = (bench_now_ns() - start) / 1000;
+
+    // the device must end up with what was committed
+    bool match = true;
+    for (uint8_t num = 0; num < PRESET_COUNT; num++){
+      tMemory preset = {};
+      preset.num = num;
+      psu.fetch_preset(preset);
+      uint16_t base = HREG_IDX_M0 + (num * HREG_IDX_M_OFFSET);
+      if (sim.get_register(base + HREG_IDX_M_SOCP) != preset.sOCP || sim.get_register(base + HREG_IDX_M_SOVP) != preset.sOVP) match = false;
+      if (sim.get_register(base + HREG_IDX_M_VSET) != preset.VSet) match = false;
+    }
+
+    const tSimStats &stats = sim.stats();
+    printf("%-16s %8u %8u %8u %12llu %10llu %8s\n", names[cached], failures, stats.requests, stats.bytesIn + stats.bytesOut,
+           (unsigned long long) stats.busTimeUs, (unsigned long long) elapsed_us / PRESET_STEPS, bench_check(match) ? "ok" : "MISMATCH");
+    if (cached){
+      printf("cache reports %u bytes written, %u bytes saved against full rewrites and reads\n",
+             psu.get_preset_bytes_written(), psu.get_preset_bytes_saved());
+    }
+  }
+}
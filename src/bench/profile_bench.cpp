@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../components/xy_profile.h"
+#include "../sim/xy6020l_sim.h"
+
+static const char *state_names[] = {"idle", "running", "done", "aborted"};
+
+typedef struct {
+  const char *name;
+  tProfileStep steps[PROFILE_MAX_STEPS];
+  uint8_t count;
+  uint32_t expectedMs;
+  bool battery;           // load resistance rises like a charging battery
+} tProfileCase;
+
+static void run_case(tProfileCase &pc, uint16_t tick_ms){
+  xy6020l_sim sim;
+  xy6020l psu(&sim);
+  xy_profile profile(&psu);
+  psu.use_default_poll_plan();
+  psu.start_polling();
+
+  // this thread plays the communication task
+  uint32_t start = millis();
+  while (millis() - start < 200) psu.process();
+
+  profile.load(pc.steps, pc.count);
+  profile.set_output_off_at_end(true);
+  uint64_t t0 = bench_now_ns();
+  profile.start(tick_ms);
+
+  while (profile.get_state() == PROFILE_RUNNING){
+    if (pc.battery){
+      // 14.4 V over 2 ohm rising to 200 ohm within 3 s: CC first, then the current tapers
+      uint32_t elapsed = (bench_now_ns() - t0) / 1000000;
+      sim.config().loadMilliOhm = 2000 + (elapsed * 66);
+      sim.set_register(HREG_IDX_OUTPUT_ON, sim.get_register(HREG_IDX_OUTPUT_ON));
+    }
+    psu.process();
+    if ((bench_now_ns() - t0) > 20000000000ULL) profile.stop();
+  }
+  uint32_t took_ms = (bench_now_ns() - t0) / 1000000;
+  while (!psu.is_idle()) psu.process();
+  uint16_t final_volt = sim.get_register(HREG_IDX_CV);
+
+  tProfileStats stats;
+  profile.get_stats(stats);
+  char expected[12] = "-";
+  if (pc.expectedMs) snprintf(expected, sizeof(expected), "%u", pc.expectedMs);
+  // the last step's voltage is left on the device, the output switched off at the end
+  bool ok = stats.state == PROFILE_DONE && stats.writeFailures == 0 && final_volt == pc.steps[pc.count - 1].volt &&
+            !sim.get_register(HREG_IDX_OUTPUT_ON);
+  printf("%-22s %4u %8s %7u/%-6s %6u %6u %8u %8u %7u %6u %6u %6.2f %s%s\n", pc.name, tick_ms, state_names[stats.state], took_ms, expected,
+         stats.ticks, stats.deadlineMisses, stats.worstLatencyUs, stats.worstTickUs, stats.writes, stats.writeFailures, stats.reads,
+         final_volt / 100.0,
+         sim.get_register(HREG_IDX_OUTPUT_ON) ? "on" : "off", bench_check(ok) ? "" : "  FAILED");
+}
+
+void bench_profile(){
+  static tProfileCase cases[3];
+
+  tProfileCase &ramp = cases[0];
+  ramp.name = "ramp 0->12 V in 1 s";
+  ramp.steps[0] = {PROFILE_HOLD, 0, 200, 100, 0, 0};
+  ramp.steps[1] = {PROFILE_RAMP, 1200, 200, 1000, 0, 0};
+  ramp.count = 2;
+  ramp.expectedMs = 1100;
+  ramp.battery = false;
+
+  tProfileCase &stairs = cases[1];
+  stairs.name = "staircase 5x200 ms";
+  stairs.count = xy_profile::make_staircase(stairs.steps, PROFILE_MAX_STEPS, 500, 1300, 5, 200, 300);
+  stairs.expectedMs = 1000;
+  stairs.battery = false;
+
+  tProfileCase &charge = cases[2];
+  charge.name = "CC-CV 14.4 V, 3 A";
+  charge.steps[0] = {PROFILE_CC_CV, 1440, 300, 10000, 50, 200};
+  charge.count = 1;
+  charge.expectedMs = 0;
+  charge.battery = true;
+
+  printf("%-22s %4s %8s %14s %6s %6s %8s %8s %7s %6s %6s %6s %s\n", "profile", "tick", "state", "ms/expected", "ticks", "misses",
+         "late us", "tick us", "writes", "failed", "reads", "V end", "out");
+  for (tProfileCase &pc : cases) run_case(pc, PROFILE_TICK_MS);
+  run_case(cases[0], 2);
+}
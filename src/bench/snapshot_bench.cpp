@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../components/seqlock.h"
+#include "../sim/xy6020l_sim.h"
+
+#define SNAPSHOT_RUN_MS   1000
+#define SNAPSHOT_READERS  2
+
+// the same payload without a sequence counter, what the getters do today
+class unguarded_copy
+{
+  public:
+    void publish(const tSnapshot &value){
+      uint32_t words[sizeof(tSnapshot) / 4];
+      memcpy(words, &value, sizeof(value));
+      for (uint16_t i = 0; i < sizeof(words) / 4; i++) _words[i].store(words[i], std::memory_order_relaxed);
+    }
+    uint32_t read(tSnapshot &out) const {
+      uint32_t words[sizeof(tSnapshot) / 4];
+      for (uint16_t i = 0; i < sizeof(words) / 4; i++) words[i] = _words[i].load(std::memory_order_relaxed);
+      memcpy(&out, words, sizeof(out));
+      return 1;
+    }
+  private:
+    std::atomic<uint32_t> _words[sizeof(tSnapshot) / 4] = {};
+};
+
+// every published frame carries the same counter in all registers, a mix of two is a tear
+static bool torn(const tSnapshot &snapshot){
+  for (uint8_t reg = 1; reg < 30; reg++){
+    if (snapshot.regs[reg] != snapshot.regs[0]) return true;
+  }
+  return false;
+}
+
+template <typename Lock>
+static uint64_t race(const char *name, Lock &lock){
+  std::atomic<bool> running(true);
+  std::atomic<uint64_t> reads(0), tears(0), read_ns(0);
+  uint64_t publishes = 0;
+
+  std::thread readers[SNAPSHOT_READERS];
+  for (uint8_t i = 0; i < SNAPSHOT_READERS; i++){
+    readers[i] = std::thread([&](){
+      uint64_t local_reads = 0, local_tears = 0;
+      uint64_t start = bench_now_ns();
+      tSnapshot snapshot;
+      while (running.load(std::memory_order_relaxed)){
+        lock.read(snapshot);
+        local_reads++;
+        if (torn(snapshot)) local_tears++;
+      }
+      read_ns += bench_now_ns() - start;
+      reads += local_reads;
+      tears += local_tears;
+    });
+  }
+
+  tSnapshot frame = {};
+  uint64_t start = bench_now_ns();
+  while (bench_now_ns() - start < SNAPSHOT_RUN_MS * 1000000ULL){
+    publishes++;
+    for (uint8_t reg = 0; reg < 30; reg++) frame.regs[reg] = (uint16_t) publishes;
+    lock.publish(frame);
+  }
+  double publish_ns = (double)(bench_now_ns() - start) / publishes;
+  running = false;
+  for (std::thread &reader : readers) reader.join();
+
+  printf("%-12s %12llu %12llu %10llu %10.1f %10.1f\n", name, (unsigned long long) publishes, (unsigned long long) reads.load(),
+         (unsigned long long) tears.load(), (double) read_ns.load() / reads.load(), publish_ns);
+  return tears;
+}
+
+void bench_snapshot(){
+  printf("writer publishing back to back, %u readers on other cores\n", SNAPSHOT_READERS);
+  printf("%-12s %12s %12s %10s %10s %10s\n", "payload", "publishes", "reads", "torn", "ns/read", "ns/publish");
+
+  unguarded_copy unguarded;
+  race("unguarded", unguarded);
+  xy_seqlock<tSnapshot> seqlock;
+  bench_check(race("seqlock", seqlock) == 0);
+
+  // through the driver: a reader polling snapshots while the poller publishes replies
+  xy6020l_sim sim;
+  xy6020l psu(&sim);
+  psu.add_poll_group(HREG_IDX_CV, 30, 10);
+  psu.start_polling();
+
+  std::atomic<bool> running(true);
+  uint32_t last_seq = 0, seen = 0;
+  std::thread reader([&](){
+    tSnapshot snapshot;
+    while (running){
+      if (psu.get_snapshot(snapshot) && snapshot.seq != last_seq){
+        last_seq = snapshot.seq;
+        seen++;
+      }
+    }
+  });
+  uint64_t start = bench_now_ns();
+  while (bench_now_ns() - start < SNAPSHOT_RUN_MS * 1000000ULL) psu.process();
+  running = false;
+  reader.join();
+  printf("driver: %u snapshots published, %u observed by a concurrent reader\n", psu.get_snapshot_sequence(), seen);
+}
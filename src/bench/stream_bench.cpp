@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <vector>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../components/xy_stream.h"
+#include "../sim/xy6020l_sim.h"
+
+#define STREAM_BENCH_RUN_MS     3000
+
+// console port that keeps what it was given
+class capture_port : public Stream
+{
+  public:
+    std::vector<uint8_t> bytes;
+
+    int available() override {return 0;}
+    int read() override {return -1;}
+    int peek() override {return -1;}
+    size_t write(uint8_t data) override {bytes.push_back(data); return 1;}
+    size_t write(const uint8_t *buf, size_t size) override {bytes.insert(bytes.end(), buf, buf + size); return size;}
+};
+
+typedef struct {
+  xy6020l *psu;
+  std::atomic<bool> run;
+} tCommCtx;
+
+static void comm_task(tCommCtx *ctx){
+  while (ctx->run) ctx->psu->process();
+}
+
+// what the console costs when the same content is printed as text
+typedef struct {
+  uint32_t samples;
+  uint32_t frames;
+  uint64_t hexBytes;        // "[0x%02X] " per frame byte and a newline per frame
+  uint64_t lineBytes;       // one printf line of telemetry per sample
+  uint64_t hexNs;
+  uint64_t lineNs;
+  tStreamSample last;
+} tTextCost;
+
+static void on_sample(const tStreamSample &sample, void *ctx){
+  tTextCost *cost = (tTextCost *) ctx;
+  tTelemetry t;
+  xy_stream_decoder::to_telemetry(sample, t);
+
+  char line[160];
+  uint64_t t0 = bench_now_ns();
+  int len = snprintf(line, sizeof(line), "%u V=%u.%02u I=%u.%02u P=%u.%u in=%u.%02u out=%u prot=%u cvcc=%u T=%u.%u\n",
+                     sample.timestampMs, t.actVolt / 100, t.actVolt % 100, t.actCurrent / 100, t.actCurrent % 100,
+                     t.actPower / 10, t.actPower % 10, t.inVolt / 100, t.inVolt % 100, t.outputOn, t.protect, t.cvcc,
+                     t.tempInternal / 10, t.tempInternal % 10);
+  cost->lineNs += bench_now_ns() - t0;
+  cost->lineBytes += len;
+  cost->samples++;
+  cost->last = sample;
+}
+
+static void on_frame(const tStreamFrame &frame, void *ctx){
+  tTextCost *cost = (tTextCost *) ctx;
+  char text[8];
+  uint64_t t0 = bench_now_ns();
+  for (uint8_t i = 0; i < frame.len; i++) cost->hexBytes += snprintf(text, sizeof(text), "[0x%02X] ", frame.data[i]);
+  cost->hexNs += bench_now_ns() - t0;
+  cost->hexBytes++;
+  cost->frames++;
+}
+
+static void run_case(const char *name, uint32_t link_baud, bool frames, uint32_t corrupt_ppm, bool text){
+  xy6020l_sim sim;
+  sim.set_register(HREG_IDX_CC, 500);
+  sim.set_register(HREG_IDX_CV, 1200);
+  sim.set_register(HREG_IDX_OUTPUT_ON, 1);
+  sim.config().loadMilliOhm = 10000;
+  xy6020l psu(&sim);
+  capture_port port;
+  xy_stream stream(&port, link_baud);
+  stream.set_frames(frames);
+  psu.set_stream(&stream);
+  psu.use_default_poll_plan();
+  psu.start_polling();
+
+  tCommCtx ctx;
+  ctx.psu = &psu;
+  ctx.run = true;
+  std::thread comm(comm_task, &ctx);
+
+  // loop() of the application, the setpoint wanders so the actual values move
+  uint64_t poll_ns = 0;
+  uint32_t start = millis();
+  while (millis() - start < STREAM_BENCH_RUN_MS){
+    uint32_t elapsed = millis() - start;
+    sim.set_register(HREG_IDX_CV, 1200 + ((elapsed / 40) % 50));
+    uint64_t t0 = bench_now_ns();
+    stream.poll();
+    poll_ns += bench_now_ns() - t0;
+    delay(5);
+  }
+  ctx.run = false;
+  comm.join();
+  uint32_t elapsed_ms = millis() - start;
+  tStreamStats stats;
+  stream.get_stats(stats);
+  uint32_t bytes = stats.bytes;
+
+  // drain what the link budget held back
+  for (uint16_t i = 0; i < 1000; i++){
+    stream.poll();
+    delay(2);
+  }
+
+  stream.get_stats(stats);
+
+  srand(5);
+  std::vector<uint8_t> &wire = port.bytes;
+  uint32_t flipped = 0;
+  for (size_t i = 0; corrupt_ppm && i < wire.size(); i++){
+    if ((uint32_t)(rand() % 1000000) < corrupt_ppm){
+      wire[i] ^= 1 << (rand() % 8);
+      flipped++;
+    }
+  }
+
+  tTextCost cost = {};
+  xy_stream_decoder decoder;
+  decoder.on_sample(on_sample, &cost);
+  decoder.on_frame(on_frame, &cost);
+  uint64_t t0 = bench_now_ns();
+  decoder.feed(wire.data(), wire.size());
+  uint64_t decode_ns = bench_now_ns() - t0 - cost.hexNs - cost.lineNs;
+  tStreamDecodeStats decoded;
+  decoder.get_stats(decoded);
+
+  tTelemetry sent = psu.get_telemetry();
+  tTelemetry got = {};
+  xy_stream_decoder::to_telemetry(cost.last, got);
+  bool match = memcmp(&sent, &got, sizeof(sent)) == 0;
+
+  uint32_t link_bytes = link_baud / 10;
+  if (text){
+    printf("%-30s %8.0f %6.1f%% %8s %8.0f us\n", "printf hex dump of frames", (cost.hexBytes * 1000.0) / elapsed_ms,
+           (cost.hexBytes * 100000.0) / elapsed_ms / link_bytes, "", cost.hexNs / (1.0 * elapsed_ms));
+    printf("%-30s %8.0f %6.1f%% %8s %8.0f us\n", "printf line per sample", (cost.lineBytes * 1000.0) / elapsed_ms,
+           (cost.lineBytes * 100000.0) / elapsed_ms / link_bytes, "", cost.lineNs / (1.0 * elapsed_ms));
+  }
+  printf("%-30s %8.0f %6.1f%% %8.1f %8.0f us %5u/%-5u %4u/%-4u %s\n", name, (bytes * 1000.0) / elapsed_ms,
+         (bytes * 100000.0) / elapsed_ms / link_bytes, (decoded.samples * 1000.0) / elapsed_ms,
+         poll_ns / (1.0 * elapsed_ms), stats.droppedSamples, stats.droppedFrames,
+         decoded.badPackets + decoded.lostPackets, decoded.skippedPackets, bench_check(match) ? "yes" : "NO");
+  if (corrupt_ppm) printf("  %u bits flipped, decoder %.0f ns per byte; a damaged samples packet costs the deltas up to the next keyframe\n",
+                          flipped, (double) decode_ns / wire.size());
+}
+
+void bench_stream(){
+  printf("default poll plan with the setpoint moving every 40 ms, %u s per case; link share %u%%\n", STREAM_BENCH_RUN_MS / 1000, STREAM_LINK_SHARE);
+  printf("%-30s %8s %7s %8s %11s %11s %9s %s\n", "115200 baud console", "bytes/s", "link", "samples/s", "cpu/s", "dropped s/f",
+         "bad/skip", "final image");
+  run_case("binary, samples", 115200, false, 0, false);
+  run_case("binary, samples + frames", 115200, true, 0, true);
+  run_case("binary, 1 bit flip per 2000 B", 115200, true, 500, false);
+  printf("\n9600 baud console\n");
+  run_case("binary, samples + frames", 9600, true, 0, false);
+  printf("cpu/s: time spent in poll(), or in formatting the text, per second of traffic\n");
+}
@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../components/xy_capture.h"
+#include "../sim/xy6020l_sim.h"
+
+#define TRANSACTION_ITERATIONS  200
+#define SLOW_WRITE_US           300     // a UART write() that blocks on a full fifo
+
+typedef struct {
+  const char *name;
+  bool (*run)(xy6020l &psu, uint32_t i);
+} tTransactionOp;
+
+static bool op_all_hold_regs(xy6020l &psu, uint32_t){
+  return psu.get_all_hold_regs();
+}
+
+static bool op_fetch_preset(xy6020l &psu, uint32_t i){
+  tMemory preset = {};
+  preset.num = i % 10;
+  // measure the bus read, not the preset cache
+  psu.invalidate_presets();
+  return psu.fetch_preset(preset);
+}
+
+static bool op_set_preset(xy6020l &psu, uint32_t i){
+  tMemory preset = {};
+  preset.num = i % 10;
+  preset.VSet = 1200;
+  preset.ISet = 150;
+  preset.sOVP = 6200;
+  preset.sOCP = 2100;
+  psu.invalidate_presets();
+  return psu.set_preset(preset);
+}
+
+static bool op_single_write(xy6020l &psu, uint32_t i){
+  return psu.set_volt(1000 + (i % 100)) && psu.flush_writes(true);
+}
+
+static const tTransactionOp ops[] = {
+  {"get_all_hold_regs", op_all_hold_regs},
+  {"fetch_preset", op_fetch_preset},
+  {"set_preset", op_set_preset},
+  {"set_volt (FC 0x06)", op_single_write},
+};
+
+static uint32_t percentile(const std::vector<uint32_t> &sorted, uint32_t pct){
+  if (sorted.empty()) return 0;
+  size_t idx = (sorted.size() * pct) / 100;
+  return sorted[idx < sorted.size() ? idx : sorted.size() - 1];
+}
+
+static void run_blocking(const tSimConfig &config){
+  printf("%-20s %5s %5s %8s %8s %8s %8s %8s %8s %8s\n", "transaction", "ok", "fail", "p50 us", "p90 us", "p99 us", "max us", "txn/s", "srtt us", "rto us");
+
+  for (const tTransactionOp &op : ops){
+    xy6020l_sim sim;
+    sim.set_config(config);
+    xy6020l psu(&sim);
+    psu.begin(config.baud);
+
+    std::vector<uint32_t> latencies;
+    uint32_t failures = 0;
+    uint64_t start = bench_now_ns();
+
+    for (uint32_t i = 0; i < TRANSACTION_ITERATIONS; i++){
+      uint64_t t0 = bench_now_ns();
+      if (op.run(psu, i)) latencies.push_back((bench_now_ns() - t0) / 1000);
+      else failures++;
+    }
+
+    double seconds = (bench_now_ns() - start) / 1e9;
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-20s %5zu %5u %8u %8u %8u %8u %8.0f %8u %8u\n", op.name, latencies.size(), failures,
+           percentile(latencies, 50), percentile(latencies, 90), percentile(latencies, 99),
+           latencies.empty() ? 0 : latencies.back(), TRANSACTION_ITERATIONS / seconds, psu.get_srtt_us(), psu.get_rto_us());
+  }
+}
+
+static void count_done(const tTxnResult &result, void *ctx){
+  uint32_t *counters = (uint32_t *) ctx;
+  counters[result.status == TXN_OK ? 0 : 1]++;
+}
+
+static void run_pipelined(const tSimConfig &config){
+  xy6020l_sim sim;
+  sim.set_config(config);
+  xy6020l psu(&sim);
+  psu.begin(config.baud);
+
+  // keep the queue full with poll reads for two seconds
+  uint32_t counters[2] = {0, 0};
+  uint64_t start = bench_now_ns();
+  uint64_t end = start + 2000000000ULL;
+  uint32_t engine_rate = 0;
+
+  while (bench_now_ns() < end){
+    while (psu.submit_read(HREG_IDX_CV, 30, count_done, counters)){}
+    psu.process();
+    engine_rate = psu.get_transactions_per_second();
+  }
+
+  double seconds = (bench_now_ns() - start) / 1e9;
+  double bus_share = sim.stats().busTimeUs / (seconds * 1e6);
+  printf("%-20s %5u %5u %44.0f  (engine reports %u/s, wire busy %.0f%%)\n", "pipelined polls", counters[0], counters[1],
+         counters[0] / seconds, engine_rate, bus_share * 100.0);
+}
+
+static void drain(xy6020l &psu){
+  while (!psu.is_idle()) psu.process();
+}
+
+static void run_setpoint_burst(){
+  // a control loop period: V and I updated five times each, plus the output switched on
+  const uint32_t bursts = 50;
+  const char *names[] = {"immediate FC 0x06", "coalesced ring"};
+
+  printf("%-20s %8s %8s %12s %12s\n", "setpoint burst", "frames", "bytes", "wire us", "us/burst");
+
+  for (uint8_t coalesced = 0; coalesced < 2; coalesced++){
+    xy6020l_sim sim;
+    xy6020l psu(&sim);
+
+    for (uint32_t burst = 0; burst < bursts; burst++){
+      for (uint16_t step = 0; step < 5; step++){
+        uint16_t volt = 1000 + (burst * 10) + step;
+        uint16_t amps = 200 + step;
+        if (coalesced){
+          psu.set_volt(volt);
+          psu.set_current(amps);
+        } else {
+          psu.submit_write_single(HREG_IDX_CV, volt);
+          psu.submit_write_single(HREG_IDX_CC, amps);
+          drain(psu);
+        }
+      }
+      if (coalesced){
+        psu.set_switch_state(true);
+        psu.flush_writes(true);
+      } else {
+        psu.submit_write_single(HREG_IDX_OUTPUT_ON, 1);
+        drain(psu);
+      }
+    }
+
+    const tSimStats &stats = sim.stats();
+    printf("%-20s %8u %8u %12llu %12llu\n", names[coalesced], stats.requests, stats.bytesIn + stats.bytesOut,
+           (unsigned long long) stats.busTimeUs, (unsigned long long) stats.busTimeUs / bursts);
+  }
+}
+
+// output off, new setpoints, output on: the setpoints must land while the output is off
+static void run_write_order(){
+  xy6020l_sim sim;
+  xy6020l psu(&sim);
+  xy_capture capture;
+  capture.set_enabled(true);
+  psu.set_capture(&capture);
+
+  psu.set_switch_state(false);
+  psu.set_volt(3000);
+  psu.set_current(500);
+  psu.set_switch_state(true);
+  psu.set_volt(3100);     // after the output went on, so not merged into the first write of CV
+  psu.set_lock_state(true);
+  psu.flush_writes(true);
+
+  const uint16_t expected[][2] = {{HREG_IDX_OUTPUT_ON, 1}, {HREG_IDX_CV, 2}, {HREG_IDX_OUTPUT_ON, 1}, {HREG_IDX_CV, 1},
+                                  {HREG_IDX_LOCK, 1}};
+  const uint8_t expected_count = sizeof(expected) / sizeof(expected[0]);
+  uint8_t frames = 0;
+  bool ok = true;
+  tCaptureRecord record;
+  printf("write order:");
+  for (uint16_t i = 0; capture.get(i, record); i++){
+    if (record.dir != CAPTURE_TX) continue;
+    uint16_t start = (record.data[2] << 8) | record.data[3];
+    uint16_t count = record.data[1] == FUNC_CODE_WRITE_MULTIPLE_HOLD_REG ? (record.data[4] << 8) | record.data[5] : 1;
+    printf(" %02X+%u", start, count);
+    ok = ok && frames < expected_count && start == expected[frames][0] && count == expected[frames][1];
+    frames++;
+  }
+  printf(" -> %s\n", bench_check(ok && frames == expected_count && sim.get_register(HREG_IDX_CV) == 3100) ? "ok" : "WRONG ORDER");
+}
+
+// write() returns only once the frame left, other tasks keep submitting meanwhile
+class slow_port : public xy6020l_sim
+{
+  public:
+    size_t write(const uint8_t *buf, size_t size) override {
+      delayMicroseconds(SLOW_WRITE_US);
+      return xy6020l_sim::write(buf, size);
+    }
+    using xy6020l_sim::write;
+};
+
+static void count_setpoint(const tTxnResult &result, void *ctx){
+  uint32_t *counters = (uint32_t *) ctx;
+  counters[result.status == TXN_OK ? 0 : 1]++;
+  if (result.status == TXN_OK && result.funcCode == FUNC_CODE_READ_HOLD_REG && result.dataLen != result.count * 2) counters[1]++;
+}
+
+// setpoints and priority reads from a second task while the comm task is halfway through a write()
+static void run_concurrent_submit(){
+  slow_port sim;
+  xy6020l psu(&sim);
+  psu.begin(115200);
+
+  uint32_t polls[2] = {0, 0}, control[2] = {0, 0};
+  std::atomic<bool> running(true);
+  std::atomic<uint32_t> submitted(0);
+  std::thread control_task([&](){
+    for (uint16_t i = 0; running; i++){
+      bool queued = i % 2 ? psu.submit_write_single(HREG_IDX_CV, 1000 + (i % 500), count_setpoint, control)
+                          : psu.submit_priority_read(HREG_IDX_ACT_V, 2, count_setpoint, control);
+      if (queued) submitted++;
+      delay(10);
+    }
+  });
+
+  uint64_t end = bench_now_ns() + 2000000000ULL;
+  while (bench_now_ns() < end){
+    // leave room in the queue for the other task
+    if (psu.get_pending_transactions() < 3) psu.submit_read(HREG_IDX_CV, 30, count_setpoint, polls);
+    psu.process();
+  }
+  running = false;
+  control_task.join();
+  drain(psu);
+
+  // nothing is lost on this link, a failure is a reply matched to the wrong request
+  bool ok = polls[1] == 0 && control[1] == 0 && control[0] == submitted;
+  printf("concurrent submit: %u polls, %u of %u control frames ok, %u failed -> %s\n", polls[0], control[0],
+         (uint32_t) submitted, polls[1] + control[1], bench_check(ok) ? "ok" : "MISMATCHED");
+}
+
+// one task queues setpoints and lock changes while the comm task flushes into a nearly full transaction queue
+static void run_write_backlog(){
+  xy6020l_sim sim;
+  xy6020l psu(&sim);
+  psu.begin(115200);
+  psu.set_write_flush_delay(0);
+
+  const uint8_t regs[] = {HREG_IDX_CV, HREG_IDX_LOCK, HREG_IDX_CC, HREG_IDX_OUTPUT_ON};
+  std::atomic<uint16_t> accepted[4];
+  for (std::atomic<uint16_t> &value : accepted) value = 0;
+  std::atomic<bool> running(true);
+  uint32_t refused = 0;
+  std::thread control_task([&](){
+    for (uint16_t i = 1; running; i++){
+      uint8_t n = i % 4;
+      uint16_t value = n == 1 || n == 3 ? (i / 4) % 2 : 1000 + (i % 1000);
+      if (psu.queue_write(regs[n], value)) accepted[n] = value;
+      else refused++;
+      delayMicroseconds(100);
+    }
+  });
+
+  uint32_t polls[2] = {0, 0};
+  uint64_t end = bench_now_ns() + 1000000000ULL;
+  while (bench_now_ns() < end){
+    // two slots left, a flush queues a frame or two and puts the rest back
+    while (psu.get_pending_transactions() < 5 && psu.submit_read(HREG_IDX_CV, 30, count_done, polls)){}
+    psu.process();
+  }
+  running = false;
+  control_task.join();
+  psu.flush_writes(true);
+  drain(psu);
+
+  bool ok = psu.get_write_errors() == 0;
+  for (uint8_t n = 0; n < 4; n++) ok = ok && sim.get_register(regs[n]) == accepted[n];
+  printf("write backlog: %u writes refused, %u lost -> %s\n", refused, psu.get_write_errors(), bench_check(ok) ? "ok" : "LOST WRITES");
+}
+
+void bench_transactions(){
+  const uint32_t bauds[] = {115200, 9600};
+
+  for (uint32_t baud : bauds){
+    tSimConfig config = xy6020l_sim::default_config();
+    config.baud = baud;
+    printf("-- simulated slave: %u baud, %u us response latency --\n", config.baud, config.responseLatencyUs);
+    run_blocking(config);
+    run_pipelined(config);
+  }
+
+  tSimConfig lossy = xy6020l_sim::default_config();
+  lossy.byteGapUs = 50;
+  lossy.dropBytePpm = 500;
+  lossy.crcCorruptPpm = 10000;
+  printf("-- lossy link: 50 us byte gaps, 0.05%% dropped bytes, 1%% corrupted replies --\n");
+  run_blocking(lossy);
+
+  run_setpoint_burst();
+  run_write_order();
+  run_concurrent_submit();
+  run_write_backlog();
+}
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <algorithm>
+#include "bench.h"
+#include "../components/xy6020l.h"
+#include "../components/xy_watch.h"
+#include "../sim/xy6020l_sim.h"
+
+#define WATCH_BENCH_EVENTS    30
+
+// changes registers from inside the communication task, like the device would
+class event_sim : public xy6020l_sim
+{
+  public:
+    void schedule_trip(uint32_t delay_us){
+      _trip_at = micros() + delay_us;
+      _trip_armed = true;
+    }
+    void set_ramp(bool on){
+      _ramp_from = get_register(HREG_IDX_CV);
+      _ramp_us = micros();
+      _ramp = on;
+    }
+    std::atomic<uint32_t> tripped_us{0};
+
+    int available() override {
+      uint32_t now = micros();
+      if (_trip_armed && (int32_t)(now - _trip_at) >= 0){
+        _trip_armed = false;
+        set_register(HREG_IDX_PROTECT, get_register(HREG_IDX_PROTECT) ? 0 : 1);
+        tripped_us = now;
+      }
+      // the driver only looks at the port while a reply is due, so the ramp follows the clock
+      if (_ramp) set_register(HREG_IDX_CV, _ramp_from + ((now - _ramp_us) / 20000));
+      return xy6020l_sim::available();
+    }
+
+  private:
+    volatile uint32_t _trip_at = 0;
+    volatile bool _trip_armed = false;
+    volatile bool _ramp = false;
+    uint32_t _ramp_us = 0;
+    uint16_t _ramp_from = 0;
+};
+
+typedef struct {
+  xy6020l *psu;
+  std::atomic<bool> run;
+} tCommCtx;
+
+static void comm_task(tCommCtx *ctx){
+  while (ctx->run) ctx->psu->process();
+}
+
+typedef struct {
+  uint32_t latency[WATCH_BENCH_EVENTS];
+  uint8_t count;
+  uint32_t wakeups;
+} tWatchRun;
+
+static void print_run(const char *name, tWatchRun &run){
+  std::sort(run.latency, run.latency + run.count);
+  uint64_t sum = 0;
+  for (uint8_t i = 0; i < run.count; i++) sum += run.latency[i];
+  printf("%-26s %6u %9.2f %9.2f %9.2f %10.1f\n", name, run.count, run.count ? sum / (1000.0 * run.count) : 0,
+         run.count ? run.latency[run.count / 2] / 1000.0 : 0, run.count ? run.latency[run.count - 1] / 1000.0 : 0,
+         run.count ? (double) run.wakeups / run.count : 0);
+}
+
+// period_ms > 0 spins on get_protect_state() that often, 0 blocks on a watch queue
+static void run_case(const char *name, uint16_t period_ms){
+  event_sim sim;
+  xy6020l psu(&sim);
+  xy_watch watch;
+  psu.set_watch(&watch);
+  psu.use_default_poll_plan();
+  psu.start_polling();
+
+  QueueHandle_t queue = xQueueCreate(8, sizeof(tWatchEvent));
+  watch.watch_protection(queue);
+
+  tCommCtx ctx;
+  ctx.psu = &psu;
+  ctx.run = true;
+  std::thread comm(comm_task, &ctx);
+  delay(200);
+
+  tWatchRun run = {};
+  srand(11);
+  bool state = false;
+  tWatchEvent event;
+  while (xQueueReceive(queue, &event, 0) == pdTRUE);
+
+  for (uint8_t i = 0; i < WATCH_BENCH_EVENTS; i++){
+    sim.schedule_trip(20000 + (rand() % 80000));
+    uint32_t start = millis();
+    bool seen = false;
+    while (!seen && millis() - start < 1000){
+      if (period_ms){
+        delay(period_ms);
+        run.wakeups++;
+        seen = psu.get_protect_state() != state;
+      } else if (xQueueReceive(queue, &event, pdMS_TO_TICKS(1000)) == pdTRUE){
+        run.wakeups++;
+        seen = event.kind == (state ? WATCH_FALL : WATCH_RISE);
+      }
+    }
+    if (seen) run.latency[run.count++] = micros() - sim.tripped_us;
+    state = !state;
+  }
+
+  ctx.run = false;
+  comm.join();
+  vQueueDelete(queue);
+  print_run(name, run);
+}
+
+static void run_deadband(uint16_t deadband){
+  event_sim sim;
+  xy6020l psu(&sim);
+  xy_watch watch;
+  psu.set_watch(&watch);
+  psu.use_default_poll_plan();
+  psu.start_polling();
+  sim.set_register(HREG_IDX_CC, 500);
+  sim.set_register(HREG_IDX_CV, 500);
+  sim.set_register(HREG_IDX_OUTPUT_ON, 1);
+
+  QueueHandle_t queue = xQueueCreate(64, sizeof(tWatchEvent));
+  watch.subscribe(HREG_IDX_ACT_V, queue, deadband);
+
+  tCommCtx ctx;
+  ctx.psu = &psu;
+  ctx.run = true;
+  std::thread comm(comm_task, &ctx);
+  delay(100);
+  sim.set_ramp(true);
+
+  uint32_t events = 0;
+  tWatchEvent event;
+  uint32_t start = millis();
+  while (millis() - start < 2000){
+    if (xQueueReceive(queue, &event, pdMS_TO_TICKS(50)) == pdTRUE) events++;
+  }
+  ctx.run = false;
+  comm.join();
+
+  tWatchStats stats;
+  watch.get_stats(stats);
+  printf("deadband %3u (%.2f V)  %4u frames %4u changed words %4u events %u dropped\n", deadband, deadband / 100.0,
+         stats.frames, stats.changedWords, events, stats.dropped);
+  vQueueDelete(queue);
+}
+
+void bench_watch(){
+  printf("protection trip/clear to application, default poll plan (V/I/P and status at 20 Hz)\n");
+  printf("%-26s %6s %9s %9s %9s %10s\n", "application", "events", "mean ms", "p50 ms", "max ms", "wakeups/ev");
+  run_case("getters every 10 ms", 10);
+  run_case("getters every 1 ms", 1);
+  run_case("watch queue", 0);
+  printf("\nACT_V subscription while CV ramps 0.01 V per 20 ms for 2 s\n");
+  run_deadband(0);
+  run_deadband(10);
+  run_deadband(50);
+}
@@ -0,0 +1,95 @@
+/**
+ * @file crc16.h
+ * @brief Table driven Modbus RTU CRC16 (reflected polynomial 0xA001, init 0xFFFF)
+ *
+ * The lookup tables are generated by the compiler, nothing is computed at runtime.
+ * By default a 256 entry table (512 bytes of flash) is used, one lookup per byte.
+ * Builds short on flash can define CRC16_USE_NIBBLE_TABLE to switch to a 16 entry
+ * table (32 bytes) at the cost of two lookups per byte.
+ *
+ * The update function is incremental, so the CRC can follow the bytes while they
+ * arrive. Running it over a whole frame including its two CRC bytes yields 0
+ * when the frame is intact.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef crc16_h
+#define crc16_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CRC16_MODBUS_INIT   0xFFFF
+#define CRC16_MODBUS_POLY   0xA001
+
+typedef struct { uint16_t entry[256]; } tCrc16Table;
+typedef struct { uint16_t entry[16]; } tCrc16NibbleTable;
+
+constexpr uint16_t crc16_shift(uint16_t crc, uint8_t bits){
+  for (uint8_t j = 0; j < bits; j++){
+    crc = (crc & 0x0001) ? (crc >> 1) ^ CRC16_MODBUS_POLY : crc >> 1;
+  }
+  return crc;
+}
+
+constexpr tCrc16Table crc16_make_table(){
+  tCrc16Table table = {};
+  for (uint16_t i = 0; i < 256; i++) table.entry[i] = crc16_shift(i, 8);
+  return table;
+}
+
+constexpr tCrc16NibbleTable crc16_make_nibble_table(){
+  tCrc16NibbleTable table = {};
+  for (uint16_t i = 0; i < 16; i++) table.entry[i] = crc16_shift(i, 4);
+  return table;
+}
+
+// only the table referenced by crc16_update ends up in the image
+inline constexpr tCrc16Table CRC16_TABLE = crc16_make_table();
+inline constexpr tCrc16NibbleTable CRC16_NIBBLE_TABLE = crc16_make_nibble_table();
+
+constexpr uint16_t crc16_update_table(uint16_t crc, uint8_t data){
+  return (crc >> 8) ^ CRC16_TABLE.entry[(crc ^ data) & 0xFF];
+}
+
+constexpr uint16_t crc16_update_nibble(uint16_t crc, uint8_t data){
+  crc ^= data;
+  crc = (crc >> 4) ^ CRC16_NIBBLE_TABLE.entry[crc & 0x0F];
+  crc = (crc >> 4) ^ CRC16_NIBBLE_TABLE.entry[crc & 0x0F];
+  return crc;
+}
+
+/**
+ * @brief Feeds one byte into a running CRC
+ * @param crc previous value, start with CRC16_MODBUS_INIT
+ * @param data next byte
+ *
+ * @return updated crc16 value
+ */
+constexpr uint16_t crc16_update(uint16_t crc, uint8_t data){
+#ifdef CRC16_USE_NIBBLE_TABLE
+  return crc16_update_nibble(crc, data);
+#else
+  return crc16_update_table(crc, data);
+#endif
+}
+
+/**
+ * @brief Calculates the crc16 checksum of a buffer
+ * @param buf pointer to the data
+ * @param length data length
+ * @param crc start value, pass a previous result to continue a calculation
+ *
+ * @return crc16 value, low byte is sent first
+ */
+constexpr uint16_t crc16_calc(const uint8_t *buf, size_t length, uint16_t crc = CRC16_MODBUS_INIT){
+  for (size_t i = 0; i < length; i++) crc = crc16_update(crc, buf[i]);
+  return crc;
+}
+
+static constexpr uint8_t CRC16_CHECK_SAMPLE[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+static_assert(crc16_calc(CRC16_CHECK_SAMPLE, sizeof(CRC16_CHECK_SAMPLE)) == 0x4B37, "crc16 table does not match CRC-16/MODBUS");
+
+#endif
@@ -0,0 +1,86 @@
+/**
+ * @file seqlock.h
+ * @brief Single writer, many reader sequence lock for small trivially copyable structs
+ *
+ * The writer never waits: it makes the sequence odd, stores the payload and makes
+ * it even again. Readers on either core copy the payload and retry if the
+ * sequence was odd or changed meanwhile, so they never see half of an update and
+ * never hold anything the writer could block on. The payload is kept in 32 bit
+ * atomics accessed with relaxed ordering, which on the ESP32 compile to plain
+ * loads and stores, with fences ordering them against the sequence counter.
+ *
+ * A reader that keeps colliding with the writer sleeps a tick after
+ * SEQLOCK_SPIN_LIMIT attempts, so a higher priority reader on the writer's core
+ * cannot starve a preempted publish.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef seqlock_h
+#define seqlock_h
+
+#include "Arduino.h"
+#include <atomic>
+#include <type_traits>
+
+#define SEQLOCK_SPIN_LIMIT  64
+
+template <typename T>
+class xy_seqlock
+{
+  static_assert(std::is_trivially_copyable<T>::value, "seqlock payload must be trivially copyable");
+
+  public:
+    /**
+     * @brief Stores a new value, only one task may publish
+     * @return sequence number of the published value, starting at 1
+     */
+    uint32_t publish(const T &value){
+      uint32_t words[WORDS];
+      words[WORDS - 1] = 0;
+      memcpy(words, &value, sizeof(T));
+
+      uint32_t seq = _seq.load(std::memory_order_relaxed);
+      _seq.store(seq + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+
+      for (uint16_t i = 0; i < WORDS; i++) _words[i].store(words[i], std::memory_order_relaxed);
+
+      _seq.store(seq + 2, std::memory_order_release);
+      return (seq + 2) / 2;
+    }
+
+    /**
+     * @brief Copies a consistent value
+     * @return sequence number of the copy, 0 if nothing was published yet
+     */
+    uint32_t read(T &out) const {
+      uint32_t words[WORDS];
+
+      for (uint32_t attempt = 1;; attempt++){
+        if (attempt % SEQLOCK_SPIN_LIMIT == 0) vTaskDelay(1);
+
+        uint32_t before = _seq.load(std::memory_order_acquire);
+        if (before & 1) continue;
+
+        for (uint16_t i = 0; i < WORDS; i++) words[i] = _words[i].load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_seq.load(std::memory_order_relaxed) != before) continue;
+
+        memcpy(&out, words, sizeof(T));
+        return before / 2;
+      }
+    }
+
+    uint32_t get_sequence() const {return _seq.load(std::memory_order_acquire) / 2;}
+
+  private:
+    static constexpr uint16_t WORDS = (sizeof(T) + 3) / 4;
+
+    std::atomic<uint32_t> _seq{0};
+    std::atomic<uint32_t> _words[WORDS] = {};
+};
+
+#endif
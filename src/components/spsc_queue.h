@@ -0,0 +1,67 @@
+/**
+ * @file spsc_queue.h
+ * @brief Bounded lock-free ring queue for exactly one producer and one consumer task
+ *
+ * The producer only writes the head index and the consumer only the tail, so
+ * neither ever waits on the other and no critical section is needed: an item is
+ * stored before the head is released, and read before the tail is released.
+ * Both sides may run on different cores. Items are copied in and out; N must be
+ * a power of two and one slot stays empty to tell a full queue from an empty one.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef spsc_queue_h
+#define spsc_queue_h
+
+#include "Arduino.h"
+#include <atomic>
+#include <type_traits>
+
+template <typename T, uint16_t N>
+class xy_spsc_queue
+{
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "queue size must be a power of two");
+  static_assert(std::is_trivially_copyable<T>::value, "queue items must be trivially copyable");
+
+  public:
+    /**
+     * @brief Producer side, never blocks
+     * @return false if the queue is full
+     */
+    bool push(const T &item){
+      uint16_t head = _head.load(std::memory_order_relaxed);
+      uint16_t next = (head + 1) & (N - 1);
+      if (next == _tail.load(std::memory_order_acquire)) return false;
+
+      _items[head] = item;
+      _head.store(next, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * @brief Consumer side, never blocks
+     * @return false if the queue is empty
+     */
+    bool pop(T &item){
+      uint16_t tail = _tail.load(std::memory_order_relaxed);
+      if (tail == _head.load(std::memory_order_acquire)) return false;
+
+      item = _items[tail];
+      _tail.store((tail + 1) & (N - 1), std::memory_order_release);
+      return true;
+    }
+
+    // either side, exact for the calling side only
+    uint16_t size() const {return (_head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire)) & (N - 1);}
+    bool empty() const {return size() == 0;}
+    static constexpr uint16_t capacity(){return N - 1;}
+
+  private:
+    T _items[N];
+    std::atomic<uint16_t> _head{0};     // next slot the producer fills
+    std::atomic<uint16_t> _tail{0};     // next slot the consumer takes
+};
+
+#endif
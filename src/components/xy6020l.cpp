@@ -1,230 +1,1008 @@
 #include "xy6020l.h"
+#include "xy_bus.h"
+#include "xy_history.h"
+#include "xy_watch.h"
+#include "xy_stream.h"
+#include "xy_capture.h"
+
+
+typedef struct {
+  volatile TxnStatus status;
+  uint8_t *dest;
+} tBlockingCtx;
+
+typedef struct {
+  volatile uint8_t outstanding;
+  volatile bool failed;
+} tFlushCtx;
+
+static void blocking_done(const tTxnResult &result, void *ctx){
+  tBlockingCtx *blocking = (tBlockingCtx *) ctx;
+  if (result.status == TXN_OK && blocking->dest) memcpy(blocking->dest, result.data, result.dataLen);
+  blocking->status = result.status;
+}
+
+static void flush_done(const tTxnResult &result, void *ctx){
+  tFlushCtx *flush = (tFlushCtx *) ctx;
+  if (result.status != TXN_OK) flush->failed = true;
+  flush->outstanding--;
+}
 
+// index of the OUTPUT_ON value in a write request, -1 if the request does not touch it
+static int8_t output_on_value_index(const tTransaction &txn){
+  if (txn.funcCode == FUNC_CODE_READ_HOLD_REG) return -1;
+  if (HREG_IDX_OUTPUT_ON < txn.startReg || HREG_IDX_OUTPUT_ON >= txn.startReg + txn.count) return -1;
+  return (txn.funcCode == FUNC_CODE_WRITE_SINGLE_HOLD_REG ? 4 : 7) + ((HREG_IDX_OUTPUT_ON - txn.startReg) * 2);
+}
 
-bool xy6020l::read_hold_register_data(uint16_t holding_reg_start_addr, uint16_t no_of_register_to_read){
+uint8_t reply_length(const tTransaction &txn, const uint8_t *rx, uint8_t rx_len){
+  if (rx_len >= 2 && (rx[1] & 0x80)) return 5;
+  if (rx_len >= 3 && txn.funcCode == FUNC_CODE_READ_HOLD_REG && rx[2] + 5 < txn.expectedRxBytes) return rx[2] + 5;
+  return txn.expectedRxBytes;
+}
+
+TxnStatus check_reply(const tTransaction &txn, const uint8_t *rx, uint8_t len, uint16_t crc){
+  if (len < 5) return TXN_SHORT_FRAME;
+  if (crc != 0) return TXN_CRC_ERROR;
+  if (rx[0] != txn.txFrame[0]) return TXN_BAD_FRAME;
+  if (rx[1] == (txn.funcCode | 0x80)) return len == 5 ? TXN_EXCEPTION : TXN_BAD_FRAME;
+  if (rx[1] != txn.funcCode || len != txn.expectedRxBytes) return TXN_BAD_FRAME;
+  if (txn.funcCode == FUNC_CODE_READ_HOLD_REG) return rx[2] == txn.count * 2 ? TXN_OK : TXN_BAD_FRAME;
+  return memcmp(rx, txn.txFrame, 6) == 0 ? TXN_OK : TXN_BAD_FRAME;
+}
+
+void xy6020l::init_transaction(tTransaction &txn, uint8_t funcCode, uint16_t start_reg, uint16_t count, TxnCallback callback, void *ctx){
+  txn.funcCode = funcCode;
+  txn.startReg = start_reg;
+  txn.count = count;
+  txn.flags = 0;
+  txn.callback = callback;
+  txn.ctx = ctx;
+
+  txn.txFrame[0] = _slave_address;
+  txn.txFrame[1] = funcCode;
+  txn.txFrame[2] = start_reg >> 8;
+  txn.txFrame[3] = start_reg & 0xFF;
+}
+
+bool xy6020l::enqueue_transaction(const tTransaction &txn){
   if (!serialHandle) return false;
-  if (no_of_register_to_read == 0 || no_of_register_to_read > 30) return false;
-  
-  serialHandle->setTimeout(10);
 
-  //setup a temporary tx buffer
-  uint8_t txDataBuf[8];
-  txDataBuf[0] = _slave_address;
-  txDataBuf[1] = FUNC_CODE_READ_HOLD_REG;
-  txDataBuf[2] = holding_reg_start_addr >> 8;
-  txDataBuf[3] = holding_reg_start_addr & 0xFF;
-  txDataBuf[4] = no_of_register_to_read >> 8;
-  txDataBuf[5] = no_of_register_to_read & 0xFF;
+  portENTER_CRITICAL(&_lock);
+  if (_txn_count >= TXN_QUEUE_SIZE - 1){
+    portEXIT_CRITICAL(&_lock);
+    return false;
+  }
+  int8_t output_on = output_on_value_index(txn);
+  if (_output_inhibit && output_on >= 0 && (txn.txFrame[output_on] || txn.txFrame[output_on + 1])){
+    portEXIT_CRITICAL(&_lock);
+    return false;
+  }
 
-  uint16_t crc16 = crc16_calculator(txDataBuf, 6);
+  // control writes and priority reads overtake queued telemetry reads, never the transaction in flight
+  uint8_t pos = _txn_count;
+  uint8_t first_movable = _rx_state == IDLE ? 0 : 1;
+  if (txn.funcCode != FUNC_CODE_READ_HOLD_REG || (txn.flags & TXN_FLAG_PRIORITY)){
+    while (pos > first_movable){
+      const tTransaction &queued = _txn_queue[(_txn_head + pos - 1) % TXN_QUEUE_SIZE];
+      if (queued.funcCode != FUNC_CODE_READ_HOLD_REG || (queued.flags & TXN_FLAG_PRIORITY)) break;
+      _txn_queue[(_txn_head + pos) % TXN_QUEUE_SIZE] = _txn_queue[(_txn_head + pos - 1) % TXN_QUEUE_SIZE];
+      pos--;
+    }
+  }
+  _txn_queue[(_txn_head + pos) % TXN_QUEUE_SIZE] = txn;
+  _txn_count++;
 
-  txDataBuf[6] = crc16 & 0xFF;
-  txDataBuf[7] = crc16 >> 8;
+  portEXIT_CRITICAL(&_lock);
+  return true;
+}
 
-  size_t txDataSent = serialHandle->write(txDataBuf, sizeof(txDataBuf));
-  if(txDataSent != sizeof(txDataBuf)) return false;
+bool xy6020l::submit_read(uint16_t start_reg, uint16_t count, TxnCallback callback, void *ctx){
+  return enqueue_read(start_reg, count, 0, callback, ctx);
+}
 
-  uint8_t expectedRxBytes = (no_of_register_to_read * 2) + 5;
-  memset(response_temp_buf, 0, expectedRxBytes);
+bool xy6020l::submit_priority_read(uint16_t start_reg, uint16_t count, TxnCallback callback, void *ctx){
+  return enqueue_read(start_reg, count, TXN_FLAG_PRIORITY, callback, ctx);
+}
 
-  vTaskDelay(pdMS_TO_TICKS(5));
-  
-  size_t bytesRead = serialHandle->readBytes(response_temp_buf, expectedRxBytes);
-  if (bytesRead != expectedRxBytes) return false;
-  if (response_temp_buf[1] & 0x80) return false;
+bool xy6020l::enqueue_read(uint16_t start_reg, uint16_t count, uint8_t flags, TxnCallback callback, void *ctx){
+  if (count == 0 || count > 30) return false;
 
-  uint16_t rxCRC16 = (response_temp_buf[expectedRxBytes - 1] << 8) | (response_temp_buf[expectedRxBytes - 2]);
-  if (crc16_calculator(response_temp_buf, expectedRxBytes - 2) != rxCRC16) return false;
+  tTransaction txn;
+  init_transaction(txn, FUNC_CODE_READ_HOLD_REG, start_reg, count, callback, ctx);
+  txn.flags = flags;
+  if (lookup_frame(start_reg, count, txn.txFrame)) txn.flags |= TXN_FLAG_PREBUILT;
+  txn.txFrame[4] = count >> 8;
+  txn.txFrame[5] = count & 0xFF;
+  txn.txLen = 6;
+  txn.expectedRxBytes = (count * 2) + 5;
 
-  return true;
+  return enqueue_transaction(txn);
 }
 
-bool xy6020l::write_a_single_register(uint16_t reg_address, uint16_t value){
-  if (!serialHandle) return false;
-  
-  serialHandle->setTimeout(40);
+bool xy6020l::submit_write_single(uint16_t reg_address, uint16_t value, TxnCallback callback, void *ctx){
+  tTransaction txn;
+  init_transaction(txn, FUNC_CODE_WRITE_SINGLE_HOLD_REG, reg_address, 1, callback, ctx);
+  txn.txFrame[4] = value >> 8;
+  txn.txFrame[5] = value & 0xFF;
+  txn.txLen = 6;
+  txn.expectedRxBytes = 8;
 
-  uint8_t txDataBuf[8];
-  txDataBuf[0] = _slave_address;
-  txDataBuf[1] = FUNC_CODE_WRITE_SINGLE_HOLD_REG;
-  txDataBuf[2] = reg_address >> 8;
-  txDataBuf[3] = reg_address & 0xFF;
-  txDataBuf[4] = value >> 8;
-  txDataBuf[5] = value & 0xFF;
+  return enqueue_transaction(txn);
+}
 
-  uint16_t crc16 = crc16_calculator(txDataBuf, 6);
+bool xy6020l::submit_write_multiple(uint16_t start_reg, uint16_t count, const uint8_t *value_buf, TxnCallback callback, void *ctx){
+  if (count == 0 || count > 14) return false;
+  if (!value_buf) return false;
 
-  txDataBuf[6] = crc16 & 0xFF;
-  txDataBuf[7] = crc16 >> 8;
+  tTransaction txn;
+  init_transaction(txn, FUNC_CODE_WRITE_MULTIPLE_HOLD_REG, start_reg, count, callback, ctx);
+  uint8_t data_byte_count = count * 2;
+  txn.txFrame[4] = count >> 8;
+  txn.txFrame[5] = count & 0xFF;
+  txn.txFrame[6] = data_byte_count;
+  memcpy(&txn.txFrame[7], value_buf, data_byte_count);
+  txn.txLen = 7 + data_byte_count;
+  txn.expectedRxBytes = 8;
+
+  return enqueue_transaction(txn);
+}
 
-  size_t txDataSent = serialHandle->write(txDataBuf, sizeof(txDataBuf));
-  if(txDataSent != sizeof(txDataBuf)) return false;
+void xy6020l::build_trip_frame(){
+  init_transaction(_trip_txn, FUNC_CODE_WRITE_SINGLE_HOLD_REG, HREG_IDX_OUTPUT_ON, 1, nullptr, nullptr);
+  tRequestFrame frame = _slave_address == DEFAULT_SLAVE_ADDRESS ? XY_DEFAULT_TRIP_FRAME
+                      : make_write_single_frame(_slave_address, HREG_IDX_OUTPUT_ON, 0);
+  memcpy(_trip_txn.txFrame, frame.bytes, REQUEST_FRAME_LEN);
+  _trip_txn.txLen = 6;
+  _trip_txn.expectedRxBytes = 8;
+  _trip_txn.flags = TXN_FLAG_URGENT | TXN_FLAG_PREBUILT;
+}
 
-  uint8_t expectedRxBytes = 8;
+static inline uint8_t frame_slot(uint16_t start_reg, uint16_t count){
+  return ((start_reg * 7) + count) & (FRAME_CACHE_SIZE - 1);
+}
 
-  memset(response_temp_buf, 0, expectedRxBytes);
+void xy6020l::rebuild_frames(){
+  portENTER_CRITICAL(&_lock);
+  memset(_frame_cache, 0, sizeof(_frame_cache));
+  _frame_cache_poll = 0;
+  portEXIT_CRITICAL(&_lock);
+
+  // the fixed reads are complete constants at the default address, otherwise built once here
+  for (uint8_t i = 0; i < XY_FIXED_READ_COUNT; i++){
+    const tReadRange &range = XY_FIXED_READS.range[i];
+    if (_slave_address == DEFAULT_SLAVE_ADDRESS) cache_frame(range.startReg, range.count, XY_DEFAULT_FRAMES.frame[i]);
+    else cache_frame(range.startReg, range.count, make_read_frame(_slave_address, range.startReg, range.count));
+  }
+  for (uint8_t i = 0; i < _poll_group_count; i++) learn_poll_frame(_poll_groups[i].startReg, _poll_groups[i].count);
 
-  vTaskDelay(pdMS_TO_TICKS(5));
-  
-  size_t bytesRead = serialHandle->readBytes(response_temp_buf, expectedRxBytes);
-  if (bytesRead != expectedRxBytes) return false;
-  if (response_temp_buf[1] & 0x80) return false;
+  build_trip_frame();
+}
 
-  uint16_t rxCRC16 = (response_temp_buf[expectedRxBytes - 1] << 8) | (response_temp_buf[expectedRxBytes - 2]);
+void xy6020l::cache_frame(uint16_t start_reg, uint16_t count, const tRequestFrame &frame){
+  portENTER_CRITICAL(&_lock);
+  uint8_t slot = frame_slot(start_reg, count);
+  while (_frame_cache[slot].count && !(_frame_cache[slot].startReg == start_reg && _frame_cache[slot].count == count)){
+    slot = (slot + 1) & (FRAME_CACHE_SIZE - 1);
+  }
+  tFrameCacheEntry &entry = _frame_cache[slot];
+  entry.startReg = start_reg;
+  entry.count = count;
+  entry.frame = frame;
+  portEXIT_CRITICAL(&_lock);
+}
 
-  if(crc16_calculator(response_temp_buf, expectedRxBytes - 2) != rxCRC16) return false;
+bool xy6020l::lookup_frame(uint16_t start_reg, uint16_t count, uint8_t *dest){
+  portENTER_CRITICAL(&_lock);
+  for (uint8_t slot = frame_slot(start_reg, count); _frame_cache[slot].count; slot = (slot + 1) & (FRAME_CACHE_SIZE - 1)){
+    const tFrameCacheEntry &entry = _frame_cache[slot];
+    if (entry.startReg != start_reg || entry.count != count) continue;
+    if (dest){
+      memcpy(dest, entry.frame.bytes, REQUEST_FRAME_LEN);
+      _frame_hits++;
+    }
+    portEXIT_CRITICAL(&_lock);
+    return true;
+  }
+  if (dest) _frame_misses++;
+  portEXIT_CRITICAL(&_lock);
+  return false;
+}
 
-  return true;
+void xy6020l::learn_poll_frame(uint16_t start_reg, uint16_t count){
+  // poll ranges repeat, their frames are built the first time only
+  if (_frame_cache_poll >= FRAME_CACHE_POLL || lookup_frame(start_reg, count, nullptr)) return;
+  cache_frame(start_reg, count, make_read_frame(_slave_address, start_reg, count));
+  _frame_cache_poll++;
 }
 
-bool xy6020l::write_multiple_registers(uint16_t holding_reg_start_addr, uint16_t no_of_register_to_write, uint8_t data_byte_count, uint8_t *value_buf){
+bool xy6020l::trip_output(TxnCallback callback, void *ctx){
   if (!serialHandle) return false;
 
-  if (no_of_register_to_write == 0 || no_of_register_to_write > 14) return false;
-  if (data_byte_count != no_of_register_to_write * 2) return false;
-  if (!value_buf) return false;
+  portENTER_CRITICAL(&_lock);
+  _output_inhibit = true;
 
-  
-  serialHandle->setTimeout(10);
+  // a pending setpoint would switch the output back on
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < _tx_ring_count; i++){
+    txRingEle ele = _tx_ring[(_tx_ring_head + i) % TX_RING_BUFFER_SIZE];
+    if (ele.mHregIdx == HREG_IDX_OUTPUT_ON) continue;
+    _tx_ring[(_tx_ring_head + kept++) % TX_RING_BUFFER_SIZE] = ele;
+  }
+  _tx_ring_count = kept;
+
+  // queued writes still go out, with the output kept off
+  uint8_t first_movable = _rx_state == IDLE ? 0 : 1;
+  for (uint8_t pos = first_movable; pos < _txn_count; pos++){
+    tTransaction &queued = _txn_queue[(_txn_head + pos) % TXN_QUEUE_SIZE];
+    int8_t output_on = output_on_value_index(queued);
+    if (output_on < 0) continue;
+    queued.txFrame[output_on] = 0;
+    queued.txFrame[output_on + 1] = 0;
+  }
 
-  uint8_t txDataBuf[9 + data_byte_count];
-  txDataBuf[0] = _slave_address;
-  txDataBuf[1] = FUNC_CODE_WRITE_MULTIPLE_HOLD_REG;
-  txDataBuf[2] = holding_reg_start_addr >> 8;
-  txDataBuf[3] = holding_reg_start_addr & 0xFF;
-  txDataBuf[4] = no_of_register_to_write >> 8;
-  txDataBuf[5] = no_of_register_to_write & 0xFF;
-  txDataBuf[6] = data_byte_count;
+  if (_trip_queued){
+    portEXIT_CRITICAL(&_lock);
+    return true;
+  }
 
-  for(int data = 0; data < data_byte_count; data++){
-    txDataBuf[7 + data] = value_buf[data];
+  // the slot enqueue_transaction keeps free, ahead of everything not yet on the wire
+  for (uint8_t pos = _txn_count; pos > first_movable; pos--){
+    _txn_queue[(_txn_head + pos) % TXN_QUEUE_SIZE] = _txn_queue[(_txn_head + pos - 1) % TXN_QUEUE_SIZE];
   }
+  tTransaction &trip = _txn_queue[(_txn_head + first_movable) % TXN_QUEUE_SIZE];
+  trip = _trip_txn;
+  trip.callback = callback;
+  trip.ctx = ctx;
+  _txn_count++;
+  _trip_queued = true;
+
+  portEXIT_CRITICAL(&_lock);
+  return true;
+}
 
-  uint16_t crc16 = crc16_calculator(txDataBuf, 7 + data_byte_count);
-  txDataBuf[7 + data_byte_count] = crc16 & 0xFF;
-  txDataBuf[8 + data_byte_count] = crc16 >> 8;
+void xy6020l::process(){
+  if (_bus){
+    _bus->process();
+    return;
+  }
 
-  size_t txDataSent = serialHandle->write(txDataBuf, sizeof(txDataBuf));
-  if(txDataSent != sizeof(txDataBuf)) return false;
+  service(millis());
 
-  uint8_t expectedRxBytes = 8;
-  memset(response_temp_buf, 0, expectedRxBytes);
+  // loop so a finished transaction is followed by the next request in the same call
+  while (!transfer(true)){
+    if (_txn_count == 0 || frame_gap_pending()) return;
+  }
+}
 
-  vTaskDelay(pdMS_TO_TICKS(5));
-  
-  size_t bytesRead = serialHandle->readBytes(response_temp_buf, expectedRxBytes);
-  if (bytesRead != expectedRxBytes) return false;
-  if (response_temp_buf[1] & 0x80) return false;
+void xy6020l::service(uint32_t now){
+  if (now - _txn_window_start_ms >= 1000){
+    _txn_per_sec = (_txn_completed * 1000) / (now - _txn_window_start_ms);
+    _txn_completed = 0;
+    _txn_window_start_ms = now;
+  }
 
-  uint16_t rxCRC16 = (response_temp_buf[expectedRxBytes - 1] << 8) | (response_temp_buf[expectedRxBytes - 2]);
+  if (_tx_ring_count && (int32_t)(now - _tx_ring_deadline_ms) >= 0) flush_writes();
+  if (_polling && _poll_outstanding == 0) schedule_polls(now);
+}
 
-  if(crc16_calculator(response_temp_buf, expectedRxBytes - 2) != rxCRC16) return false;
+bool xy6020l::control_pending(){
+  portENTER_CRITICAL(&_lock);
+  bool control = _rx_state == IDLE && _txn_count && _txn_queue[_txn_head].funcCode != FUNC_CODE_READ_HOLD_REG;
+  portEXIT_CRITICAL(&_lock);
+  return control;
+}
 
+bool xy6020l::transfer(bool may_start){
+  if (_rx_state == IDLE){
+    if (!may_start || _txn_count == 0) return false;
+    if (!start_transaction()) return false;
+  }
+
+  while (_rx_state != IDLE){
+    if (_rx_state == RECEIVING){
+      receive_bytes();
+      if (_rx_state != RECEIVING) continue;
+
+      uint32_t now_us = micros();
+      // the deadline covers the first byte, after that a reply that went silent for t3.5 is over
+      if (_rx_len == 0){
+        if (now_us - _txn_start_us > _timeout) complete_transaction(TXN_TIMEOUT);
+        else return true;
+      } else if (now_us - _rx_last_us > _t35_us + RTU_SILENCE_SLACK_US){
+        complete_transaction(TXN_SHORT_FRAME);
+      } else if (now_us - _rx_first_us > 2 * _rx_expected * _char_time_us + _t35_us + RTU_SILENCE_SLACK_US){
+        // a slave that keeps babbling
+        complete_transaction(TXN_TIMEOUT);
+      } else {
+        return true;
+      }
+    } else {
+      // the crc was updated while the bytes arrived, over the crc bytes included it ends at 0
+      complete_transaction(check_reply(_txn_queue[_txn_head], response_temp_buf, _rx_len, _rx_crc));
+    }
+  }
+  return false;
+}
+
+void xy6020l::set_link_baud(uint32_t baud){
+  if (baud == 0) return;
+  _link_baud = baud;
+  _char_time_us = (RTU_BITS_PER_CHAR * 1000000UL + baud - 1) / baud;
+
+  if (baud > 19200){
+    _t15_us = RTU_FIXED_T15_US;
+    _t35_us = RTU_FIXED_T35_US;
+  } else {
+    _t15_us = (_char_time_us * 3) / 2;
+    _t35_us = (_char_time_us * 7) / 2;
+  }
+  _frame_gap_us = _t35_us;
+}
+
+void xy6020l::update_rtt(uint32_t sample_us){
+  if (_srtt_us == 0){
+    _srtt_us = sample_us ? sample_us : 1;
+    _rttvar_us = sample_us / 2;
+  } else {
+    int32_t err = (int32_t) sample_us - (int32_t) _srtt_us;
+    uint32_t abs_err = err < 0 ? -err : err;
+    _srtt_us = (int32_t) _srtt_us + (err / 8);
+    _rttvar_us = (int32_t) _rttvar_us + (((int32_t) abs_err - (int32_t) _rttvar_us) / 4);
+  }
+
+  _rto_us = _srtt_us + (4 * _rttvar_us);
+  if (_rto_us < RTO_MIN_US) _rto_us = RTO_MIN_US;
+  if (_rto_us > RTO_MAX_US) _rto_us = RTO_MAX_US;
+}
+
+bool xy6020l::start_transaction(){
+  tTransaction &txn = _txn_queue[_txn_head];
+
+  // keep the inter-frame silence, t3.5 unless configured otherwise
+  if (frame_gap_pending()) return false;
+
+  // drop late bytes of a previous, timed out reply
+  uint8_t stray[CAPTURE_FRAME_MAX];
+  uint8_t stray_len = 0;
+  while (serialHandle->available()){
+    int rxByte = serialHandle->read();
+    if (_capture && rxByte >= 0 && stray_len < sizeof(stray)) stray[stray_len++] = rxByte;
+  }
+  if (stray_len) _capture->add(CAPTURE_STRAY, TXN_PENDING, stray, stray_len, micros());
+
+  // from here on submits and trip_output() queue behind the head instead of replacing it
+  portENTER_CRITICAL(&_lock);
+  _rx_state = SENDING;
+  portEXIT_CRITICAL(&_lock);
+
+  if (!(txn.flags & TXN_FLAG_PREBUILT)){
+    uint16_t crc16 = crc16_calc(txn.txFrame, txn.txLen);
+    txn.txFrame[txn.txLen] = crc16 & 0xFF;
+    txn.txFrame[txn.txLen + 1] = crc16 >> 8;
+  }
+
+  _rx_len = 0;
+  _rx_crc = CRC16_MODBUS_INIT;
+  _rx_expected = txn.expectedRxBytes;
+  _tx_wire_us = (txn.txLen + 2) * _char_time_us;
+  _timeout = _tx_wire_us + _rto_us + _t35_us;
+  _txn_start_us = micros();
+
+  size_t txDataSent = serialHandle->write(txn.txFrame, txn.txLen + 2);
+  if (txDataSent != (size_t)(txn.txLen + 2)){
+    complete_transaction(TXN_TX_ERROR);
+    return true;
+  }
+
+  _rx_state = RECEIVING;
   return true;
 }
 
-bool xy6020l::get_all_hold_regs(){
-  bool response = read_hold_register_data(HREG_IDX_CV, 30);
+void xy6020l::receive_bytes(){
+  tTransaction &txn = _txn_queue[_txn_head];
+
+  while (_rx_len < _rx_expected && serialHandle->available()){
+    int rxByte = serialHandle->read();
+    if (rxByte < 0) break;
+    _rx_last_us = micros();
+    if (_rx_len == 0) _rx_first_us = _rx_last_us;
+    response_temp_buf[_rx_len++] = (uint8_t) rxByte;
+    _rx_crc = crc16_update(_rx_crc, (uint8_t) rxByte);
+
+    // exception replies and reads with a short byte count end before the requested length
+    if (_rx_len == 2 || _rx_len == 3) _rx_expected = reply_length(txn, response_temp_buf, _rx_len);
+    // discard anything not addressed to us before the frame started
+    if (_rx_len == 1 && response_temp_buf[0] != txn.txFrame[0]){
+      _rx_len = 0;
+      _rx_crc = CRC16_MODBUS_INIT;
+    }
+  }
 
-  if (!response) return response;
+  if (_rx_len == _rx_expected) _rx_state = COMPLETE;
+}
+
+void xy6020l::complete_transaction(TxnStatus status){
+  portENTER_CRITICAL(&_lock);
+  tTransaction txn = _txn_queue[_txn_head];
+  _rx_state = IDLE;
+  // a failed trip frame stays at the head until the device acknowledged it
+  bool retry = (txn.flags & TXN_FLAG_URGENT) && status != TXN_OK && _output_inhibit;
+  if (!retry){
+    _txn_head = (_txn_head + 1) % TXN_QUEUE_SIZE;
+    _txn_count--;
+    if (txn.flags & TXN_FLAG_URGENT) _trip_queued = false;
+  }
+  portEXIT_CRITICAL(&_lock);
+
+  _txn_completed++;
+
+  // silence is counted from the last byte seen on the bus
+  uint32_t now_us = micros();
+  _bus_last_us = _rx_len ? _rx_last_us : now_us;
+
+  if (status == TXN_OK){
+    // turnaround of the slave: first reply byte minus the time the request needed on the wire
+    uint32_t turnaround = _rx_first_us - _txn_start_us;
+    update_rtt(turnaround > _tx_wire_us ? turnaround - _tx_wire_us : 0);
+  } else if (status == TXN_TIMEOUT){
+    // back off like a retransmission timer until a reply is measured again
+    _rto_us = _rto_us * 2 > RTO_MAX_US ? RTO_MAX_US : _rto_us * 2;
+  }
+
+  tTxnResult result;
+  result.status = status;
+  result.funcCode = txn.funcCode;
+  result.startReg = txn.startReg;
+  result.count = txn.count;
+  result.exception = status == TXN_EXCEPTION ? response_temp_buf[2] : 0;
+  result.data = nullptr;
+  result.dataLen = 0;
+  result.latencyUs = now_us - _txn_start_us;
+
+  _last_status = status;
+  _last_exception = result.exception;
+  uint8_t func = txn.funcCode == FUNC_CODE_READ_HOLD_REG ? METRICS_FC_READ
+               : txn.funcCode == FUNC_CODE_WRITE_SINGLE_HOLD_REG ? METRICS_FC_WRITE_SINGLE : METRICS_FC_WRITE_MULTIPLE;
+  uint16_t tx_bytes = status == TXN_TX_ERROR ? 0 : txn.txLen + 2;
+  uint32_t busy_us = (status == TXN_TX_ERROR ? 0 : _tx_wire_us) + (_rx_len ? (_rx_last_us - _rx_first_us) + _char_time_us : 0);
+  _metrics.record(func, status, result.exception, result.latencyUs, tx_bytes, _rx_len, busy_us);
+
+  if (_capture){
+    if (tx_bytes) _capture->add(CAPTURE_TX, status, txn.txFrame, tx_bytes, _txn_start_us);
+    if (_rx_len) _capture->add(CAPTURE_RX, status, response_temp_buf, _rx_len, _rx_first_us);
+  }
+
+  if (_stream && _stream->frames_enabled()){
+    uint32_t stamp = millis();
+    if (tx_bytes) _stream->add_frame(false, status, txn.txFrame, tx_bytes, stamp);
+    if (_rx_len) _stream->add_frame(true, status, response_temp_buf, _rx_len, stamp);
+  }
+
+  // mirror acknowledged setpoints so the getters do not wait for the next poll
+  if (status == TXN_OK && txn.funcCode != FUNC_CODE_READ_HOLD_REG && txn.startReg >= HREG_IDX_M0){
+    cache_preset_data(txn.startReg, txn.count, &txn.txFrame[txn.funcCode == FUNC_CODE_WRITE_SINGLE_HOLD_REG ? 4 : 7], true);
+  }
+
+  if (status == TXN_OK && txn.funcCode != FUNC_CODE_READ_HOLD_REG && txn.startReg + txn.count <= 30){
+    const uint8_t *values = &txn.txFrame[txn.funcCode == FUNC_CODE_WRITE_SINGLE_HOLD_REG ? 4 : 7];
+    memcpy(&all_hold_reg_data[txn.startReg * 2], values, txn.count * 2);
+    regmap_decode(XY_HOLD_REG_MAP, all_hold_reg_data, txn.startReg, txn.startReg + txn.count, _telemetry);
+    uint32_t stamp = millis();
+    publish_snapshot(stamp);
+    if (_watch) _watch->update(txn.startReg, txn.count, values, stamp);
+    if (_stream) _stream->add_registers(txn.startReg, txn.count, values, stamp);
+  }
+
+  if (status == TXN_OK && txn.funcCode == FUNC_CODE_READ_HOLD_REG){
+    result.data = &response_temp_buf[3];
+    result.dataLen = txn.count * 2;
+
+    if (txn.startReg >= HREG_IDX_M0) cache_preset_data(txn.startReg, txn.count, result.data, false);
+
+    if (txn.startReg + txn.count <= 30){
+      memcpy(&all_hold_reg_data[txn.startReg * 2], result.data, result.dataLen);
+      regmap_decode(XY_HOLD_REG_MAP, all_hold_reg_data, txn.startReg, txn.startReg + txn.count, _telemetry);
+      uint32_t stamp = millis();
+      for (uint16_t reg = txn.startReg; reg < txn.startReg + txn.count; reg++) _reg_stamp_ms[reg] = stamp ? stamp : 1;
+      publish_snapshot(stamp);
+      if (_watch) _watch->update(txn.startReg, txn.count, result.data, stamp);
+      if (_stream) _stream->add_registers(txn.startReg, txn.count, result.data, stamp);
+
+      if (_history && txn.startReg <= HREG_IDX_ACT_V && txn.startReg + txn.count > HREG_IDX_ACT_P){
+        uint16_t values[HISTORY_CHANNELS] = {_telemetry.actVolt, _telemetry.actCurrent, _telemetry.actPower,
+                                             _telemetry.tempInternal, _telemetry.tempExternal};
+        _history->add(stamp, values);
+      }
+    }
+  }
 
-  for (int data = 0; data < 60; data++){
-    all_hold_reg_data[data] = response_temp_buf[data + 3];
+  if (retry) return;
+  if (txn.callback) txn.callback(result, txn.ctx);
+}
+
+bool xy6020l::wait_for(volatile TxnStatus &status){
+  while (status == TXN_PENDING){
+    process();
+    if (status != TXN_PENDING) break;
+    vTaskDelay(1);
   }
+  return status == TXN_OK;
+}
+
+bool xy6020l::read_hold_register_data(uint16_t holding_reg_start_addr, uint16_t no_of_register_to_read, uint8_t *dest){
+  tBlockingCtx blocking = {TXN_PENDING, dest};
+  if (!submit_read(holding_reg_start_addr, no_of_register_to_read, blocking_done, &blocking)) return false;
+
+  return wait_for(blocking.status);
+}
 
+bool xy6020l::write_a_single_register(uint16_t reg_address, uint16_t value){
+  tBlockingCtx blocking = {TXN_PENDING, nullptr};
+  if (!submit_write_single(reg_address, value, blocking_done, &blocking)) return false;
+
+  return wait_for(blocking.status);
+}
+
+bool xy6020l::write_multiple_registers(uint16_t holding_reg_start_addr, uint16_t no_of_register_to_write, uint8_t data_byte_count, uint8_t *value_buf){
+  if (data_byte_count != no_of_register_to_write * 2) return false;
+
+  tBlockingCtx blocking = {TXN_PENDING, nullptr};
+  if (!submit_write_multiple(holding_reg_start_addr, no_of_register_to_write, value_buf, blocking_done, &blocking)) return false;
+
+  return wait_for(blocking.status);
+}
+
+// writes that change what the others act on keep their place in the submission order
+static bool ordered_write(uint8_t reg){
+  return reg == HREG_IDX_OUTPUT_ON || reg == HREG_IDX_LOCK || reg == HREG_IDX_PROTECT || reg == HREG_IDX_MEMORY;
+}
+
+bool xy6020l::queue_write(uint8_t reg_address, uint16_t value){
+  if (reg_address < 30 && !regmap_writable(XY_HOLD_REG_MAP, reg_address)) return false;
+  if (reg_address == HREG_IDX_OUTPUT_ON && value && _output_inhibit) return false;
+
+  portENTER_CRITICAL(&_lock);
+  // newest first, a pending write is only replaced if that does not move it across an ordered one
+  for (uint8_t i = _tx_ring_count; i > 0; i--){
+    txRingEle &ele = _tx_ring[(_tx_ring_head + i - 1) % TX_RING_BUFFER_SIZE];
+    if (ele.mHregIdx == reg_address){
+      ele.mValue = value;
+      portEXIT_CRITICAL(&_lock);
+      return true;
+    }
+    if (ordered_write(ele.mHregIdx) || ordered_write(reg_address)) break;
+  }
+  bool full = _tx_ring_count + _tx_ring_held >= TX_RING_BUFFER_SIZE;
+  portEXIT_CRITICAL(&_lock);
+
+  if (full && !flush_writes()) return false;
+
+  portENTER_CRITICAL(&_lock);
+  // a flush that could not queue everything puts the rest back, its room is kept for it
+  if (_tx_ring_count + _tx_ring_held >= TX_RING_BUFFER_SIZE){
+    portEXIT_CRITICAL(&_lock);
+    return false;
+  }
+  if (_tx_ring_count == 0) _tx_ring_deadline_ms = millis() + _write_flush_delay_ms;
+
+  txRingEle &ele = _tx_ring[(_tx_ring_head + _tx_ring_count) % TX_RING_BUFFER_SIZE];
+  ele.mHregIdx = reg_address;
+  ele.mValue = value;
+  _tx_ring_count++;
+  portEXIT_CRITICAL(&_lock);
   return true;
 }
 
-uint16_t xy6020l::crc16_calculator(uint8_t *data, uint8_t length) {
-    uint16_t crc = 0xFFFF;
-    
-    for (uint8_t i = 0; i < length; i++) {
-        crc ^= data[i];
-        
-        for (uint8_t j = 0; j < 8; j++) {
-            if (crc & 0x0001) {
-                crc >>= 1;
-                crc ^= 0xA001;
-            } else {
-                crc >>= 1;
-            }
+void xy6020l::write_done(const tTxnResult &result, void *ctx){
+  if (result.status != TXN_OK) ((xy6020l *) ctx)->_write_errors++;
+}
+
+bool xy6020l::flush_writes(bool wait){
+  tFlushCtx flush = {0, false};
+
+  // drain the ring; between ordered writes it is sorted by register so adjacent ones form runs
+  txRingEle pending[TX_RING_BUFFER_SIZE];
+  uint8_t count = 0, segment = 0;
+  portENTER_CRITICAL(&_lock);
+  while (_tx_ring_count){
+    txRingEle ele = _tx_ring[_tx_ring_head];
+    uint8_t pos = count++;
+    while (!ordered_write(ele.mHregIdx) && pos > segment && pending[pos - 1].mHregIdx > ele.mHregIdx){
+      pending[pos] = pending[pos - 1];
+      pos--;
+    }
+    pending[pos] = ele;
+    if (ordered_write(ele.mHregIdx)) segment = count;
+    _tx_ring_head = (_tx_ring_head + 1) % TX_RING_BUFFER_SIZE;
+    _tx_ring_count--;
+  }
+  _tx_ring_held += count;
+  portEXIT_CRITICAL(&_lock);
+
+  TxnCallback callback = wait ? flush_done : write_done;
+  void *ctx = wait ? (void *) &flush : (void *) this;
+  bool queued = true;
+
+  for (uint8_t first = 0; first < count;){
+    uint8_t run = 1;
+    while (first + run < count && run < MEM_REGS && !ordered_write(pending[first].mHregIdx) &&
+           !ordered_write(pending[first + run].mHregIdx) && pending[first + run].mHregIdx == pending[first].mHregIdx + run) run++;
+
+    bool ok;
+    if (run == 1){
+      ok = submit_write_single(pending[first].mHregIdx, pending[first].mValue, callback, ctx);
+    } else {
+      uint8_t value_buf[MEM_REGS * 2];
+      for (uint8_t i = 0; i < run; i++){
+        value_buf[i * 2] = pending[first + i].mValue >> 8;
+        value_buf[(i * 2) + 1] = pending[first + i].mValue & 0xFF;
+      }
+      ok = submit_write_multiple(pending[first].mHregIdx, run, value_buf, callback, ctx);
+    }
+
+    if (!ok){
+      // transaction queue is full, the rest goes back ahead of anything queued meanwhile, for the next flush
+      portENTER_CRITICAL(&_lock);
+      txRingEle newer[TX_RING_BUFFER_SIZE];
+      uint8_t newer_count = _tx_ring_count;
+      for (uint8_t j = 0; j < newer_count; j++) newer[j] = _tx_ring[(_tx_ring_head + j) % TX_RING_BUFFER_SIZE];
+      _tx_ring_head = 0;
+      _tx_ring_count = 0;
+      for (uint8_t i = first; i < count; i++) _tx_ring[_tx_ring_count++] = pending[i];
+      _tx_ring_held -= count - first;
+      for (uint8_t j = 0; j < newer_count; j++){
+        // a newer value of a plain register replaces the old one unless an ordered write lies between them
+        bool merged = false;
+        for (uint8_t i = _tx_ring_count; i > 0 && !merged; i--){
+          txRingEle &ele = _tx_ring[i - 1];
+          if (ele.mHregIdx == newer[j].mHregIdx && !ordered_write(ele.mHregIdx)){
+            ele.mValue = newer[j].mValue;
+            merged = true;
+          }
+          if (ordered_write(ele.mHregIdx) || ordered_write(newer[j].mHregIdx)) break;
         }
+        if (merged) continue;
+        // queue_write() keeps room for the held entries, this only happens if that was bypassed
+        if (_tx_ring_count < TX_RING_BUFFER_SIZE) _tx_ring[_tx_ring_count++] = newer[j];
+        else _write_errors++;
+      }
+      _tx_ring_deadline_ms = millis();
+      portEXIT_CRITICAL(&_lock);
+      queued = false;
+      break;
+    }
+
+    portENTER_CRITICAL(&_lock);
+    _tx_ring_held -= run;
+    portEXIT_CRITICAL(&_lock);
+    if (wait) flush.outstanding++;
+    first += run;
+  }
+
+  if (!wait) return queued;
+
+  while (flush.outstanding){
+    process();
+    if (!flush.outstanding) break;
+    vTaskDelay(1);
+  }
+  return queued && !flush.failed;
+}
+
+bool xy6020l::write_in_flight(uint8_t reg){
+  bool found = false;
+  portENTER_CRITICAL(&_lock);
+  for (uint8_t pos = 0; pos < _txn_count && !found; pos++){
+    const tTransaction &txn = _txn_queue[(_txn_head + pos) % TXN_QUEUE_SIZE];
+    found = txn.funcCode != FUNC_CODE_READ_HOLD_REG && reg >= txn.startReg && reg < txn.startReg + txn.count;
+  }
+  portEXIT_CRITICAL(&_lock);
+  return found;
+}
+
+int8_t xy6020l::add_poll_group(uint8_t start_reg, uint8_t count, uint16_t period_ms){
+  if (count == 0 || start_reg + count > 30) return -1;
+  if (_poll_group_count >= POLL_GROUP_MAX) return -1;
+
+  tPollGroup &group = _poll_groups[_poll_group_count];
+  group.startReg = start_reg;
+  group.count = count;
+  group.periodMs = period_ms;
+  group.lastMs = 0;
+  group.polled = false;
+  learn_poll_frame(start_reg, count);
+  return _poll_group_count++;
+}
+
+void xy6020l::use_default_poll_plan(){
+  clear_poll_groups();
+  add_poll_group(HREG_IDX_ACT_V, 3, 50);                  // actual V/I/P
+  add_poll_group(HREG_IDX_PROTECT, 3, 50);                // protection, CV/CC, output state
+  add_poll_group(HREG_IDX_CV, 2, 1000);                   // setpoints
+  add_poll_group(HREG_IDX_IN_V, 10, 1000);                // input voltage, energy counters, on time, temperatures
+  add_poll_group(HREG_IDX_LOCK, 1, 1000);
+  add_poll_group(HREG_IDX_MEMORY, 1, 1000);
+  add_poll_group(HREG_IDX_FC, 9, POLL_ONCE);              // display settings, identity, temperature offsets
+}
+
+void xy6020l::poll_done(const tTxnResult &result, void *ctx){
+  xy6020l *self = (xy6020l *) ctx;
+  if (self->_poll_outstanding) self->_poll_outstanding--;
+  if (result.status != TXN_OK) self->retry_polls(result.startReg, result.count);
+}
+
+void xy6020l::retry_polls(uint16_t start_reg, uint16_t count){
+  // periodic groups come back with their period, one time groups would never be read again
+  for (uint8_t i = 0; i < _poll_group_count; i++){
+    tPollGroup &group = _poll_groups[i];
+    bool covered = group.startReg < start_reg + count && start_reg < group.startReg + group.count;
+    if (covered && group.periodMs == POLL_ONCE) group.polled = false;
+  }
+}
+
+void xy6020l::schedule_polls(uint32_t now){
+  // collect the due ranges ordered by start register
+  uint8_t starts[POLL_GROUP_MAX], ends[POLL_GROUP_MAX];
+  uint8_t due = 0;
+
+  for (uint8_t i = 0; i < _poll_group_count; i++){
+    tPollGroup &group = _poll_groups[i];
+    bool is_due = !group.polled || (group.periodMs != POLL_ONCE && now - group.lastMs >= group.periodMs);
+    if (!is_due) continue;
+
+    group.polled = true;
+    group.lastMs = now;
+
+    uint8_t pos = due++;
+    while (pos > 0 && starts[pos - 1] > group.startReg){
+      starts[pos] = starts[pos - 1];
+      ends[pos] = ends[pos - 1];
+      pos--;
+    }
+    starts[pos] = group.startReg;
+    ends[pos] = group.startReg + group.count;
+  }
+
+  // merge overlapping ranges and ones separated by a small gap into single reads
+  for (uint8_t i = 0; i < due;){
+    uint8_t start = starts[i];
+    uint8_t end = ends[i];
+    i++;
+    while (i < due && starts[i] <= end + POLL_MERGE_GAP){
+      if (ends[i] > end) end = ends[i];
+      i++;
+    }
+
+    learn_poll_frame(start, end - start);
+    if (submit_read(start, end - start, poll_done, this)) _poll_outstanding++;
+    else retry_polls(start, end - start);
+  }
+}
+
+void xy6020l::publish_snapshot(uint32_t stamp){
+  tSnapshot snapshot;
+  for (uint8_t reg = 0; reg < 30; reg++){
+    snapshot.regs[reg] = (all_hold_reg_data[reg * 2] << 8) | all_hold_reg_data[(reg * 2) + 1];
+  }
+  snapshot.timestampMs = stamp;
+  snapshot.seq = 0;
+  _snapshot.publish(snapshot);
+}
+
+bool xy6020l::set_address(uint16_t value){
+  if (value == 0 || value > 247) return false;
+  if (!flush_writes(true) || !write_a_single_register(HREG_IDX_SLAVE_ADD, value)) return false;
+
+  // the reply still came from the old address, everything after goes to the new one
+  _slave_address = value;
+  rebuild_frames();
+  return true;
+}
+
+bool xy6020l::set_target_address(uint8_t addr){
+  if (addr == 0 || addr > 247 || !is_idle()) return false;
+  _slave_address = addr;
+  rebuild_frames();
+  return true;
+}
+
+bool xy6020l::get_all_hold_regs(){
+  // the completion handler copies the payload into all_hold_reg_data
+  return read_hold_register_data(HREG_IDX_CV, 30);
+}
+
+void xy6020l::cache_preset_data(uint16_t start_reg, uint16_t count, const uint8_t *data, bool acknowledged_write){
+  portENTER_CRITICAL(&_lock);
+  for (uint8_t num = 0; num < PRESET_COUNT; num++){
+    uint16_t base = HREG_IDX_M0 + (num * HREG_IDX_M_OFFSET);
+    if (start_reg >= base + MEM_REGS || start_reg + count <= base) continue;
+
+    if (acknowledged_write){
+      // keep a loaded copy in step with what the device accepted
+      if (!(_preset_valid & (1 << num))) continue;
+      for (uint16_t reg = start_reg; reg < start_reg + count; reg++){
+        if (reg < base || reg >= base + MEM_REGS) continue;
+        memcpy(&_preset_words[num][(reg - base) * 2], &data[(reg - start_reg) * 2], 2);
+      }
+    } else {
+      // a read covering the whole preset loads it, a partial one refreshes a loaded copy;
+      // staged registers keep their new value
+      bool whole = start_reg <= base && start_reg + count >= base + MEM_REGS;
+      if (!whole && !(_preset_valid & (1 << num))) continue;
+      for (uint16_t reg = start_reg; reg < start_reg + count; reg++){
+        if (reg < base || reg >= base + MEM_REGS || (_preset_dirty[num] & (1 << (reg - base)))) continue;
+        memcpy(&_preset_words[num][(reg - base) * 2], &data[(reg - start_reg) * 2], 2);
+      }
+      if (whole) _preset_valid |= 1 << num;
     }
-    return crc;
+  }
+  portEXIT_CRITICAL(&_lock);
 }
 
 bool xy6020l::fetch_preset(tMemory &presetStruct){
-  if (presetStruct.num >= 10) return false;
+  if (presetStruct.num >= PRESET_COUNT) return false;
+
+  uint8_t data_buf[MEM_REGS * 2];
+  portENTER_CRITICAL(&_lock);
+  bool cached = _preset_valid & (1 << presetStruct.num);
+  if (cached) memcpy(data_buf, _preset_words[presetStruct.num], sizeof(data_buf));
+  portEXIT_CRITICAL(&_lock);
+
+  if (cached){
+    _preset_bytes_saved += PRESET_READ_BYTES;
+  } else {
+    uint16_t start_address = HREG_IDX_M0 + (presetStruct.num * HREG_IDX_M_OFFSET);
+    if (!read_hold_register_data(start_address, MEM_REGS, data_buf)) return false;
+
+    // the completion handler filled the cache, staged registers included
+    portENTER_CRITICAL(&_lock);
+    memcpy(data_buf, _preset_words[presetStruct.num], sizeof(data_buf));
+    portEXIT_CRITICAL(&_lock);
+  }
 
-  uint16_t start_address = HREG_IDX_M0 + (presetStruct.num * HREG_IDX_M_OFFSET);
+  regmap_decode(XY_MEM_REG_MAP, data_buf, 0, MEM_REGS, presetStruct);
+  return true;
+}
 
-  bool response = read_hold_register_data(start_address, MEM_REGS);
+bool xy6020l::load_presets(){
+  // presets are HREG_IDX_M_OFFSET apart, one 30 register read covers two of them
+  bool ok = true;
+  for (uint8_t num = 0; num < PRESET_COUNT; num += 2){
+    uint16_t start_address = HREG_IDX_M0 + (num * HREG_IDX_M_OFFSET);
+    uint16_t count = num + 1 < PRESET_COUNT ? HREG_IDX_M_OFFSET + MEM_REGS : MEM_REGS;
+    if (!read_hold_register_data(start_address, count)) ok = false;
+  }
+  return ok;
+}
 
-  if(!response) return response;
+void xy6020l::invalidate_presets(uint8_t num){
+  portENTER_CRITICAL(&_lock);
+  for (uint8_t i = 0; i < PRESET_COUNT; i++){
+    if (num != PRESET_ALL && num != i) continue;
+    _preset_valid &= ~(1 << i);
+    _preset_dirty[i] = 0;
+  }
+  portEXIT_CRITICAL(&_lock);
+}
 
-  presetStruct.VSet = (response_temp_buf[3] << 8) | response_temp_buf[4];
-  presetStruct.ISet = (response_temp_buf[5] << 8) | response_temp_buf[6];
-  presetStruct.sLVP = (response_temp_buf[7] << 8) | response_temp_buf[8];
-  presetStruct.sOVP = (response_temp_buf[9] << 8) | response_temp_buf[10];
-  presetStruct.sOCP = (response_temp_buf[11] << 8) | response_temp_buf[12];
-  presetStruct.sOPP = (response_temp_buf[13] << 8) | response_temp_buf[14];
-  presetStruct.sOHPh = (response_temp_buf[15] << 8) | response_temp_buf[16];
-  presetStruct.sOHPm = (response_temp_buf[17] << 8) | response_temp_buf[18];
+bool xy6020l::restore_preset(uint8_t num, const uint8_t *words){
+  if (num >= PRESET_COUNT) return false;
+  portENTER_CRITICAL(&_lock);
+  memcpy(_preset_words[num], words, MEM_REGS * 2);
+  _preset_valid |= 1 << num;
+  _preset_dirty[num] = 0;
+  portEXIT_CRITICAL(&_lock);
+  return true;
+}
 
-  uint16_t sOAH_low = (response_temp_buf[19] << 8) | response_temp_buf[20];
-  uint16_t sOAH_high = (response_temp_buf[21] << 8) | response_temp_buf[22];
-  presetStruct.sOAH = ((uint32_t)sOAH_high << 16) | sOAH_low;
+bool xy6020l::get_preset_words(uint8_t num, uint8_t *words){
+  if (num >= PRESET_COUNT) return false;
+  portENTER_CRITICAL(&_lock);
+  bool clean = (_preset_valid & (1 << num)) && !_preset_dirty[num];
+  if (clean) memcpy(words, _preset_words[num], MEM_REGS * 2);
+  portEXIT_CRITICAL(&_lock);
+  return clean;
+}
 
-  uint16_t sOWH_low = (response_temp_buf[23] << 8) | response_temp_buf[24];
-  uint16_t sOWH_high = (response_temp_buf[25] << 8) | response_temp_buf[26];
-  presetStruct.sOWH = ((uint32_t)sOWH_high << 16) | sOWH_low;
+bool xy6020l::stage_preset(const tMemory &presetStruct){
+  if (presetStruct.num >= PRESET_COUNT) return false;
 
-  presetStruct.sOTP = (response_temp_buf[27] << 8) | response_temp_buf[28];
-  presetStruct.sINI = (response_temp_buf[29] << 8) | response_temp_buf[30];
+  uint8_t data_buf[MEM_REGS * 2];
+  regmap_encode(XY_MEM_REG_MAP, presetStruct, data_buf);
 
+  portENTER_CRITICAL(&_lock);
+  uint8_t *words = _preset_words[presetStruct.num];
+  bool cached = _preset_valid & (1 << presetStruct.num);
+  for (uint8_t reg = 0; reg < MEM_REGS; reg++){
+    if (cached && memcmp(&words[reg * 2], &data_buf[reg * 2], 2) == 0) continue;
+    _preset_dirty[presetStruct.num] |= 1 << reg;
+  }
+  // every register is known now, uncommitted ones are marked
+  memcpy(words, data_buf, sizeof(data_buf));
+  _preset_valid |= 1 << presetStruct.num;
+  portEXIT_CRITICAL(&_lock);
   return true;
 }
 
-bool xy6020l::set_preset(tMemory &preset){
-  if (preset.num >= 10) return false;
-  uint16_t start_address = HREG_IDX_M0 + (preset.num * HREG_IDX_M_OFFSET);
-
-  uint8_t temp_data_buf[MEM_REGS * 2] = {
-                                      preset.VSet >> 8,
-                                      preset.VSet & 0xFF,
-                                      preset.ISet >> 8,
-                                      preset.ISet & 0xFF,
-                                      preset.sLVP >> 8,
-                                      preset.sLVP & 0xFF,
-                                      preset.sOVP >> 8,
-                                      preset.sOVP & 0xFF,
-                                      preset.sOCP >> 8,
-                                      preset.sOCP & 0xFF,
-                                      preset.sOPP >> 8,
-                                      preset.sOPP & 0xFF,
-                                      preset.sOHPh >> 8,
-                                      preset.sOHPh & 0xFF,
-                                      preset.sOHPm >> 8,
-                                      preset.sOHPm & 0xFF,
-                                      (preset.sOAH & 0xFFFF) >> 8,  //low 16 bytes
-                                      (preset.sOAH & 0xFFFF) & 0xFF,
-                                      (preset.sOAH >> 16) >> 8,     //upper 16 bytes
-                                      (preset.sOAH >> 16) & 0xFF,
-                                      (preset.sOWH & 0xFFFF) >> 8,
-                                      (preset.sOWH & 0xFFFF) & 0xFF,
-                                      (preset.sOWH >> 16) >> 8,
-                                      (preset.sOWH >> 16) & 0xFF,
-                                      preset.sOTP >> 8,
-                                      preset.sOTP & 0xFF,
-                                      preset.sINI >> 8,
-                                      preset.sINI & 0xFF
-
-  };
-
-  bool response = write_multiple_registers(start_address, MEM_REGS, MEM_REGS * 2, temp_data_buf);
-
-  if(!response) return response;
+bool xy6020l::stage_preset_register(uint8_t num, uint8_t mem_reg, uint16_t value){
+  if (num >= PRESET_COUNT || mem_reg >= MEM_REGS) return false;
 
+  portENTER_CRITICAL(&_lock);
+  uint8_t *word = &_preset_words[num][mem_reg * 2];
+  if (!(_preset_valid & (1 << num)) || ((word[0] << 8) | word[1]) != value){
+    word[0] = value >> 8;
+    word[1] = value & 0xFF;
+    _preset_dirty[num] |= 1 << mem_reg;
+  }
+  portEXIT_CRITICAL(&_lock);
   return true;
+}
+
+bool xy6020l::commit_presets(){
+  bool ok = true;
+  for (uint8_t num = 0; num < PRESET_COUNT; num++){
+    if (_preset_dirty[num] && !commit_preset(num)) ok = false;
+  }
+  return ok;
+}
+
+bool xy6020l::commit_preset(uint8_t num){
+  uint8_t words[MEM_REGS * 2];
+  portENTER_CRITICAL(&_lock);
+  uint16_t dirty = _preset_dirty[num];
+  bool cached = _preset_valid & (1 << num);
+  memcpy(words, _preset_words[num], sizeof(words));
+  portEXIT_CRITICAL(&_lock);
+
+  // group the changed registers into runs, bridging short gaps of known values
+  uint8_t run_start[MEM_REGS], run_end[MEM_REGS];
+  uint8_t runs = 0;
+  uint16_t bytes = 0;
+  for (uint8_t reg = 0; reg < MEM_REGS; reg++){
+    if (!(dirty & (1 << reg))) continue;
+    if (runs && cached && reg - run_end[runs - 1] <= PRESET_MERGE_GAP){
+      run_end[runs - 1] = reg + 1;
+    } else if (runs && run_end[runs - 1] == reg){
+      run_end[runs - 1] = reg + 1;
+    } else {
+      run_start[runs] = reg;
+      run_end[runs] = reg + 1;
+      runs++;
+    }
+  }
+  for (uint8_t i = 0; i < runs; i++){
+    uint8_t count = run_end[i] - run_start[i];
+    bytes += (count == 1 ? 8 : 9 + (count * 2)) + 8;
+  }
+  if (cached && bytes > PRESET_FULL_WRITE_BYTES){
+    runs = 1;
+    run_start[0] = 0;
+    run_end[0] = MEM_REGS;
+    bytes = PRESET_FULL_WRITE_BYTES;
+  }
 
-}
\ No newline at end of file
+  uint16_t base = HREG_IDX_M0 + (num * HREG_IDX_M_OFFSET);
+  bool ok = true;
+  for (uint8_t i = 0; i < runs; i++){
+    uint8_t count = run_end[i] - run_start[i];
+    uint8_t *values = &words[run_start[i] * 2];
+    bool written = count == 1 ? write_a_single_register(base + run_start[i], (values[0] << 8) | values[1])
+                              : write_multiple_registers(base + run_start[i], count, count * 2, values);
+    if (!written){
+      ok = false;
+      continue;
+    }
+
+    // registers staged again while the write was in flight stay dirty
+    portENTER_CRITICAL(&_lock);
+    for (uint8_t reg = run_start[i]; reg < run_end[i]; reg++){
+      if (memcmp(&_preset_words[num][reg * 2], &words[reg * 2], 2) == 0) _preset_dirty[num] &= ~(1 << reg);
+    }
+    portEXIT_CRITICAL(&_lock);
+  }
+
+  _preset_bytes_written += bytes;
+  if (bytes < PRESET_FULL_WRITE_BYTES) _preset_bytes_saved += PRESET_FULL_WRITE_BYTES - bytes;
+  return ok;
+}
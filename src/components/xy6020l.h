@@ -25,6 +25,11 @@
 #define xy6020l_h
 
 #include "Arduino.h"
+#include "crc16.h"
+#include "seqlock.h"
+#include "xy_regmap.h"
+#include "xy_metrics.h"
+#include "xy_frames.h"
 
 // the XY6020 provides 31 holding registers
 #define HOLD_REGS 31
@@ -70,6 +75,10 @@
 #define HREG_IDX_SLAVE_ADD        0x18
 #define HREG_IDX_BAUDRATE         0x19
 
+// values of HREG_IDX_BAUDRATE, index is the code
+#define BAUD_CODE_COUNT           9
+inline constexpr uint32_t XY_BAUD_RATES[BAUD_CODE_COUNT] = {9600, 14400, 19200, 38400, 56000, 57600, 115200, 2400, 4800};
+
 //temperature offset
 #define HREG_IDX_TEMP_OFS         0x1A 
 #define HREG_IDX_TEMP_EXT_OFS     0x1B
@@ -95,7 +104,24 @@
 
 #define DEFAULT_SLAVE_ADDRESS     0x1
 
+// preset cache
+#define PRESET_COUNT        10
+#define PRESET_ALL          0xFF
+#define PRESET_MERGE_GAP    8   // another FC 0x10 costs 17 bytes plus t3.5, more than 8 unchanged registers
+#define PRESET_FULL_WRITE_BYTES   ((9 + (MEM_REGS * 2)) + 8)
+#define PRESET_READ_BYTES         (8 + (5 + (MEM_REGS * 2)))
+
 #define TX_RING_BUFFER_SIZE 16
+#define WRITE_FLUSH_DELAY_MS 10   // default time a queued setpoint waits for others to merge with
+
+// polling scheduler
+#define POLL_GROUP_MAX      8
+#define POLL_MERGE_GAP      6   // a second request/reply costs 13 bytes of headers, about 6 registers
+#define POLL_ONCE           0   // group period for registers read a single time
+
+// request frame cache, open addressing on (start register, count)
+#define FRAME_CACHE_SIZE    64  // power of two, kept at most half full
+#define FRAME_CACHE_POLL    12  // slots for poll group ranges and their merges
 
 #define FUNC_CODE_READ_HOLD_REG               0x3
 #define FUNC_CODE_WRITE_SINGLE_HOLD_REG       0x06
@@ -114,13 +140,112 @@ enum XY6020L_EXCEPTIONS{
     GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND
 };
 
-enum RxState { IDLE, RECEIVING, COMPLETE };
+// SENDING: the head transaction is being written, it no longer moves or changes
+enum RxState { IDLE, SENDING, RECEIVING, COMPLETE };
+
+// transaction engine
+#define TXN_QUEUE_SIZE      8   // one slot is kept free for the output trip frame
+#define TXN_FLAG_URGENT     0x01  // retried until acknowledged, see trip_output()
+#define TXN_FLAG_PRIORITY   0x02  // read queued ahead of plain reads, like a write
+#define TXN_FLAG_PREBUILT   0x04  // txFrame already carries its CRC
+#define MAX_TX_FRAME_SIZE   37  // 9 header/crc bytes + 14 registers
+#define MAX_RX_FRAME_SIZE   65  // 5 header/crc bytes + 30 registers
+
+// RTU timing, see the Modbus over serial line specification 2.5.1.1
+#define RTU_BITS_PER_CHAR       10        // 8N1
+#define RTU_FIXED_T15_US        750       // above 19200 baud t1.5 and t3.5 are fixed
+#define RTU_FIXED_T35_US        1750
+#define RTU_SILENCE_SLACK_US    1000      // UART drivers hand bytes over in bursts, not one by one
+#define RTO_INITIAL_US          40000     // reply deadline until the first round trip was measured
+#define RTO_MIN_US              5000      // one scheduler tick of jitter on top of the turnaround
+#define RTO_MAX_US              250000
+
+enum TxnStatus {
+    TXN_PENDING,
+    TXN_OK,
+    TXN_TIMEOUT,      // no reply before the deadline expired
+    TXN_SHORT_FRAME,  // reply ended (inter-frame silence) before the expected length
+    TXN_CRC_ERROR,
+    TXN_EXCEPTION,    // slave answered with an exception frame, see exception field
+    TXN_TX_ERROR,     // the stream did not accept the whole request
+    TXN_BAD_FRAME     // reply does not match the request (address, function, length)
+};
+
+/**
+ * @brief Outcome of a transaction handed to the completion callback
+ * data points to the register payload (big endian words) and is only valid inside the callback.
+ */
+typedef struct {
+    TxnStatus status;
+    uint8_t funcCode;
+    uint16_t startReg;
+    uint16_t count;
+    uint8_t exception;
+    const uint8_t *data;
+    uint8_t dataLen;
+    uint32_t latencyUs;
+} tTxnResult;
+
+typedef void (*TxnCallback)(const tTxnResult &result, void *ctx);
+
+typedef struct {
+    uint8_t txFrame[MAX_TX_FRAME_SIZE];
+    uint8_t txLen;
+    uint8_t expectedRxBytes;
+    uint8_t funcCode;
+    uint16_t startReg;
+    uint16_t count;
+    uint8_t flags;
+    TxnCallback callback;
+    void *ctx;
+} tTransaction;
+
+/**
+ * @brief Length of the whole reply to txn, judged from its first rx_len bytes
+ * An exception reply is 5 bytes, a read as long as its byte count says but never longer than requested,
+ * so a reply that lies about its length ends early and fails check_reply() instead of running into the deadline.
+ */
+uint8_t reply_length(const tTransaction &txn, const uint8_t *rx, uint8_t rx_len);
+
+/**
+ * @brief Validates a received reply of len bytes against its request
+ * @param crc running CRC over all len bytes, 0 for an intact frame
+ */
+TxnStatus check_reply(const tTransaction &txn, const uint8_t *rx, uint8_t len, uint16_t crc);
 
 typedef struct {
   uint8_t mHregIdx;
   uint16_t mValue;
 } txRingEle;
 
+typedef struct {
+    uint16_t startReg;      // 0 marks a free slot, together with count
+    uint16_t count;
+    tRequestFrame frame;
+} tFrameCacheEntry;
+
+typedef struct {
+    uint8_t startReg;
+    uint8_t count;
+    uint16_t periodMs;
+    uint32_t lastMs;
+    bool polled;
+} tPollGroup;
+
+/**
+ * @brief Consistent copy of the holding registers as published after a reply
+ * Words are in host order, indexed by HREG_IDX_*.
+ */
+typedef struct {
+    uint16_t regs[30];
+    uint32_t timestampMs;   // millis() when the reply completing this copy arrived
+    uint32_t seq;           // increases with every published reply
+} tSnapshot;
+
+inline uint32_t snapshot_u32(const tSnapshot &snapshot, uint8_t low_reg){
+  return ((uint32_t) snapshot.regs[low_reg + 1] << 16) | snapshot.regs[low_reg];
+}
+
 typedef struct {
     uint8_t num;
     uint16_t VSet;
@@ -137,6 +262,135 @@ typedef struct {
     uint16_t sINI;
 } tMemory;
 
+/**
+ * @brief Holding registers decoded into raw integer values, see XY_HOLD_REG_MAP for units
+ */
+typedef struct {
+    uint16_t setVolt;
+    uint16_t setCurrent;
+    uint16_t actVolt;
+    uint16_t actCurrent;
+    uint16_t actPower;
+    uint16_t inVolt;
+    uint32_t outCharge;
+    uint32_t outEnergy;
+    uint16_t onHour;
+    uint16_t onMin;
+    uint16_t onSec;
+    uint16_t tempInternal;
+    uint16_t tempExternal;
+    uint16_t lock;
+    uint16_t protect;
+    uint16_t cvcc;
+    uint16_t outputOn;
+    uint16_t tempSymbol;
+    uint16_t backlight;
+    uint16_t sleepTime;
+    uint16_t model;
+    uint16_t version;
+    uint16_t slaveAddress;
+    uint16_t baudCode;
+    uint16_t tempOffset;
+    uint16_t tempExtOffset;
+    uint16_t memory;
+} tTelemetry;
+
+// holding register block HREG_IDX_CV..HREG_IDX_MEMORY
+inline constexpr tRegDesc XY_HOLD_REG_MAP[] = {
+  REG_DESC(tTelemetry, setVolt,       HREG_IDX_CV,            1, REG_RW, 100,  "V"),
+  REG_DESC(tTelemetry, setCurrent,    HREG_IDX_CC,            1, REG_RW, 100,  "A"),
+  REG_DESC(tTelemetry, actVolt,       HREG_IDX_ACT_V,         1, REG_RO, 100,  "V"),
+  REG_DESC(tTelemetry, actCurrent,    HREG_IDX_ACT_C,         1, REG_RO, 100,  "A"),
+  REG_DESC(tTelemetry, actPower,      HREG_IDX_ACT_P,         1, REG_RO, 10,   "W"),
+  REG_DESC(tTelemetry, inVolt,        HREG_IDX_IN_V,          1, REG_RO, 100,  "V"),
+  REG_DESC(tTelemetry, outCharge,     HREG_IDX_OUT_CHRG,      2, REG_RO, 1000, "Ah"),
+  REG_DESC(tTelemetry, outEnergy,     HREG_IDX_OUT_ENERGY,    2, REG_RO, 1000, "Wh"),
+  REG_DESC(tTelemetry, onHour,        HREG_IDX_ON_HOUR,       1, REG_RO, 1,    "h"),
+  REG_DESC(tTelemetry, onMin,         HREG_IDX_ON_MIN,        1, REG_RO, 1,    "min"),
+  REG_DESC(tTelemetry, onSec,         HREG_IDX_ON_SEC,        1, REG_RO, 1,    "s"),
+  REG_DESC(tTelemetry, tempInternal,  HREG_IDX_TEMP,          1, REG_RO, 10,   "deg"),
+  REG_DESC(tTelemetry, tempExternal,  HREG_IDX_TEMP_EXD,      1, REG_RO, 10,   "deg"),
+  REG_DESC(tTelemetry, lock,          HREG_IDX_LOCK,          1, REG_RW, 1,    ""),
+  REG_DESC(tTelemetry, protect,       HREG_IDX_PROTECT,       1, REG_RW, 1,    ""),
+  REG_DESC(tTelemetry, cvcc,          HREG_IDX_CVCC,          1, REG_RO, 1,    ""),
+  REG_DESC(tTelemetry, outputOn,      HREG_IDX_OUTPUT_ON,     1, REG_RW, 1,    ""),
+  REG_DESC(tTelemetry, tempSymbol,    HREG_IDX_FC,            1, REG_RW, 1,    ""),
+  REG_DESC(tTelemetry, backlight,     HREG_IDX_BB,            1, REG_RW, 1,    ""),
+  REG_DESC(tTelemetry, sleepTime,     HREG_IDX_SLEEP,         1, REG_RW, 1,    "min"),
+  REG_DESC(tTelemetry, model,         HREG_IDX_MODEL,         1, REG_RO, 1,    ""),
+  REG_DESC(tTelemetry, version,       HREG_IDX_VERSION,       1, REG_RO, 1,    ""),
+  REG_DESC(tTelemetry, slaveAddress,  HREG_IDX_SLAVE_ADD,     1, REG_RW, 1,    ""),
+  REG_DESC(tTelemetry, baudCode,      HREG_IDX_BAUDRATE,      1, REG_RW, 1,    ""),
+  REG_DESC(tTelemetry, tempOffset,    HREG_IDX_TEMP_OFS,      1, REG_RW, 10,   "deg"),
+  REG_DESC(tTelemetry, tempExtOffset, HREG_IDX_TEMP_EXT_OFS,  1, REG_RW, 10,   "deg"),
+  REG_DESC(tTelemetry, memory,        HREG_IDX_MEMORY,        1, REG_RW, 1,    ""),
+};
+static_assert(regmap_valid<tTelemetry>(XY_HOLD_REG_MAP, 30), "holding register map does not match tTelemetry");
+
+// one preset, registers relative to HREG_IDX_M0 + num * HREG_IDX_M_OFFSET
+inline constexpr tRegDesc XY_MEM_REG_MAP[] = {
+  REG_DESC(tMemory, VSet,   HREG_IDX_M_VSET,   1, REG_RW, 100,  "V"),
+  REG_DESC(tMemory, ISet,   HREG_IDX_M_ISET,   1, REG_RW, 100,  "A"),
+  REG_DESC(tMemory, sLVP,   HREG_IDX_M_SLVP,   1, REG_RW, 100,  "V"),
+  REG_DESC(tMemory, sOVP,   HREG_IDX_M_SOVP,   1, REG_RW, 100,  "V"),
+  REG_DESC(tMemory, sOCP,   HREG_IDX_M_SOCP,   1, REG_RW, 100,  "A"),
+  REG_DESC(tMemory, sOPP,   HREG_IDX_M_SOPP,   1, REG_RW, 10,   "W"),
+  REG_DESC(tMemory, sOHPh,  HREG_IDX_M_SOHPH,  1, REG_RW, 1,    "h"),
+  REG_DESC(tMemory, sOHPm,  HREG_IDX_M_SOHPM,  1, REG_RW, 1,    "min"),
+  REG_DESC(tMemory, sOAH,   HREG_IDX_M_SOAHL,  2, REG_RW, 1000, "Ah"),
+  REG_DESC(tMemory, sOWH,   HREG_IDX_M_SOWHL,  2, REG_RW, 1000, "Wh"),
+  REG_DESC(tMemory, sOTP,   HREG_IDX_M_SOTP,   1, REG_RW, 10,   "deg"),
+  REG_DESC(tMemory, sINI,   HREG_IDX_M_SINI,   1, REG_RW, 1,    ""),
+};
+static_assert(regmap_valid<tMemory>(XY_MEM_REG_MAP, MEM_REGS), "memory register map does not match tMemory");
+
+typedef struct {
+    uint16_t startReg;
+    uint16_t count;
+} tReadRange;
+
+/**
+ * @brief Reads the driver issues with fixed ranges: get_all_hold_regs, the actual
+ * values, fetch_preset of each preset and the five reads of load_presets
+ */
+#define XY_FIXED_READ_COUNT   (2 + PRESET_COUNT + (PRESET_COUNT / 2))
+static_assert(XY_FIXED_READ_COUNT + FRAME_CACHE_POLL <= FRAME_CACHE_SIZE / 2, "frame cache too small");
+
+typedef struct { tReadRange range[XY_FIXED_READ_COUNT]; } tFixedReads;
+typedef struct { tRequestFrame frame[XY_FIXED_READ_COUNT]; } tFixedFrames;
+
+constexpr tFixedReads make_fixed_reads(){
+  tFixedReads reads = {};
+  uint8_t i = 0;
+  reads.range[i++] = {HREG_IDX_CV, 30};
+  reads.range[i++] = {HREG_IDX_ACT_V, 3};
+  for (uint8_t num = 0; num < PRESET_COUNT; num++) reads.range[i++] = {(uint16_t)(HREG_IDX_M0 + (num * HREG_IDX_M_OFFSET)), MEM_REGS};
+  for (uint8_t num = 0; num < PRESET_COUNT; num += 2){
+    reads.range[i++] = {(uint16_t)(HREG_IDX_M0 + (num * HREG_IDX_M_OFFSET)), (uint16_t)(num + 1 < PRESET_COUNT ? HREG_IDX_M_OFFSET + MEM_REGS : MEM_REGS)};
+  }
+  return reads;
+}
+
+constexpr tFixedFrames make_fixed_frames(uint8_t addr, const tFixedReads &reads){
+  tFixedFrames frames = {};
+  for (uint8_t i = 0; i < XY_FIXED_READ_COUNT; i++) frames.frame[i] = make_read_frame(addr, reads.range[i].startReg, reads.range[i].count);
+  return frames;
+}
+
+inline constexpr tFixedReads XY_FIXED_READS = make_fixed_reads();
+// complete frames for a device at the default address, nothing left to compute at runtime
+inline constexpr tFixedFrames XY_DEFAULT_FRAMES = make_fixed_frames(DEFAULT_SLAVE_ADDRESS, XY_FIXED_READS);
+inline constexpr tRequestFrame XY_DEFAULT_TRIP_FRAME = make_write_single_frame(DEFAULT_SLAVE_ADDRESS, HREG_IDX_OUTPUT_ON, 0);
+
+static_assert(request_frame_intact(XY_DEFAULT_FRAMES.frame[0]) && request_frame_intact(XY_DEFAULT_TRIP_FRAME), "request frame crc mismatch");
+static_assert(XY_DEFAULT_FRAMES.frame[0].bytes[6] == 0xC5 && XY_DEFAULT_FRAMES.frame[0].bytes[7] == 0xC2, "read of all holding registers has the wrong crc");
+
+
+class xy_bus;
+class xy_history;
+class xy_watch;
+class xy_stream;
+class xy_capture;
 
 /**
  * @class xy6020l
@@ -153,93 +407,448 @@ class xy6020l
      */
     xy6020l(Stream *serial, uint8_t addr=1) : serialHandle(serial), _slave_address(addr)
     {
+      set_link_baud(115200);
+      rebuild_frames();
+    }
 
+    /**
+     * @brief Sets the link timing, call with the baud rate the serial port was opened with
+     */
+    void begin(uint32_t baud = 115200){
+      set_link_baud(baud);
     }
 
-    void begin(){
+    /**
+     * @brief Derives character time, t1.5 and t3.5 from the baud rate
+     * Call it again whenever the serial port is switched to another rate.
+     */
+    void set_link_baud(uint32_t baud);
+
+    uint32_t get_link_baud(){return _link_baud;}
+    uint32_t get_char_time_us(){return _char_time_us;}
+    uint32_t get_t15_us(){return _t15_us;}
+    uint32_t get_t35_us(){return _t35_us;}
+
+    /**
+     * @brief Silence kept between the end of a reply and the next request, t3.5 by default
+     * Slaves that resynchronise faster can be polled with a shorter gap, set_link_baud restores t3.5.
+     */
+    void set_inter_frame_gap_us(uint32_t gap_us){_frame_gap_us = gap_us;}
+    uint32_t get_inter_frame_gap_us(){return _frame_gap_us;}
+
+    /**
+     * @brief Smoothed turnaround time of the slave (request sent to first reply byte) and its variation
+     * Estimated like a TCP retransmission timer (RFC 6298), 0 until the first reply was measured.
+     */
+    uint32_t get_srtt_us(){return _srtt_us;}
+    uint32_t get_rttvar_us(){return _rttvar_us;}
+
+    /**
+     * @brief Current turnaround allowance
+     * The first reply byte is due within the request wire time plus rto and t3.5; the rest of the
+     * reply is then bounded by inter-byte silence.
+     */
+    uint32_t get_rto_us(){return _rto_us;}
+    /**
+     * @brief Overrides the turnaround allowance until the next reply is measured, i.e. short probes of absent slaves
+     */
+    void set_rto_us(uint32_t rto_us){_rto_us = rto_us < RTO_MIN_US ? RTO_MIN_US : (rto_us > RTO_MAX_US ? RTO_MAX_US : rto_us);}
 
+    /**
+     * @brief Time a transaction of the given sizes may take at most on an undisturbed link
+     */
+    uint32_t get_reply_timeout_us(uint8_t tx_bytes, uint8_t rx_bytes){
+      return ((tx_bytes + rx_bytes) * _char_time_us) + _rto_us + _t35_us;
     }
-      uint16_t get_set_volt(){return (uint16_t) (all_hold_reg_data[HREG_IDX_CV*2] << 8) | (all_hold_reg_data[(HREG_IDX_CV * 2) + 1]);}
-      uint16_t get_set_current(){return (uint16_t) (all_hold_reg_data[HREG_IDX_CC *2] << 8) | (all_hold_reg_data[(HREG_IDX_CC * 2) + 1]);}
-      uint16_t get_actual_volt(){return (uint16_t) (all_hold_reg_data[HREG_IDX_ACT_V * 2] << 8) | (all_hold_reg_data[(HREG_IDX_ACT_V * 2) + 1]);}
-      uint16_t get_actual_current(){return (uint16_t) (all_hold_reg_data[HREG_IDX_ACT_C * 2] << 8) | (all_hold_reg_data[(HREG_IDX_ACT_C * 2) + 1]);}
-      uint16_t get_power(){return (uint16_t) (all_hold_reg_data[HREG_IDX_ACT_P * 2] << 8) | (all_hold_reg_data[(HREG_IDX_ACT_P * 2) + 1]);}
-      uint16_t get_input_volt(){return (uint16_t) (all_hold_reg_data[HREG_IDX_IN_V * 2] << 8) | (all_hold_reg_data[(HREG_IDX_IN_V * 2) + 1]);}
-
-      uint32_t get_amp_hour(){
-        uint16_t ah_low = (uint16_t) (all_hold_reg_data[HREG_IDX_OUT_CHRG * 2] << 8) | (all_hold_reg_data[(HREG_IDX_OUT_CHRG * 2) + 1]);
-        uint16_t ah_high = (uint16_t) (all_hold_reg_data[HREG_IDX_OUT_CHRG_HIGH * 2] << 8) | (all_hold_reg_data[(HREG_IDX_OUT_CHRG_HIGH * 2) + 1]);
-        return (uint32_t) (ah_high << 16) | ah_low;
-      }
-
-      uint32_t get_watt_hour(){
-        uint16_t ah_low = (uint16_t) (all_hold_reg_data[HREG_IDX_OUT_ENERGY * 2] << 8) | (all_hold_reg_data[(HREG_IDX_OUT_ENERGY * 2) + 1]);
-        uint16_t ah_high = (uint16_t) (all_hold_reg_data[HREG_IDX_OUT_ENERGY_HIGH * 2] << 8) | (all_hold_reg_data[(HREG_IDX_OUT_ENERGY_HIGH * 2) + 1]);
-        return (uint32_t) (ah_high << 16) | ah_low;
-      }
-
-      uint16_t get_output_hour(){return (uint16_t) (all_hold_reg_data[HREG_IDX_ON_HOUR * 2] << 8) | (all_hold_reg_data[(HREG_IDX_ON_HOUR * 2) + 1]);}
-      uint16_t get_output_min(){return (uint16_t) (all_hold_reg_data[HREG_IDX_ON_MIN * 2] << 8) | (all_hold_reg_data[(HREG_IDX_ON_MIN * 2) + 1]);}
-      uint16_t get_output_sec(){return (uint16_t) (all_hold_reg_data[HREG_IDX_ON_SEC * 2] << 8) | (all_hold_reg_data[(HREG_IDX_ON_SEC * 2) + 1]);}
-
-      uint16_t get_internal_temp(){return (uint16_t) (all_hold_reg_data[HREG_IDX_TEMP * 2] << 8) | (all_hold_reg_data[(HREG_IDX_TEMP * 2) + 1]);}
-      uint16_t get_external_temp(){return (uint16_t) (all_hold_reg_data[HREG_IDX_TEMP_EXD * 2] << 8) | (all_hold_reg_data[(HREG_IDX_TEMP_EXD * 2) + 1]);}
-
-      bool get_lock_state(){return (bool) all_hold_reg_data[(HREG_IDX_LOCK * 2) + 1];}
-      bool get_protect_state(){return (bool) all_hold_reg_data[(HREG_IDX_PROTECT * 2) + 1];}
-      bool get_constant_state(){return (bool) all_hold_reg_data[(HREG_IDX_CVCC * 2) + 1];}
-      bool get_switch_state(){return (bool) all_hold_reg_data[(HREG_IDX_OUTPUT_ON * 2) + 1];} 
-      bool get_temp_symbol(){return (bool) all_hold_reg_data[(HREG_IDX_FC * 2) + 1];} 
-
-      uint8_t get_model(){return all_hold_reg_data[(HREG_IDX_MODEL * 2) + 1];}
-      uint8_t get_version(){return all_hold_reg_data[(HREG_IDX_VERSION * 2) + 1];}
-      uint8_t get_address(){return all_hold_reg_data[(HREG_IDX_SLAVE_ADD * 2) + 1];}
-      uint8_t get_baudrate(){return all_hold_reg_data[(HREG_IDX_BAUDRATE * 2) + 1];}
-
-      uint16_t get_internal_temp_offset(){return (uint16_t) (all_hold_reg_data[HREG_IDX_TEMP_OFS * 2] << 8) | (all_hold_reg_data[(HREG_IDX_TEMP_OFS * 2) + 1]);}
-      uint16_t get_external_temp_offset(){return (uint16_t) (all_hold_reg_data[HREG_IDX_TEMP_EXT_OFS * 2] << 8) | (all_hold_reg_data[(HREG_IDX_TEMP_EXT_OFS * 2) + 1]);}
-
-      uint8_t get_loaded_preset(){return all_hold_reg_data[(HREG_IDX_MEMORY * 2) + 1];}
 
+    /**
+     * @brief Queue a FC 0x03 read, the reply is delivered to callback from process()
+     * Reads starting at HREG_IDX_CV inside the holding register block also refresh the getter data.
+     * @return false if the request is invalid or the queue is full
+     */
+    bool submit_read(uint16_t start_reg, uint16_t count, TxnCallback callback = nullptr, void *ctx = nullptr);
+    /**
+     * @brief Read that overtakes queued plain reads (polling, bulk reads), for latency sensitive sampling
+     */
+    bool submit_priority_read(uint16_t start_reg, uint16_t count, TxnCallback callback = nullptr, void *ctx = nullptr);
+    bool submit_write_single(uint16_t reg_address, uint16_t value, TxnCallback callback = nullptr, void *ctx = nullptr);
+    bool submit_write_multiple(uint16_t start_reg, uint16_t count, const uint8_t *value_buf, TxnCallback callback = nullptr, void *ctx = nullptr);
+
+    /**
+     * @brief Drives the transaction state machine, never blocks
+     * Sends the next queued request as soon as the previous one completed, so call it as often as possible.
+     * A device attached to an xy_bus forwards this to the bus. Submitting and queueing writes is safe
+     * from any task; without a bus, process() itself belongs to a single task.
+     */
+    void process();
+
+    xy_bus *get_bus(){return _bus;}
+    uint8_t get_slave_address(){return _slave_address;}
+    /**
+     * @brief Talks to another slave from now on, nothing is written to the device (see set_address)
+     * Only while the transaction queue is empty.
+     */
+    bool set_target_address(uint8_t addr);
+
+    bool is_idle(){return _rx_state == IDLE && _txn_count == 0;}
+    RxState get_rx_state(){return _rx_state;}
+    uint8_t get_pending_transactions(){return _txn_count;}
+
+    /**
+     * @brief Completed transactions per second, measured over the last full second
+     */
+    uint32_t get_transactions_per_second(){return _txn_per_sec;}
+
+    /**
+     * @brief Reads sent from a ready frame of the cache vs. assembled and checksummed on the spot
+     */
+    uint32_t get_frame_cache_hits(){return _frame_hits;}
+    uint32_t get_frame_cache_misses(){return _frame_misses;}
+
+    /**
+     * @brief Switches the output off ahead of all queued traffic, never blocks
+     * The pre-built OUTPUT_ON = 0 frame goes out right after the transaction on the wire and is
+     * retried until acknowledged. Until release_output(), pending and new writes cannot switch the
+     * output back on: queued frames carrying OUTPUT_ON get it patched to 0, new ones are refused.
+     * @param callback called once the device acknowledged the frame
+     */
+    bool trip_output(TxnCallback callback = nullptr, void *ctx = nullptr);
+    void release_output(){_output_inhibit = false;}
+    bool is_output_inhibited(){return _output_inhibit;}
+
+    /**
+     * @brief Refresh all holding registers, blocks until the reply arrived
+     */
+    bool get_all_hold_regs();
+
+    /**
+     * @brief Queue a register write in the coalescing ring
+     * A pending write to the same register is replaced (last writer wins). Pending writes are sent
+     * when the flush delay expired or flush_writes() is called. Writes to OUTPUT_ON, LOCK, PROTECT
+     * and MEMORY keep their place in the submission order and are never merged or moved across;
+     * the plain writes between them go out in ascending register order, adjacent registers merged
+     * into one FC 0x10 frame.
+     * @return false for a read only holding register, for switching the output on after a trip,
+     * or if the ring is full and could not be flushed into the transaction queue
+     */
+    bool queue_write(uint8_t reg_address, uint16_t value);
+
+    /**
+     * @brief Turn all queued writes into transactions
+     * @param wait block until the slave acknowledged all of them
+     * @return false if a transaction could not be queued, or with wait, if one failed
+     */
+    bool flush_writes(bool wait = false);
+    /**
+     * @brief True while a write frame covering reg waits in the transaction queue or is on the wire
+     * Lets a periodic writer keep a single frame in flight and merge its values in the ring until then.
+     */
+    bool write_in_flight(uint8_t reg);
+
+    void set_write_flush_delay(uint16_t delay_ms){_write_flush_delay_ms = delay_ms;}
+
+    /**
+     * @brief Register a block of holding registers to be refreshed every period_ms from process()
+     * Due groups are merged into as few contiguous FC 0x03 reads as possible per tick.
+     * @param period_ms refresh period, POLL_ONCE reads the group a single time
+     * @return group index, -1 if the range is outside the holding registers or no slot is free
+     */
+    int8_t add_poll_group(uint8_t start_reg, uint8_t count, uint16_t period_ms);
+    void clear_poll_groups(){_poll_group_count = 0; rebuild_frames();}
+    void refresh_poll_group(uint8_t group){if (group < _poll_group_count) _poll_groups[group].polled = false;}
+
+    /**
+     * @brief Telemetry at 20 Hz, setpoints/energy/temperatures at 1 Hz, identity and settings once
+     */
+    void use_default_poll_plan();
+
+    void start_polling(){_polling = true;}
+    void stop_polling(){_polling = false;}
+    bool is_polling(){return _polling;}
+
+    /**
+     * @brief Copies the holding registers as of the latest reply, never blocks the task driving the bus
+     * Safe from any task on either core; unlike the getters, 32 bit values made of two registers
+     * always come from the same reply.
+     * @return false if no reply arrived yet
+     */
+    bool get_snapshot(tSnapshot &snapshot){
+      uint32_t seq = _snapshot.read(snapshot);
+      snapshot.seq = seq;
+      return seq != 0;
+    }
+    uint32_t get_snapshot_sequence(){return _snapshot.get_sequence();}
+
+    /**
+     * @brief Latency histograms per function code, outcome and exception counters, wire usage
+     * Lock free, callable from any task. Compiled out with XY6020L_NO_METRICS.
+     */
+    void get_metrics(tMetricsSnapshot &snapshot){_metrics.snapshot(snapshot);}
+    void reset_metrics(){_metrics.reset();}
+
+    /**
+     * @brief Outcome of the last completed transaction, tells why a blocking call returned false
+     */
+    TxnStatus get_last_status(){return _last_status;}
+    uint8_t get_last_exception(){return _last_exception;}
+
+    /**
+     * @brief Feed every read of the actual V/I/P into history, nullptr to stop
+     * Temperatures are sampled at the same time, with their last read value.
+     */
+    void set_history(xy_history *history){_history = history;}
+    xy_history *get_history(){return _history;}
+
+    /**
+     * @brief Hand every holding register frame (replies and acknowledged writes) to watch, nullptr to stop
+     */
+    void set_watch(xy_watch *watch){_watch = watch;}
+    xy_watch *get_watch(){return _watch;}
+
+    /**
+     * @brief Copy every holding register frame, and the raw bus frames if enabled there, to stream; nullptr to stop
+     */
+    void set_stream(xy_stream *stream){_stream = stream;}
+    xy_stream *get_stream(){return _stream;}
+
+    /**
+     * @brief Record every request, reply and stray byte sequence on the link into capture, nullptr to stop
+     */
+    void set_capture(xy_capture *capture){_capture = capture;}
+    xy_capture *get_capture(){return _capture;}
+
+    /**
+     * @brief millis() of the last reply that carried the register, 0 if it was never read
+     */
+    uint32_t get_reg_timestamp(uint8_t reg){return reg < 30 ? _reg_stamp_ms[reg] : 0;}
+    uint32_t get_reg_age(uint8_t reg){return get_reg_timestamp(reg) ? millis() - _reg_stamp_ms[reg] : UINT32_MAX;}
+    uint8_t get_queued_writes(){return _tx_ring_count;}
+    uint32_t get_write_errors(){return _write_errors;}
+
+      /**
+       * @brief All holding registers, decoded once per reply
+       */
+      const tTelemetry &get_telemetry(){return _telemetry;}
+
+      uint16_t get_set_volt(){return _telemetry.setVolt;}
+      uint16_t get_set_current(){return _telemetry.setCurrent;}
+      uint16_t get_actual_volt(){return _telemetry.actVolt;}
+      uint16_t get_actual_current(){return _telemetry.actCurrent;}
+      uint16_t get_power(){return _telemetry.actPower;}
+      uint16_t get_input_volt(){return _telemetry.inVolt;}
+
+      uint32_t get_amp_hour(){return _telemetry.outCharge;}
+      uint32_t get_watt_hour(){return _telemetry.outEnergy;}
+
+      uint16_t get_output_hour(){return _telemetry.onHour;}
+      uint16_t get_output_min(){return _telemetry.onMin;}
+      uint16_t get_output_sec(){return _telemetry.onSec;}
+
+      uint16_t get_internal_temp(){return _telemetry.tempInternal;}
+      uint16_t get_external_temp(){return _telemetry.tempExternal;}
+
+      bool get_lock_state(){return _telemetry.lock;}
+      bool get_protect_state(){return _telemetry.protect;}
+      bool get_constant_state(){return _telemetry.cvcc;}
+      bool get_switch_state(){return _telemetry.outputOn;}
+      bool get_temp_symbol(){return _telemetry.tempSymbol;}
+
+      uint8_t get_model(){return _telemetry.model;}
+      uint8_t get_version(){return _telemetry.version;}
+      uint8_t get_address(){return _telemetry.slaveAddress;}
+      uint8_t get_baudrate(){return _telemetry.baudCode;}
+
+      uint16_t get_internal_temp_offset(){return _telemetry.tempOffset;}
+      uint16_t get_external_temp_offset(){return _telemetry.tempExtOffset;}
+
+      uint8_t get_loaded_preset(){return _telemetry.memory;}
+
+      /**
+       * @brief Preset presetStruct.num, from the cache when it is loaded, otherwise read from the device
+       * Staged but not yet committed changes are included.
+       */
       bool fetch_preset(tMemory &presetStruct);
 
-      //setter functions
-      bool set_volt(uint16_t value) {return write_a_single_register(HREG_IDX_CV, value);}
-      bool set_current(uint16_t value)  {return write_a_single_register(HREG_IDX_CC, value);}
-      bool set_lock_state(bool value) {return write_a_single_register(HREG_IDX_LOCK, value);}  
-      bool set_protect_state(bool value)  {return write_a_single_register(HREG_IDX_PROTECT, value);}
-      bool set_switch_state(bool value) {return write_a_single_register(HREG_IDX_OUTPUT_ON, value);}
-      bool set_temp_symbol(bool value)  {return write_a_single_register(HREG_IDX_FC, value);}
-      bool set_sleep_time(uint16_t value) {return write_a_single_register(HREG_IDX_SLEEP, value);}
-      bool set_address(uint16_t value)  {return write_a_single_register(HREG_IDX_SLAVE_ADD, value);}
-      bool set_baudrate(uint16_t value) {return write_a_single_register(HREG_IDX_BAUDRATE, value);}
-      bool set_internal_temp_offset(uint16_t value) {return write_a_single_register(HREG_IDX_TEMP_OFS, value);}
-      bool set_external_temp_offset(uint16_t value) {return write_a_single_register(HREG_IDX_TEMP_EXT_OFS, value);}
-      bool switch_preset(uint8_t value) {return write_a_single_register(HREG_IDX_MEMORY, value);}
-
-      bool set_preset(tMemory &presetStruct);
+      /**
+       * @brief Warms the cache up with all presets, two per FC 0x03 read
+       */
+      bool load_presets();
 
-    private:
       /**
-       * @brief Calculates the crc16 checksum 
-       * @param buf pointer to the data
-       * @param length data length
-       * 
-       * @return crc16 value
+       * @brief Marks the cached copy of presets stale, e.g. after they were edited on the front panel
+       * Staged changes of those presets are discarded.
        */
-      uint16_t crc16_calculator(uint8_t *buf, uint8_t length);
+      void invalidate_presets(uint8_t num = PRESET_ALL);
+      bool is_preset_cached(uint8_t num){return num < PRESET_COUNT && (_preset_valid & (1 << num));}
 
-      bool read_hold_register_data(uint16_t holding_reg_start_addr, uint16_t no_of_register_to_read);
+      /**
+       * @brief Fills the cache of preset num with words known to match the device, e.g. a persisted copy
+       * @param words MEM_REGS big endian words as on the wire
+       */
+      bool restore_preset(uint8_t num, const uint8_t *words);
+      /**
+       * @brief Copy of preset num as the device holds it, false if it is not cached or has staged changes
+       */
+      bool get_preset_words(uint8_t num, uint8_t *words);
+
+      /**
+       * @brief Store new preset values in the cache and mark the registers that changed
+       * Nothing is sent until commit_presets().
+       */
+      bool stage_preset(const tMemory &presetStruct);
+      bool stage_preset_register(uint8_t num, uint8_t mem_reg, uint16_t value);
+
+      /**
+       * @brief Writes the changed registers of all presets, blocks until they are acknowledged
+       * Changed registers less than PRESET_MERGE_GAP apart go out in one FC 0x10 frame.
+       */
+      bool commit_presets();
+
+      /**
+       * @brief Bytes on the wire preset commits and cached fetches did not need compared with
+       * a full 14 register rewrite or read
+       */
+      uint32_t get_preset_bytes_saved(){return _preset_bytes_saved;}
+      uint32_t get_preset_bytes_written(){return _preset_bytes_written;}
+
+      //setter functions, queued in the coalescing write ring
+      bool set_volt(uint16_t value) {return queue_write(HREG_IDX_CV, value);}
+      bool set_current(uint16_t value)  {return queue_write(HREG_IDX_CC, value);}
+      bool set_lock_state(bool value) {return queue_write(HREG_IDX_LOCK, value);}  
+      bool set_protect_state(bool value)  {return queue_write(HREG_IDX_PROTECT, value);}
+      bool set_switch_state(bool value) {return queue_write(HREG_IDX_OUTPUT_ON, value);}
+      bool set_temp_symbol(bool value)  {return queue_write(HREG_IDX_FC, value);}
+      bool set_sleep_time(uint16_t value) {return queue_write(HREG_IDX_SLEEP, value);}
+      bool set_internal_temp_offset(uint16_t value) {return queue_write(HREG_IDX_TEMP_OFS, value);}
+      bool set_external_temp_offset(uint16_t value) {return queue_write(HREG_IDX_TEMP_EXT_OFS, value);}
+
+      // these change how the device talks: pending writes go out first and they block until acknowledged,
+      // the driver has to follow with its own address or port rate before the next frame
+      /**
+       * @brief Moves the device to another slave address (1..247) and rebuilds the request frames for it
+       */
+      bool set_address(uint16_t value);
+      bool set_baudrate(uint16_t value) {return flush_writes(true) && write_a_single_register(HREG_IDX_BAUDRATE, value);}
+      /**
+       * @brief Loads a preset into the setpoints, queued like the setters above
+       * Nothing on the driver side depends on the acknowledge, so it does not block; the write ring keeps
+       * it in order with the setpoints queued before and after it.
+       */
+      bool switch_preset(uint8_t value) {return queue_write(HREG_IDX_MEMORY, value);}
+
+      // stage and commit in one call
+      bool set_preset(tMemory &presetStruct){return stage_preset(presetStruct) && commit_presets();}
+
+    private:
+      bool read_hold_register_data(uint16_t holding_reg_start_addr, uint16_t no_of_register_to_read, uint8_t *dest = nullptr);
       bool write_a_single_register(uint16_t reg_address, uint16_t value);
       bool write_multiple_registers(uint16_t holding_reg_start_addr, uint16_t no_of_register_to_write, uint8_t data_byte_count, uint8_t *value_buf);
-      bool get_all_hold_regs();
+
+      void init_transaction(tTransaction &txn, uint8_t funcCode, uint16_t start_reg, uint16_t count, TxnCallback callback, void *ctx);
+      bool enqueue_transaction(const tTransaction &txn);
+      bool enqueue_read(uint16_t start_reg, uint16_t count, uint8_t flags, TxnCallback callback, void *ctx);
+      void service(uint32_t now);
+      bool transfer(bool may_start);
+      bool control_pending();
+      bool start_transaction();
+      void update_rtt(uint32_t sample_us);
+      void receive_bytes();
+      void complete_transaction(TxnStatus status);
+      bool wait_for(volatile TxnStatus &status);
+      // unsigned distance, so a bus quiet for longer than 2^31 us is not taken for one in the future
+      bool frame_gap_pending(){return (uint32_t)(micros() - _bus_last_us) < _frame_gap_us;}
+      static void write_done(const tTxnResult &result, void *ctx);
+      static void poll_done(const tTxnResult &result, void *ctx);
+      void retry_polls(uint16_t start_reg, uint16_t count);
+      void schedule_polls(uint32_t now);
+      void publish_snapshot(uint32_t stamp);
+      void build_trip_frame();
+      void rebuild_frames();
+      void cache_frame(uint16_t start_reg, uint16_t count, const tRequestFrame &frame);
+      bool lookup_frame(uint16_t start_reg, uint16_t count, uint8_t *dest);   // dest nullptr only tests
+      void learn_poll_frame(uint16_t start_reg, uint16_t count);
+      void cache_preset_data(uint16_t start_reg, uint16_t count, const uint8_t *data, bool acknowledged_write);
+      bool commit_preset(uint8_t num);
+
+      friend class xy_bus;
 
     private:
       Stream *serialHandle;
+      xy_bus *_bus = nullptr;
+      xy_history *_history = nullptr;
+      xy_watch *_watch = nullptr;
+      xy_stream *_stream = nullptr;
+      xy_capture *_capture = nullptr;
+      portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;   // transaction queue and write ring
       uint8_t _slave_address;
-      uint8_t all_hold_reg_data[60];
-      uint8_t response_temp_buf[70];
-      uint16_t _timeout;
+      uint8_t all_hold_reg_data[60] = {0};
+      tTelemetry _telemetry = {};
+      uint8_t response_temp_buf[MAX_RX_FRAME_SIZE];
+      uint32_t _timeout;              // reply deadline of the transaction in flight, us
+
+      // transaction engine state
+      tTransaction _txn_queue[TXN_QUEUE_SIZE];
+      uint8_t _txn_head = 0;
+      uint8_t _txn_count = 0;
+      RxState _rx_state = IDLE;
+      uint8_t _rx_len = 0;
+      uint8_t _rx_expected = 0;
+      uint16_t _rx_crc = CRC16_MODBUS_INIT;
+      uint32_t _txn_start_us = 0;
+      uint32_t _tx_wire_us = 0;
+      uint32_t _rx_first_us = 0;
+      uint32_t _rx_last_us = 0;
+      uint32_t _bus_last_us = 0;     // end of the last transaction, the gap is counted from here
+      uint32_t _txn_completed = 0;
+      uint32_t _txn_window_start_ms = 0;
+      uint32_t _txn_per_sec = 0;
+      TxnStatus _last_status = TXN_PENDING;
+      tTransaction _trip_txn;
+      volatile bool _output_inhibit = false;
+      bool _trip_queued = false;
+
+      // ready to send read requests, see rebuild_frames()
+      tFrameCacheEntry _frame_cache[FRAME_CACHE_SIZE];
+      uint8_t _frame_cache_poll = 0;
+      uint32_t _frame_hits = 0;
+      uint32_t _frame_misses = 0;
+      uint8_t _last_exception = 0;
+      xy_metrics _metrics;
+
+      // link timing
+      uint32_t _link_baud = 0;
+      uint32_t _char_time_us = 0;
+      uint32_t _t15_us = 0;
+      uint32_t _t35_us = 0;
+      uint32_t _frame_gap_us = 0;
+      uint32_t _srtt_us = 0;
+      uint32_t _rttvar_us = 0;
+      uint32_t _rto_us = RTO_INITIAL_US;
+
+      // coalescing write ring
+      txRingEle _tx_ring[TX_RING_BUFFER_SIZE];
+      uint8_t _tx_ring_head = 0;
+      uint8_t _tx_ring_count = 0;
+      uint8_t _tx_ring_held = 0;        // drained by a flush and not yet queued, still take room in the ring
+      uint32_t _tx_ring_deadline_ms = 0;
+      uint16_t _write_flush_delay_ms = WRITE_FLUSH_DELAY_MS;
+      uint32_t _write_errors = 0;
+
+      // polling scheduler
+      tPollGroup _poll_groups[POLL_GROUP_MAX];
+      uint8_t _poll_group_count = 0;
+      uint8_t _poll_outstanding = 0;
+      bool _polling = false;
+      uint32_t _reg_stamp_ms[30] = {0};
+
+      xy_seqlock<tSnapshot> _snapshot;
+
+      // preset cache, raw big endian words as on the wire
+      uint8_t _preset_words[PRESET_COUNT][MEM_REGS * 2];
+      uint16_t _preset_valid = 0;                      // bit per preset
+      uint16_t _preset_dirty[PRESET_COUNT] = {0};      // bit per register
+      uint32_t _preset_bytes_saved = 0;
+      uint32_t _preset_bytes_written = 0;
 };
 
 #endif
\ No newline at end of file
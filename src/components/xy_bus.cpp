@@ -0,0 +1,110 @@
+#include "xy_bus.h"
+
+xy_bus::xy_bus(Stream *serial) : serialHandle(serial)
+{
+  _mutex = xSemaphoreCreateMutex();
+  reset_stats();
+}
+
+xy_bus::~xy_bus(){
+  vSemaphoreDelete(_mutex);
+}
+
+void xy_bus::begin(uint32_t baud){
+  _link_baud = baud;
+  for (uint8_t i = 0; i < _device_count; i++) _devices[i]->set_link_baud(baud);
+}
+
+bool xy_bus::attach(xy6020l *device){
+  if (!device || device->_bus) return false;
+  if (_device_count >= BUS_MAX_DEVICES) return false;
+
+  device->serialHandle = serialHandle;
+  device->set_link_baud(_link_baud);
+  device->_bus = this;
+  _devices[_device_count] = device;
+  _busy_us[_device_count] = 0;
+  _txn_count[_device_count] = 0;
+  _device_count++;
+  return true;
+}
+
+void xy_bus::reset_stats(){
+  for (uint8_t i = 0; i < _device_count; i++){
+    _busy_us[i] = 0;
+    _txn_count[i] = 0;
+  }
+  _stats_start_ms = millis();
+}
+
+uint16_t xy_bus::get_device_bus_share(uint8_t idx){
+  if (idx >= _device_count) return 0;
+  uint32_t elapsed_ms = millis() - _stats_start_ms;
+  if (elapsed_ms == 0) return 0;
+  return (uint16_t) (_busy_us[idx] / elapsed_ms);
+}
+
+uint16_t xy_bus::get_utilization(){
+  uint32_t elapsed_ms = millis() - _stats_start_ms;
+  if (elapsed_ms == 0) return 0;
+
+  uint64_t busy = 0;
+  for (uint8_t i = 0; i < _device_count; i++) busy += _busy_us[i];
+  return (uint16_t) (busy / elapsed_ms);
+}
+
+int8_t xy_bus::pick_next(){
+  if (_device_count == 0) return BUS_NO_DEVICE;
+
+  // first pass only control writes, second pass anything, round robin after the device served last
+  for (uint8_t pass = 0; pass < 2; pass++){
+    for (uint8_t i = 1; i <= _device_count; i++){
+      uint8_t idx = (_last_served + i + _device_count) % _device_count;
+      xy6020l *device = _devices[idx];
+      if (device->_txn_count == 0) continue;
+      if (pass == 0 && !device->control_pending()) continue;
+      return idx;
+    }
+  }
+  return BUS_NO_DEVICE;
+}
+
+void xy_bus::release_active(){
+  xy6020l *device = _devices[_active];
+  _busy_us[_active] += micros() - _active_start_us;
+  _txn_count[_active]++;
+  _bus_last_us = device->_bus_last_us;
+  _bus_gap_us = device->_frame_gap_us;
+  _last_served = _active;
+  _active = BUS_NO_DEVICE;
+}
+
+void xy_bus::process(){
+  if (xSemaphoreTake(_mutex, 0) != pdTRUE) return;
+
+  uint32_t now = millis();
+  for (uint8_t i = 0; i < _device_count; i++) _devices[i]->service(now);
+
+  for (;;){
+    if (_active != BUS_NO_DEVICE){
+      if (_devices[_active]->transfer(false)) break;
+      release_active();
+    }
+
+    // the inter-frame gap belongs to the wire, not to a device
+    if ((uint32_t)(micros() - _bus_last_us) < _bus_gap_us) break;
+
+    int8_t next = pick_next();
+    if (next == BUS_NO_DEVICE) break;
+
+    xy6020l *device = _devices[next];
+    device->_bus_last_us = _bus_last_us;
+    // a device asking for a longer silence than the last one keeps the wire idle, nothing to count
+    if (device->frame_gap_pending()) break;
+    _active = next;
+    _active_start_us = micros();
+    if (!device->transfer(true)) release_active();
+  }
+
+  xSemaphoreGive(_mutex);
+}
@@ -0,0 +1,93 @@
+/**
+ * @file xy_bus.h
+ * @brief Shared RS-485 bus for several XY6020L units on one UART
+ *
+ * The bus owns the serial port and grants it to one attached device at a time.
+ * Devices keep their own transaction queue, write ring, poller and turnaround
+ * estimate; the bus only decides whose transaction goes next. Devices with a
+ * control write at the head of their queue are served before telemetry reads,
+ * round robin within each class, and the inter-frame gap is kept bus wide.
+ *
+ * process() may be called from several FreeRTOS tasks: one of them drives the
+ * bus at a time, the others return immediately. The blocking helpers of an
+ * attached device drive the bus themselves while they wait.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy_bus_h
+#define xy_bus_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+
+#define BUS_MAX_DEVICES   8
+#define BUS_NO_DEVICE     -1
+
+/**
+ * @class xy_bus
+ * @brief Serializes the transactions of all attached devices on one serial port
+ */
+class xy_bus
+{
+  public:
+    xy_bus(Stream *serial);
+    ~xy_bus();
+
+    /**
+     * @brief Sets the link timing of all attached devices, see xy6020l::set_link_baud
+     */
+    void begin(uint32_t baud = 115200);
+
+    /**
+     * @brief Hands the serial port of the bus to the device, call before process() runs
+     * @return false if the bus is full or the device already belongs to a bus
+     */
+    bool attach(xy6020l *device);
+
+    /**
+     * @brief Runs the housekeeping of every device and the transaction of the granted one, never blocks
+     */
+    void process();
+
+    uint8_t get_device_count(){return _device_count;}
+    xy6020l *get_device(uint8_t idx){return idx < _device_count ? _devices[idx] : nullptr;}
+
+    /**
+     * @brief Time the device held the bus since the last reset_stats(), request to end of reply
+     */
+    uint64_t get_device_bus_time_us(uint8_t idx){return idx < _device_count ? _busy_us[idx] : 0;}
+    uint32_t get_device_transactions(uint8_t idx){return idx < _device_count ? _txn_count[idx] : 0;}
+
+    /**
+     * @brief Share of the wall time since reset_stats() the device held the bus, in 0.1 %
+     */
+    uint16_t get_device_bus_share(uint8_t idx);
+    uint16_t get_utilization();
+
+    void reset_stats();
+
+  private:
+    int8_t pick_next();
+    void release_active();
+
+  private:
+    Stream *serialHandle;
+    SemaphoreHandle_t _mutex;
+    uint32_t _link_baud = 115200;
+
+    xy6020l *_devices[BUS_MAX_DEVICES];
+    uint64_t _busy_us[BUS_MAX_DEVICES];
+    uint32_t _txn_count[BUS_MAX_DEVICES];
+    uint8_t _device_count = 0;
+
+    int8_t _active = BUS_NO_DEVICE;
+    int8_t _last_served = BUS_NO_DEVICE;
+    uint32_t _active_start_us = 0;
+    uint32_t _bus_last_us = 0;
+    uint32_t _bus_gap_us = 0;       // inter-frame gap of the device that used the bus last
+    uint32_t _stats_start_ms = 0;
+};
+
+#endif
@@ -0,0 +1,137 @@
+#include "xy_capture.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *const DIR_NAMES[] = {"tx", "rx", "st"};
+
+void xy_capture::set_enabled(bool enabled){
+  portENTER_CRITICAL(&_lock);
+  _enabled = enabled;
+  if (enabled){
+    _stats.frozen = false;
+    _freeze_left = -1;
+  }
+  portEXIT_CRITICAL(&_lock);
+}
+
+void xy_capture::freeze_after_error(uint8_t more_records){
+  portENTER_CRITICAL(&_lock);
+  _freeze_after = more_records;
+  _freeze_left = -1;
+  portEXIT_CRITICAL(&_lock);
+}
+
+void xy_capture::clear(){
+  portENTER_CRITICAL(&_lock);
+  _head = 0;
+  _count = 0;
+  _freeze_left = -1;
+  _stats = {};
+  portEXIT_CRITICAL(&_lock);
+}
+
+void xy_capture::add(uint8_t dir, uint8_t status, const uint8_t *data, uint16_t len, uint32_t stamp_us){
+  if (!_enabled) return;
+
+  portENTER_CRITICAL(&_lock);
+  tCaptureRecord &record = _ring[_head];
+  record.timestampUs = stamp_us;
+  record.dir = dir;
+  record.status = status;
+  if (len > CAPTURE_FRAME_MAX){
+    len = CAPTURE_FRAME_MAX;
+    _stats.truncated++;
+  }
+  record.len = len;
+  memcpy(record.data, data, len);
+
+  _head = (_head + 1) % CAPTURE_RING_SIZE;
+  if (_count < CAPTURE_RING_SIZE) _count++;
+  else _stats.overwritten++;
+  _stats.records++;
+
+  if (_freeze_left > 0 && --_freeze_left == 0){
+    _enabled = false;
+    _stats.frozen = true;
+  } else if (_freeze_left < 0 && _freeze_after && status != TXN_OK && status != TXN_PENDING){
+    _freeze_left = _freeze_after;
+  }
+  portEXIT_CRITICAL(&_lock);
+}
+
+uint16_t xy_capture::count(){
+  portENTER_CRITICAL(&_lock);
+  uint16_t count = _count;
+  portEXIT_CRITICAL(&_lock);
+  return count;
+}
+
+bool xy_capture::get(uint16_t index, tCaptureRecord &record){
+  portENTER_CRITICAL(&_lock);
+  bool found = index < _count;
+  if (found) record = _ring[(_head + CAPTURE_RING_SIZE - _count + index) % CAPTURE_RING_SIZE];
+  portEXIT_CRITICAL(&_lock);
+  return found;
+}
+
+void xy_capture::get_stats(tCaptureStats &stats){
+  portENTER_CRITICAL(&_lock);
+  stats = _stats;
+  portEXIT_CRITICAL(&_lock);
+}
+
+void xy_capture::dump(Stream *out){
+  tCaptureRecord record;
+  char line[CAPTURE_LINE_MAX];
+  for (uint16_t i = 0; get(i, record); i++){
+    int len = format(record, line, sizeof(line));
+    if (len) out->write((const uint8_t *) line, len);
+  }
+}
+
+int xy_capture::format(const tCaptureRecord &record, char *line, size_t size){
+  static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+  int pos = snprintf(line, size, "%u %s %u ", (unsigned) record.timestampUs, DIR_NAMES[record.dir < 3 ? record.dir : 2], record.status);
+  if (pos < 0 || (size_t)(pos + (record.len * 2) + 2) > size) return 0;
+  for (uint8_t i = 0; i < record.len; i++){
+    line[pos++] = HEX_DIGITS[record.data[i] >> 4];
+    line[pos++] = HEX_DIGITS[record.data[i] & 0x0F];
+  }
+  line[pos++] = '\n';
+  line[pos] = 0;
+  return pos;
+}
+
+static int hex_value(char c){
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+bool xy_capture::parse(const char *line, tCaptureRecord &record){
+  char *end;
+  record.timestampUs = strtoul(line, &end, 10);
+  if (end == line || *end != ' ') return false;
+
+  const char *p = end + 1;
+  record.dir = 0xFF;
+  for (uint8_t dir = 0; dir < 3; dir++){
+    if (strncmp(p, DIR_NAMES[dir], 2) == 0) record.dir = dir;
+  }
+  if (record.dir == 0xFF || p[2] != ' ') return false;
+
+  p += 3;
+  record.status = strtoul(p, &end, 10);
+  if (end == p || *end != ' ') return false;
+
+  p = end + 1;
+  record.len = 0;
+  while (hex_value(p[0]) >= 0 && hex_value(p[1]) >= 0){
+    if (record.len == CAPTURE_FRAME_MAX) return false;
+    record.data[record.len++] = (hex_value(p[0]) << 4) | hex_value(p[1]);
+    p += 2;
+  }
+  return record.len > 0;
+}
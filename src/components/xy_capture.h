@@ -0,0 +1,109 @@
+/**
+ * @file xy_capture.h
+ * @brief Bus traffic capture: timestamped request and reply frames in a fixed ring
+ *
+ * Attached with xy6020l::set_capture(), the capture gets every request the
+ * driver sent and every reply it received, complete or not, with the micros()
+ * of its first byte and the status of the transaction. Late bytes the driver
+ * throws away before a request are kept as stray records. Recording is a copy
+ * into a preallocated ring, nothing is allocated; the oldest record is
+ * overwritten when the ring is full.
+ *
+ * freeze_after_error() keeps the lead-up to a fault: once a failed transaction
+ * was recorded, a few more records are taken and the capture stops by itself.
+ *
+ * Records export as text lines, "<us> <tx|rx|st> <status> <hex bytes>", which
+ * parse() reads back, e.g. into the replay Stream of the host build (xy_replay).
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy_capture_h
+#define xy_capture_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+
+#ifndef CAPTURE_RING_SIZE
+#define CAPTURE_RING_SIZE   64      // records, about 4.6 kB
+#endif
+#define CAPTURE_FRAME_MAX   MAX_RX_FRAME_SIZE
+#define CAPTURE_LINE_MAX    (24 + (CAPTURE_FRAME_MAX * 2))
+
+enum CaptureDir {
+    CAPTURE_TX,
+    CAPTURE_RX,
+    CAPTURE_STRAY       // bytes that arrived outside of a transaction
+};
+
+typedef struct {
+    uint32_t timestampUs;   // first byte
+    uint8_t dir;            // CaptureDir
+    uint8_t status;         // TxnStatus of the transaction, TXN_PENDING for stray bytes
+    uint8_t len;
+    uint8_t data[CAPTURE_FRAME_MAX];
+} tCaptureRecord;
+
+typedef struct {
+    uint32_t records;
+    uint32_t overwritten;
+    uint32_t truncated;     // longer than CAPTURE_FRAME_MAX
+    bool frozen;
+} tCaptureStats;
+
+/**
+ * @class xy_capture
+ * @brief Ring of the last CAPTURE_RING_SIZE frames on the bus of one xy6020l
+ */
+class xy_capture
+{
+  public:
+    void set_enabled(bool enabled);
+    bool is_enabled(){return _enabled;}
+
+    /**
+     * @brief Stops recording more_records after the first record of a failed transaction, 0 records forever
+     */
+    void freeze_after_error(uint8_t more_records);
+    void clear();
+
+    /**
+     * @brief Called by the driver, copies the frame if recording
+     */
+    void add(uint8_t dir, uint8_t status, const uint8_t *data, uint16_t len, uint32_t stamp_us);
+
+    uint16_t count();
+    /**
+     * @brief Copy of a record, index 0 is the oldest one
+     */
+    bool get(uint16_t index, tCaptureRecord &record);
+    void get_stats(tCaptureStats &stats);
+
+    /**
+     * @brief Writes every record as a text line to out
+     */
+    void dump(Stream *out);
+
+    /**
+     * @brief One record as a text line with newline
+     * @return length of the line, 0 if it did not fit into size
+     */
+    static int format(const tCaptureRecord &record, char *line, size_t size);
+    /**
+     * @brief Reads a line written by format(), false for comments ('#') and malformed lines
+     */
+    static bool parse(const char *line, tCaptureRecord &record);
+
+  private:
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+    tCaptureRecord _ring[CAPTURE_RING_SIZE];
+    uint16_t _head = 0;         // next record to write
+    uint16_t _count = 0;
+    volatile bool _enabled = false;
+    uint8_t _freeze_after = 0;
+    int16_t _freeze_left = -1;  // records until the freeze, -1 while no error was seen
+    tCaptureStats _stats = {};
+};
+
+#endif
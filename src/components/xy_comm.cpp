@@ -0,0 +1,144 @@
+#include "xy_comm.h"
+
+bool xy_comm::start(){
+  if (_task_alive) return false;
+
+  _running = true;
+  _task_alive = true;
+  if (xTaskCreatePinnedToCore(task_main, "xy_comm", COMM_TASK_STACK, this, COMM_TASK_PRIORITY, &_task, COMM_TASK_CORE) != pdPASS){
+    _running = false;
+    _task_alive = false;
+    return false;
+  }
+  return true;
+}
+
+void xy_comm::stop(){
+  _running = false;
+  while (_task_alive) vTaskDelay(1);
+}
+
+void xy_comm::task_main(void *param){
+  xy_comm *self = (xy_comm *) param;
+
+  while (self->_running){
+    bool worked = self->run_commands();
+
+    // a transaction that started or completed may allow the next step right away
+    RxState state = self->_psu->get_rx_state();
+    uint8_t pending = self->_psu->get_pending_transactions();
+    self->_psu->process();
+    worked |= state != self->_psu->get_rx_state() || pending != self->_psu->get_pending_transactions();
+    self->publish_telemetry();
+
+    self->_stats.loops++;
+    self->_stats_lock.publish(self->_stats);
+    if (!worked) vTaskDelay(COMM_WAIT_TICKS);
+  }
+
+  self->_task = nullptr;
+  self->_task_alive = false;
+  vTaskDelete(nullptr);
+}
+
+bool xy_comm::run_commands(){
+  bool worked = false;
+
+  // a command that found no free result slot goes first, in order
+  while (true){
+    tCommCommand command;
+    if (_has_deferred) command = _deferred;
+    else if (!_commands.pop(command)) break;
+
+    _has_deferred = false;
+    if (!execute(command)){
+      _deferred = command;
+      _has_deferred = true;
+      break;
+    }
+    _stats.commands++;
+    worked = true;
+  }
+  return worked;
+}
+
+bool xy_comm::execute(const tCommCommand &command){
+  switch (command.type){
+    case COMM_SET_REG:
+      if (!_psu->queue_write(command.reg, command.value)) _stats.rejectedCommands++;
+      return true;
+    case COMM_FLUSH:
+      _psu->flush_writes();
+      return true;
+    case COMM_TRIP:
+      if (!_psu->trip_output()) _stats.rejectedCommands++;
+      return true;
+    case COMM_RELEASE:
+      _psu->release_output();
+      return true;
+    case COMM_POLLING:
+      if (command.value) _psu->start_polling();
+      else _psu->stop_polling();
+      return true;
+    default:
+      break;
+  }
+
+  tPending *slot = nullptr;
+  for (tPending &pending : _pending){
+    if (!pending.busy){
+      slot = &pending;
+      break;
+    }
+  }
+  if (!slot) return false;
+
+  slot->comm = this;
+  slot->tag = command.tag;
+  slot->busy = true;
+
+  bool queued = false;
+  if (command.type == COMM_READ) queued = _psu->submit_read(command.reg, command.count, txn_done, slot);
+  else if (command.type == COMM_WRITE) queued = _psu->submit_write_single(command.reg, command.value, txn_done, slot);
+
+  if (!queued){
+    slot->busy = false;
+    // a full transaction queue drains by itself, anything else is refused for good
+    if (_psu->get_pending_transactions() >= TXN_QUEUE_SIZE - 1) return false;
+    _stats.rejectedCommands++;
+  }
+  return true;
+}
+
+void xy_comm::txn_done(const tTxnResult &result, void *ctx){
+  tPending *slot = (tPending *) ctx;
+  xy_comm *self = slot->comm;
+
+  tCommResult out;
+  out.tag = slot->tag;
+  out.status = result.status;
+  out.exception = result.exception;
+  out.funcCode = result.funcCode;
+  out.count = result.data ? result.count : 0;
+  out.startReg = result.startReg;
+  out.latencyUs = result.latencyUs;
+  for (uint8_t i = 0; i < out.count && i < 30; i++) out.regs[i] = (result.data[i * 2] << 8) | result.data[(i * 2) + 1];
+  slot->busy = false;
+
+  if (self->_results.push(out)) self->_stats.results++;
+  else self->_stats.droppedResults++;
+}
+
+void xy_comm::publish_telemetry(){
+  uint32_t seq = _psu->get_snapshot_sequence();
+  if (seq == _last_seq) return;
+  _last_seq = seq;
+
+  // the getters are consistent here, this task is the one completing transactions
+  tCommTelemetry out;
+  out.telemetry = _psu->get_telemetry();
+  out.timestampMs = millis();
+  out.seq = seq;
+  if (_telemetry.push(out)) _stats.telemetry++;
+  else _stats.droppedTelemetry++;
+}
@@ -0,0 +1,148 @@
+/**
+ * @file xy_comm.h
+ * @brief Communication task for one xy6020l, fed and drained through lock-free queues
+ *
+ * The task is pinned to COMM_TASK_CORE, away from the Arduino loop() on core 1,
+ * and is the only one calling process() of the device. The application never
+ * touches the driver while it runs: it pushes commands into one single-producer
+ * single-consumer ring and pops decoded telemetry and transaction results from
+ * two others. None of the three takes a lock, all are bounded; a full command
+ * queue refuses the command, full output queues drop the newest item and count it.
+ *
+ * When a pass had nothing to do the task sleeps for COMM_WAIT_TICKS, which also
+ * lets the idle task of its core run while replies trickle in.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy_comm_h
+#define xy_comm_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+#include "seqlock.h"
+#include "spsc_queue.h"
+
+#define COMM_TASK_CORE          0       // Arduino loop() runs on core 1
+#define COMM_TASK_PRIORITY      5
+#define COMM_TASK_STACK         4096
+#define COMM_WAIT_TICKS         1
+#define COMM_COMMAND_QUEUE      16      // ring sizes, one slot less is usable
+#define COMM_TELEMETRY_QUEUE    8
+#define COMM_RESULT_QUEUE       16
+#define COMM_PENDING_MAX        TXN_QUEUE_SIZE
+
+enum CommCommandType {
+    COMM_SET_REG,       // queue_write(), coalesced, no result
+    COMM_FLUSH,         // flush_writes() without waiting, no result
+    COMM_READ,          // submit_read(), result carries the registers
+    COMM_WRITE,         // submit_write_single()
+    COMM_TRIP,          // trip_output(), no result; a guard inside the comm task reacts faster
+    COMM_RELEASE,       // release_output(), no result
+    COMM_POLLING        // start_polling() if value is set, stop_polling() otherwise, no result
+};
+
+typedef struct {
+    uint8_t type;       // CommCommandType
+    uint8_t reg;        // register, start register of COMM_READ
+    uint8_t count;      // registers of COMM_READ
+    uint16_t value;
+    uint32_t tag;       // returned with the result
+} tCommCommand;
+
+typedef struct {
+    uint32_t tag;
+    uint8_t status;     // TxnStatus
+    uint8_t exception;
+    uint8_t funcCode;
+    uint8_t count;
+    uint16_t startReg;
+    uint32_t latencyUs;
+    uint16_t regs[30];  // host order, count of them for reads
+} tCommResult;
+
+typedef struct {
+    tTelemetry telemetry;
+    uint32_t timestampMs;
+    uint32_t seq;       // snapshot sequence of the frame, gaps show skipped frames
+} tCommTelemetry;
+
+typedef struct {
+    uint32_t loops;
+    uint32_t commands;
+    uint32_t rejectedCommands;  // refused by the driver (invalid, inhibited output)
+    uint32_t telemetry;
+    uint32_t droppedTelemetry;
+    uint32_t results;
+    uint32_t droppedResults;
+} tCommStats;
+
+/**
+ * @class xy_comm
+ * @brief Runs the Modbus traffic of one device in its own task
+ */
+class xy_comm
+{
+  public:
+    xy_comm(xy6020l *psu) : _psu(psu) {}
+    ~xy_comm(){stop();}
+
+    bool start();
+
+    /**
+     * @brief Ends the task after its current pass, queued commands stay queued
+     */
+    void stop();
+    bool is_running(){return _task_alive;}
+
+    // producer side of the command queue, one application task;
+    // commands the driver refuses produce no result and count as rejected
+    bool send(const tCommCommand &command){return _commands.push(command);}
+    bool set_register(uint8_t reg, uint16_t value){return send({COMM_SET_REG, reg, 0, value, 0});}
+    bool flush(){return send({COMM_FLUSH, 0, 0, 0, 0});}
+    bool read(uint8_t start_reg, uint8_t count, uint32_t tag){return send({COMM_READ, start_reg, count, 0, tag});}
+    bool write(uint8_t reg, uint16_t value, uint32_t tag){return send({COMM_WRITE, reg, 0, value, tag});}
+    bool trip(){return send({COMM_TRIP, 0, 0, 0, 0});}
+    bool release(){return send({COMM_RELEASE, 0, 0, 0, 0});}
+    bool set_polling(bool on){return send({COMM_POLLING, 0, 0, on, 0});}
+
+    // consumer side of the output queues, one application task
+    bool receive_telemetry(tCommTelemetry &telemetry){return _telemetry.pop(telemetry);}
+    bool receive_result(tCommResult &result){return _results.pop(result);}
+
+    void get_stats(tCommStats &stats){_stats_lock.read(stats);}
+
+  private:
+    typedef struct {
+        xy_comm *comm;
+        uint32_t tag;
+        bool busy;
+    } tPending;
+
+    static void task_main(void *param);
+    static void txn_done(const tTxnResult &result, void *ctx);
+    bool execute(const tCommCommand &command);
+    bool run_commands();
+    void publish_telemetry();
+
+    xy6020l *_psu;
+    TaskHandle_t _task = nullptr;
+    volatile bool _running = false;
+    volatile bool _task_alive = false;
+
+    xy_spsc_queue<tCommCommand, COMM_COMMAND_QUEUE> _commands;
+    xy_spsc_queue<tCommTelemetry, COMM_TELEMETRY_QUEUE> _telemetry;
+    xy_spsc_queue<tCommResult, COMM_RESULT_QUEUE> _results;
+
+    // comm task state
+    tPending _pending[COMM_PENDING_MAX] = {};
+    tCommCommand _deferred;
+    bool _has_deferred = false;
+    uint32_t _last_seq = 0;
+
+    tCommStats _stats = {};
+    xy_seqlock<tCommStats> _stats_lock;
+};
+
+#endif
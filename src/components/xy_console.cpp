@@ -0,0 +1,372 @@
+#include "xy_console.h"
+#include "xy_stream.h"
+#include "xy_capture.h"
+#include <stdarg.h>
+#include <stdlib.h>
+
+static const char *const STATUS_NAMES[] = {"pending", "ok", "timeout", "short frame", "crc error", "exception", "tx error", "bad frame"};
+
+const xy_console::tCommand xy_console::COMMANDS[] = {
+  {"help",    "",                         0, cmd_help},
+  {"read",    "<reg> [count]",            1, cmd_read},
+  {"write",   "<reg> <value>",            2, cmd_write},
+  {"preset",  "[num]",                    0, cmd_preset},
+  {"pset",    "<num> <field> <value>",    3, cmd_pset},
+  {"recall",  "<num>",                    1, cmd_recall},
+  {"poll",    "on|off",                   1, cmd_poll},
+  {"status",  "",                         0, cmd_status},
+  {"metrics", "[reset]",                  0, cmd_metrics},
+  {"trip",    "",                         0, cmd_trip},
+  {"release", "",                         0, cmd_release},
+  {"stream",  "on|off|frames on|off",     1, cmd_stream},
+  {"capture", "on|off|clear|dump|freeze <n>", 1, cmd_capture},
+};
+
+static bool parse_number(const char *text, uint32_t &value){
+  char *end;
+  value = strtoul(text, &end, 0);
+  return *text && !*end;
+}
+
+// holding register by number or by its name in XY_HOLD_REG_MAP (actVolt, setVolt, ...)
+static bool parse_register(const char *text, uint32_t &reg){
+  if (parse_number(text, reg)) return true;
+  int idx = regmap_find_name(XY_HOLD_REG_MAP, text);
+  if (idx == REG_NOT_FOUND) return false;
+  reg = XY_HOLD_REG_MAP[idx].reg;
+  return true;
+}
+
+void xy_console::poll(){
+  for (uint8_t n = 0; n < CONSOLE_READ_CHUNK && _io->available() > 0; n++){
+    int c = _io->read();
+    if (c < 0) break;
+
+    if (c == '\r' || c == '\n'){
+      _line[_line_len] = '\0';
+      if (_line_overflow) print("line too long, max %u characters\n", CONSOLE_LINE_MAX);
+      else if (_line_len) execute(_line);
+      _line_len = 0;
+      _line_overflow = false;
+    } else if (c == 0x08 || c == 0x7F){
+      if (_line_len) _line_len--;
+    } else if (_line_len < CONSOLE_LINE_MAX){
+      _line[_line_len++] = (char) c;
+    } else {
+      _line_overflow = true;
+    }
+  }
+
+  tCommResult result;
+  while (CONSOLE_OUT_SIZE - _out_len >= CONSOLE_RESULT_ROOM && _comm->receive_result(result)) print_result(result);
+  dump_capture();
+
+  write_out();
+  // the stream only gets the port once the text before it went out
+  if (_stream && _stream->is_enabled() && !_out_len) _stream->poll();
+}
+
+void xy_console::execute(char *line){
+  char *argv[CONSOLE_MAX_ARGS + 1];
+  uint8_t argc = 0;
+  for (char *token = strtok(line, " \t"); token; token = strtok(nullptr, " \t")){
+    if (argc > CONSOLE_MAX_ARGS){
+      print("too many arguments\n");
+      return;
+    }
+    argv[argc++] = token;
+  }
+  if (!argc) return;
+
+  for (const tCommand &command : COMMANDS){
+    if (strcmp(command.name, argv[0]) != 0) continue;
+    if (argc - 1 < command.minArgs) print("usage: %s %s\n", command.name, command.usage);
+    else command.handler(*this, argc, argv);
+    return;
+  }
+  print("unknown command '%s', try help\n", argv[0]);
+}
+
+void xy_console::print(const char *fmt, ...){
+  if (streaming()) return;
+
+  char text[160];
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(text, sizeof(text), fmt, args);
+  va_end(args);
+  if (len < 0) return;
+  if (len >= (int) sizeof(text)) len = sizeof(text) - 1;
+
+  if (_out_len + len > CONSOLE_OUT_SIZE){
+    _dropped_output += len;
+    return;
+  }
+  for (int i = 0; i < len; i++) _out[(_out_head + _out_len + i) % CONSOLE_OUT_SIZE] = text[i];
+  _out_len += len;
+}
+
+void xy_console::write_out(){
+  if (!_out_len) return;
+
+  uint16_t len = _out_len < CONSOLE_WRITE_CHUNK ? _out_len : CONSOLE_WRITE_CHUNK;
+  if (_out_head + len > CONSOLE_OUT_SIZE) len = CONSOLE_OUT_SIZE - _out_head;
+  size_t written = _io->write((const uint8_t *) &_out[_out_head], len);
+  _out_head = (_out_head + written) % CONSOLE_OUT_SIZE;
+  _out_len -= written;
+}
+
+void xy_console::dump_capture(){
+  tCaptureRecord record;
+  char line[CAPTURE_LINE_MAX];
+  while (_dump_next < _dump_end && CONSOLE_OUT_SIZE - _out_len >= CAPTURE_LINE_MAX){
+    if (!_capture->get(_dump_next++, record) || !xy_capture::format(record, line, sizeof(line))) continue;
+    print("%s", line);
+    if (_dump_next == _dump_end) print("# end\n");
+  }
+}
+
+bool xy_console::streaming(){
+  return _stream && _stream->is_enabled();
+}
+
+bool xy_console::queued(bool sent){
+  if (!sent) print("busy, command queue full\n");
+  return sent;
+}
+
+void xy_console::print_value(const tRegDesc &desc, uint32_t raw){
+  uint8_t decimals = desc.scale >= 1000 ? 3 : desc.scale >= 100 ? 2 : desc.scale >= 10 ? 1 : 0;
+  const char *gap = *desc.unit ? " " : "";
+  if (decimals) print(" %-14s %u.%0*u%s%s\n", desc.name, (unsigned)(raw / desc.scale), decimals, (unsigned)(raw % desc.scale), gap, desc.unit);
+  else print(" %-14s %u%s%s\n", desc.name, (unsigned) raw, gap, desc.unit);
+}
+
+void xy_console::print_result(const tCommResult &result){
+  uint8_t kind = result.tag & 0xFF;
+  uint8_t arg = (result.tag >> 8) & 0xFF;
+
+  if (result.status != TXN_OK){
+    if (result.status == TXN_EXCEPTION) print("0x%02X: exception %u\n", result.startReg, result.exception);
+    else print("0x%02X: %s\n", result.startReg, result.status < 8 ? STATUS_NAMES[result.status] : "?");
+    return;
+  }
+
+  if (kind == TAG_WRITE){
+    print("0x%02X: ok, %u us\n", result.startReg, (unsigned) result.latencyUs);
+  } else if (kind == TAG_PRESET){
+    uint8_t words[MEM_REGS * 2];
+    for (uint8_t i = 0; i < MEM_REGS; i++){
+      words[i * 2] = result.regs[i] >> 8;
+      words[(i * 2) + 1] = result.regs[i] & 0xFF;
+    }
+    tMemory preset = {};
+    regmap_decode(XY_MEM_REG_MAP, words, 0, MEM_REGS, preset);
+    print("preset %u:\n", arg);
+    for (const tRegDesc &desc : XY_MEM_REG_MAP){
+      uint32_t raw = 0;
+      memcpy(&raw, (const uint8_t *) &preset + desc.field, desc.width * 2);
+      print_value(desc, raw);
+    }
+  } else {
+    for (uint8_t i = 0; i < result.count; i++){
+      uint16_t reg = result.startReg + i;
+      int idx = reg < 30 ? regmap_find(XY_HOLD_REG_MAP, reg) : REG_NOT_FOUND;
+      print("0x%02X %-14s %5u\n", reg, idx == REG_NOT_FOUND ? "" : XY_HOLD_REG_MAP[idx].name, result.regs[i]);
+    }
+  }
+}
+
+void xy_console::cmd_help(xy_console &console, uint8_t, char **){
+  for (const tCommand &command : COMMANDS){
+    if (*command.usage) console.print(" %-8s %s\n", command.name, command.usage);
+    else console.print(" %s\n", command.name);
+  }
+  console.print("registers by number (0x.. for hex) or name, e.g. read actVolt 3, write setVolt 1200\n");
+}
+
+void xy_console::cmd_read(xy_console &console, uint8_t argc, char **argv){
+  uint32_t reg, count = 1;
+  if (!parse_register(argv[1], reg) || reg > 0xFF || (argc > 2 && !parse_number(argv[2], count)) || count < 1 || count > 30){
+    console.print("read: register 0..255, count 1..30\n");
+    return;
+  }
+  console.queued(console._comm->read(reg, count, console.make_tag(TAG_READ, 0)));
+}
+
+void xy_console::cmd_write(xy_console &console, uint8_t, char **argv){
+  uint32_t reg, value;
+  if (!parse_register(argv[1], reg) || reg > 0xFF || !parse_number(argv[2], value) || value > 0xFFFF){
+    console.print("write: register 0..255, value 0..65535\n");
+    return;
+  }
+  if (reg < 30 && !regmap_writable(XY_HOLD_REG_MAP, reg)){
+    console.print("write: 0x%02X is read only\n", (unsigned) reg);
+    return;
+  }
+  console.queued(console._comm->write(reg, value, console.make_tag(TAG_WRITE, 0)));
+}
+
+void xy_console::cmd_preset(xy_console &console, uint8_t argc, char **argv){
+  uint32_t num = 0;
+  if (argc > 1 && (!parse_number(argv[1], num) || num >= PRESET_COUNT)){
+    console.print("preset: 0..%u\n", PRESET_COUNT - 1);
+    return;
+  }
+
+  // without a number all of them, one read each
+  uint8_t first = argc > 1 ? num : 0;
+  uint8_t last = argc > 1 ? num : PRESET_COUNT - 1;
+  for (uint8_t n = first; n <= last; n++){
+    if (!console.queued(console._comm->read(HREG_IDX_M0 + (n * HREG_IDX_M_OFFSET), MEM_REGS, console.make_tag(TAG_PRESET, n)))) return;
+  }
+}
+
+void xy_console::cmd_pset(xy_console &console, uint8_t, char **argv){
+  uint32_t num, value;
+  int idx = regmap_find_name(XY_MEM_REG_MAP, argv[2]);
+  if (!parse_number(argv[1], num) || num >= PRESET_COUNT || idx == REG_NOT_FOUND || !parse_number(argv[3], value)){
+    console.print("pset: preset 0..%u, field one of", PRESET_COUNT - 1);
+    for (const tRegDesc &desc : XY_MEM_REG_MAP) console.print(" %s", desc.name);
+    console.print(", raw value\n");
+    return;
+  }
+
+  // 32 bit values are two registers, low word first
+  const tRegDesc &desc = XY_MEM_REG_MAP[idx];
+  uint8_t reg = HREG_IDX_M0 + (num * HREG_IDX_M_OFFSET) + desc.reg;
+  if (desc.width == 1 && value > 0xFFFF){
+    console.print("pset: %s is 16 bit\n", desc.name);
+    return;
+  }
+  if (!console.queued(console._comm->write(reg, value & 0xFFFF, console.make_tag(TAG_WRITE, 0)))) return;
+  if (desc.width == 2) console.queued(console._comm->write(reg + 1, value >> 16, console.make_tag(TAG_WRITE, 0)));
+}
+
+void xy_console::cmd_recall(xy_console &console, uint8_t, char **argv){
+  uint32_t num;
+  if (!parse_number(argv[1], num) || num >= PRESET_COUNT){
+    console.print("recall: 0..%u\n", PRESET_COUNT - 1);
+    return;
+  }
+  console.queued(console._comm->write(HREG_IDX_MEMORY, num, console.make_tag(TAG_WRITE, 0)));
+}
+
+void xy_console::cmd_poll(xy_console &console, uint8_t, char **argv){
+  bool on = strcmp(argv[1], "on") == 0;
+  if (!on && strcmp(argv[1], "off") != 0){
+    console.print("usage: poll on|off\n");
+    return;
+  }
+  if (console.queued(console._comm->set_polling(on))) console.print("polling %s\n", on ? "on" : "off");
+}
+
+void xy_console::cmd_status(xy_console &console, uint8_t, char **){
+  tSnapshot snapshot;
+  if (!console._psu->get_snapshot(snapshot)){
+    console.print("no reply from the device yet\n");
+    return;
+  }
+
+  uint8_t words[60];
+  for (uint8_t reg = 0; reg < 30; reg++){
+    words[reg * 2] = snapshot.regs[reg] >> 8;
+    words[(reg * 2) + 1] = snapshot.regs[reg] & 0xFF;
+  }
+  tTelemetry t = {};
+  regmap_decode(XY_HOLD_REG_MAP, words, 0, 30, t);
+  console.print("out %s%s, %s, set %u.%02u V %u.%02u A\n", t.outputOn ? "on" : "off", console._psu->is_output_inhibited() ? " (tripped)" : "",
+                t.cvcc ? "CC" : "CV", t.setVolt / 100, t.setVolt % 100, t.setCurrent / 100, t.setCurrent % 100);
+  console.print("act %u.%02u V %u.%02u A %u.%u W, in %u.%02u V, protect %u, age %u ms\n", t.actVolt / 100, t.actVolt % 100,
+                t.actCurrent / 100, t.actCurrent % 100, t.actPower / 10, t.actPower % 10, t.inVolt / 100, t.inVolt % 100,
+                t.protect, (unsigned)(millis() - snapshot.timestampMs));
+}
+
+void xy_console::cmd_metrics(xy_console &console, uint8_t argc, char **argv){
+  if (argc > 1 && strcmp(argv[1], "reset") == 0){
+    console._psu->reset_metrics();
+    console.print("metrics reset\n");
+    return;
+  }
+
+  tMetricsSnapshot metrics;
+  console._psu->get_metrics(metrics);
+  static const char *const FUNC_NAMES[METRICS_FUNC_CODES] = {"fc03", "fc06", "fc10"};
+  for (uint8_t fc = 0; fc < METRICS_FUNC_CODES; fc++){
+    const tLatencyHist &hist = metrics.latency[fc];
+    if (!hist.count) continue;
+    console.print("%s %6u txn, p50 %5u us p99 %5u us max %5u us\n", FUNC_NAMES[fc], (unsigned) hist.count,
+                  (unsigned) metrics_percentile(hist, 50), (unsigned) metrics_percentile(hist, 99), (unsigned) hist.maxUs);
+  }
+  for (uint8_t status = TXN_TIMEOUT; status < METRICS_STATUS_COUNT; status++){
+    if (metrics.status[status]) console.print("%s: %u\n", STATUS_NAMES[status], (unsigned) metrics.status[status]);
+  }
+  console.print("tx %u B rx %u B, bus busy %u ms of %u ms\n", (unsigned) metrics.bytesTx, (unsigned) metrics.bytesRx,
+                (unsigned) metrics.busyMs, (unsigned) metrics.windowMs);
+}
+
+void xy_console::cmd_trip(xy_console &console, uint8_t, char **){
+  console.queued(console._comm->trip());
+}
+
+void xy_console::cmd_release(xy_console &console, uint8_t, char **){
+  console.queued(console._comm->release());
+}
+
+void xy_console::cmd_stream(xy_console &console, uint8_t argc, char **argv){
+  if (!console._stream){
+    console.print("stream: none attached\n");
+    return;
+  }
+
+  bool frames = strcmp(argv[1], "frames") == 0;
+  const char *arg = frames ? (argc > 2 ? argv[2] : "") : argv[1];
+  bool on = strcmp(arg, "on") == 0;
+  if (!on && strcmp(arg, "off") != 0){
+    console.print("usage: stream on|off|frames on|off\n");
+    return;
+  }
+
+  if (frames){
+    console._stream->set_frames(on);
+    console.print("raw frames %s\n", on ? "on" : "off");
+  } else {
+    if (on) console.print("binary stream on, 'stream off' returns to text\n");
+    console._stream->set_enabled(on);
+  }
+}
+
+void xy_console::cmd_capture(xy_console &console, uint8_t argc, char **argv){
+  xy_capture *capture = console._capture;
+  if (!capture){
+    console.print("capture: none attached\n");
+    return;
+  }
+
+  uint32_t records;
+  if (strcmp(argv[1], "on") == 0){
+    capture->set_enabled(true);
+  } else if (strcmp(argv[1], "off") == 0){
+    capture->set_enabled(false);
+  } else if (strcmp(argv[1], "clear") == 0){
+    capture->clear();
+  } else if (strcmp(argv[1], "freeze") == 0 && argc > 2 && parse_number(argv[2], records) && records <= 255){
+    capture->freeze_after_error(records);
+    capture->set_enabled(true);
+  } else if (strcmp(argv[1], "dump") == 0){
+    // a ring that keeps moving cannot be listed in order
+    capture->set_enabled(false);
+    console._dump_next = 0;
+    console._dump_end = capture->count();
+    console.print("# %u records: <us> <tx|rx|st> <status> <bytes>\n", console._dump_end);
+    return;
+  } else {
+    console.print("usage: capture on|off|clear|dump|freeze <n>\n");
+    return;
+  }
+
+  tCaptureStats stats;
+  capture->get_stats(stats);
+  console.print("capture %s, %u records held, %u taken, %u overwritten\n", capture->is_enabled() ? "on" : "off",
+                capture->count(), (unsigned) stats.records, (unsigned) stats.overwritten);
+}
@@ -0,0 +1,120 @@
+/**
+ * @file xy_console.h
+ * @brief Line based, non-blocking command console for one xy6020l driven by xy_comm
+ *
+ * poll() takes whatever bytes the port has, assembles a line and dispatches it
+ * through a table of commands once it is terminated by CR or LF. Nothing waits:
+ * bus operations are pushed into the command queue of the comm task and their
+ * results are printed from a later poll(), when they come back through the
+ * result queue. The driver is only read through its lock-free getters (snapshot,
+ * metrics). Output goes into a ring and at most CONSOLE_WRITE_CHUNK bytes are
+ * handed to the port per poll(), so a long listing never fills its tx buffer;
+ * while the ring is short of room, results wait in the result queue.
+ *
+ * With a stream attached, `stream on` turns the port over to the binary
+ * telemetry stream; text output is dropped until `stream off`. With a capture
+ * attached, `capture dump` stops recording and lists the ring a few lines per
+ * poll(), in the text format of xy_capture.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy_console_h
+#define xy_console_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+#include "xy_comm.h"
+
+#define CONSOLE_LINE_MAX        64
+#define CONSOLE_MAX_ARGS        5
+#define CONSOLE_OUT_SIZE        2048
+#define CONSOLE_RESULT_ROOM     800     // free output a result needs before it is taken, a 30 register read prints about that
+#define CONSOLE_WRITE_CHUNK     64      // per poll(), stays below the tx buffer of the port
+#define CONSOLE_READ_CHUNK      64      // input bytes looked at per poll()
+
+class xy_stream;
+class xy_capture;
+
+/**
+ * @class xy_console
+ * @brief Command shell on a Stream, poll() it from loop()
+ */
+class xy_console
+{
+  public:
+    typedef void (*CommandHandler)(xy_console &console, uint8_t argc, char **argv);
+
+    typedef struct {
+        const char *name;
+        const char *usage;
+        uint8_t minArgs;        // without the command name
+        CommandHandler handler;
+    } tCommand;
+
+    xy_console(Stream *io, xy_comm *comm, xy6020l *psu) : _io(io), _comm(comm), _psu(psu) {}
+
+    void set_stream(xy_stream *stream){_stream = stream;}
+    void set_capture(xy_capture *capture){_capture = capture;}
+
+    /**
+     * @brief Reads input, runs complete lines, prints results and writes pending output
+     */
+    void poll();
+
+    /**
+     * @brief Runs one command line as if it was typed
+     */
+    void execute(char *line);
+
+    void print(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+    uint32_t get_dropped_output(){return _dropped_output;}
+
+  private:
+    enum { TAG_READ = 1, TAG_WRITE, TAG_PRESET };
+
+    static const tCommand COMMANDS[];
+
+    static void cmd_help(xy_console &console, uint8_t argc, char **argv);
+    static void cmd_read(xy_console &console, uint8_t argc, char **argv);
+    static void cmd_write(xy_console &console, uint8_t argc, char **argv);
+    static void cmd_preset(xy_console &console, uint8_t argc, char **argv);
+    static void cmd_pset(xy_console &console, uint8_t argc, char **argv);
+    static void cmd_recall(xy_console &console, uint8_t argc, char **argv);
+    static void cmd_poll(xy_console &console, uint8_t argc, char **argv);
+    static void cmd_status(xy_console &console, uint8_t argc, char **argv);
+    static void cmd_metrics(xy_console &console, uint8_t argc, char **argv);
+    static void cmd_trip(xy_console &console, uint8_t argc, char **argv);
+    static void cmd_release(xy_console &console, uint8_t argc, char **argv);
+    static void cmd_stream(xy_console &console, uint8_t argc, char **argv);
+    static void cmd_capture(xy_console &console, uint8_t argc, char **argv);
+
+    uint32_t make_tag(uint8_t kind, uint8_t arg){return kind | (arg << 8) | (++_tag_seq << 16);}
+    bool queued(bool sent);
+    void print_result(const tCommResult &result);
+    void print_value(const tRegDesc &desc, uint32_t raw);
+    void write_out();
+    void dump_capture();
+    bool streaming();
+
+    Stream *_io;
+    xy_comm *_comm;
+    xy6020l *_psu;
+    xy_stream *_stream = nullptr;
+    xy_capture *_capture = nullptr;
+    uint16_t _dump_next = 0;        // capture records still to list
+    uint16_t _dump_end = 0;
+
+    char _line[CONSOLE_LINE_MAX + 1];
+    uint8_t _line_len = 0;
+    bool _line_overflow = false;
+    uint16_t _tag_seq = 0;
+
+    char _out[CONSOLE_OUT_SIZE];
+    uint16_t _out_head = 0;
+    uint16_t _out_len = 0;
+    uint32_t _dropped_output = 0;
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include "xy_discover.h"
+
+// factory default first, then the rates units are most often left at
+static const uint32_t PROBE_ORDER[BAUD_CODE_COUNT] = {115200, 9600, 57600, 38400, 19200, 14400, 56000, 4800, 2400};
+
+typedef struct {
+  volatile TxnStatus status;
+  uint16_t *identity;
+} tProbeCtx;
+
+static void probe_done(const tTxnResult &result, void *ctx){
+  tProbeCtx *probe = (tProbeCtx *) ctx;
+  if (result.status == TXN_OK){
+    for (uint8_t i = 0; i < result.dataLen / 2; i++) probe->identity[i] = (result.data[i * 2] << 8) | result.data[(i * 2) + 1];
+  }
+  probe->status = result.status;
+}
+
+static int8_t baud_code(uint32_t baud){
+  for (uint8_t code = 0; code < BAUD_CODE_COUNT; code++) if (XY_BAUD_RATES[code] == baud) return code;
+  return -1;
+}
+
+// largest rate a unit can be set to below the given one, 0 if there is none
+static uint32_t next_slower(uint32_t baud){
+  uint32_t slower = 0;
+  for (uint8_t code = 0; code < BAUD_CODE_COUNT; code++){
+    if (XY_BAUD_RATES[code] < baud && XY_BAUD_RATES[code] > slower) slower = XY_BAUD_RATES[code];
+  }
+  return slower;
+}
+
+bool xy_discover::set_address_range(uint8_t first, uint8_t last){
+  if (first == 0 || last > 247 || first > last) return false;
+  _first_address = first;
+  _last_address = last;
+  return true;
+}
+
+bool xy_discover::use_baud(uint32_t baud, tDiscoverReport &report){
+  if (baud == _port_baud) return true;
+  if (!_set_port_baud(baud, _ctx)) return false;
+  _psu->begin(baud);
+  _port_baud = baud;
+  report.baudSwitches++;
+  return true;
+}
+
+TxnStatus xy_discover::probe(uint8_t address, uint32_t baud, uint16_t *identity, tDiscoverReport &report){
+  if (!use_baud(baud, report) || !_psu->set_target_address(address)) return TXN_TX_ERROR;
+
+  TxnStatus status = TXN_TIMEOUT;
+  for (uint8_t tries = 0; tries < DISCOVER_PROBE_TRIES; tries++){
+    // the backed off deadline of the last empty address would stretch every probe after it
+    _psu->set_rto_us(DISCOVER_PROBE_RTO_US);
+    tProbeCtx probe = {TXN_PENDING, identity};
+    report.probes++;
+    if (!_psu->submit_read(HREG_IDX_MODEL, 4, probe_done, &probe)) return TXN_TX_ERROR;
+    while (probe.status == TXN_PENDING){
+      _psu->process();
+      if (probe.status == TXN_PENDING) vTaskDelay(1);
+    }
+
+    status = probe.status;
+    // an XY reports the address it answers at, anything else only looks like one
+    if (status == TXN_OK && identity[2] != address) status = TXN_BAD_FRAME;
+    // silence means nobody is there, only a garbled answer is worth another try
+    if (status == TXN_OK || status == TXN_TIMEOUT || status == TXN_EXCEPTION) break;
+  }
+  return status;
+}
+
+void xy_discover::select(const tDiscovered &device, tDiscoverReport &report){
+  use_baud(device.baud, report);
+  _psu->set_target_address(device.address);
+}
+
+bool xy_discover::scan(tDiscoverReport &report){
+  report = {};
+  uint32_t start = millis();
+  // an empty scan hands the link back as it was, a unit powered on later is found there
+  uint32_t prior_baud = _psu->get_link_baud();
+  uint8_t prior_address = _psu->get_slave_address();
+
+  bool done = false;
+  for (uint8_t i = 0; i < BAUD_CODE_COUNT && !done; i++){
+    uint32_t baud = PROBE_ORDER[i];
+    if (!use_baud(baud, report)) continue;
+
+    for (uint16_t address = _first_address; address <= _last_address && !done; address++){
+      // one address answers at one rate, a unit found before is not probed again
+      bool known = false;
+      for (uint8_t n = 0; n < report.count; n++) known |= report.devices[n].address == address;
+      if (known) continue;
+
+      uint16_t identity[4];
+      if (probe(address, baud, identity, report) != TXN_OK) continue;
+      tDiscovered &device = report.devices[report.count++];
+      device = {(uint8_t) address, identity[0], identity[1], baud, baud, millis() - start, 0};
+      done = report.count == DISCOVER_MAX_DEVICES || (_expected && report.count >= _expected);
+    }
+  }
+
+  report.scanMs = millis() - start;
+  _psu->set_rto_us(RTO_INITIAL_US);
+  if (report.count){
+    select(report.devices[0], report);
+  } else {
+    use_baud(prior_baud, report);
+    _psu->set_target_address(prior_address);
+  }
+  return report.count > 0;
+}
+
+bool xy_discover::verify(const tDiscovered &device){
+  tSnapshot snap;
+  for (uint8_t i = 0; i < DISCOVER_VERIFY_READS; i++){
+    _psu->set_rto_us(DISCOVER_PROBE_RTO_US);
+    if (!_psu->get_all_hold_regs() || !_psu->get_snapshot(snap)) return false;
+    if (snap.regs[HREG_IDX_MODEL] != device.model || snap.regs[HREG_IDX_SLAVE_ADD] != device.address) return false;
+  }
+  return true;
+}
+
+bool xy_discover::locate(tDiscovered &device, tDiscoverReport &report){
+  uint16_t identity[4];
+  for (uint8_t i = 0; i < BAUD_CODE_COUNT; i++){
+    if (probe(device.address, PROBE_ORDER[i], identity, report) == TXN_OK){
+      device.baud = PROBE_ORDER[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+bool xy_discover::move(tDiscovered &device, uint32_t baud, tDiscoverReport &report){
+  int8_t code = baud_code(baud), old_code = baud_code(device.baud);
+  if (code < 0 || old_code < 0) return true;
+
+  // the unit must not be sent somewhere the port cannot follow
+  bool port_ok = use_baud(baud, report);
+  select(device, report);
+  if (!port_ok) return true;
+
+  // the acknowledge comes at the old rate, if it is lost the unit may have switched anyway
+  _psu->set_rto_us(DISCOVER_PROBE_RTO_US);
+  _psu->set_baudrate(code);
+  delay(DISCOVER_SETTLE_MS);
+  use_baud(baud, report);
+  if (verify(device)){
+    device.baud = baud;
+    return true;
+  }
+
+  // the unit listens at the new rate even if its replies do not make it back
+  _psu->set_rto_us(DISCOVER_PROBE_RTO_US);
+  _psu->set_baudrate(old_code);
+  delay(DISCOVER_SETTLE_MS);
+  uint16_t identity[4];
+  if (probe(device.address, device.baud, identity, report) == TXN_OK) return true;
+  return locate(device, report);
+}
+
+bool xy_discover::upgrade(tDiscoverReport &report){
+  uint32_t start = millis();
+  bool ok = true;
+
+  for (uint8_t n = 0; n < report.count; n++){
+    tDiscovered &device = report.devices[n];
+    for (uint32_t baud = next_slower(_max_baud + 1); baud > device.baud; baud = next_slower(baud)){
+      if (!move(device, baud, report)){
+        ok = false;
+        break;
+      }
+      if (device.baud == baud) break;
+      device.rejectedRates++;
+    }
+  }
+
+  report.upgradeMs = millis() - start;
+  _psu->set_rto_us(RTO_INITIAL_US);
+  if (report.count) select(report.devices[0], report);
+  return ok;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file xy_discover.h
+ * @brief Finds XY6020L units of unknown baud rate and address, and moves them to the fastest link
+ *
+ * scan() probes every candidate rate, fastest and factory default first, and at
+ * each rate every address of the range. The baud switch is the slow part, so all
+ * addresses are probed at one rate before the next. A probe is one read of
+ * MODEL, VERSION, SLAVE_ADD and BAUDRATE, 21 bytes on the wire, with a fixed
+ * turnaround allowance instead of the backed off reply deadline of the driver,
+ * so an empty address costs its wire time plus DISCOVER_PROBE_RTO_US at every
+ * rate. A reply that echoes the probed address in SLAVE_ADD identifies a unit,
+ * a garbled one is probed again.
+ *
+ * upgrade() writes a faster rate code to a unit at its old rate, follows it and
+ * verifies with full block reads. If they fail, the old code goes back and the
+ * next slower rate is tried; a unit that answers at neither is searched for again.
+ *
+ * Both block and drive the driver themselves: call them from setup() before
+ * polling or the comm task start. Each instance only touches its own driver and
+ * port, scans of separate UARTs can run in parallel tasks.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy_discover_h
+#define xy_discover_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+
+#define DISCOVER_MAX_DEVICES      8
+#define DISCOVER_LAST_ADDRESS     8         // default address range 1..8, the units a bus carries
+#define DISCOVER_PROBE_RTO_US     15000     // turnaround allowed to a probe, an XY answers within a few ms
+#define DISCOVER_PROBE_TRIES      3         // for replies that arrive garbled, silence is not retried
+#define DISCOVER_VERIFY_READS     4         // full block reads a new rate has to pass
+#define DISCOVER_SETTLE_MS        5         // time a unit takes to reopen its UART after a rate change
+
+/**
+ * @brief Switches the host side UART to baud, i.e. HardwareSerial::updateBaudRate
+ * @return false if the port cannot run at that rate
+ */
+typedef bool (*BaudCallback)(uint32_t baud, void *ctx);
+
+typedef struct {
+    uint8_t address;
+    uint16_t model;
+    uint16_t fwVersion;
+    uint32_t foundBaud;         // rate the unit answered at
+    uint32_t baud;              // rate after upgrade()
+    uint32_t foundMs;           // since the start of the scan
+    uint8_t rejectedRates;      // faster rates that failed verification
+} tDiscovered;
+
+typedef struct {
+    tDiscovered devices[DISCOVER_MAX_DEVICES];
+    uint8_t count;
+    uint16_t probes;
+    uint8_t baudSwitches;
+    uint32_t scanMs;
+    uint32_t upgradeMs;
+} tDiscoverReport;
+
+/**
+ * @class xy_discover
+ * @brief Baud rate and address discovery for the units behind one serial port
+ */
+class xy_discover
+{
+  public:
+    xy_discover(xy6020l *psu, BaudCallback set_port_baud, void *ctx = nullptr) : _psu(psu), _set_port_baud(set_port_baud), _ctx(ctx) {}
+
+    /**
+     * @brief Limits the probed addresses, 1..247
+     */
+    bool set_address_range(uint8_t first, uint8_t last);
+    /**
+     * @brief The scan ends once this many units answered, 0 probes every rate and address
+     */
+    void set_expected(uint8_t count){_expected = count;}
+    /**
+     * @brief Fastest rate upgrade() may choose, i.e. lower for long cables
+     */
+    void set_max_baud(uint32_t baud){_max_baud = baud;}
+
+    /**
+     * @brief Probes all rates and addresses until the expected units answered
+     * The driver is left talking to the first unit found, at its rate. Without one it gets the rate
+     * and address it had before the scan back.
+     * @return true if at least one unit answered
+     */
+    bool scan(tDiscoverReport &report);
+
+    /**
+     * @brief Moves every unit of the report to the fastest rate it passes verification at
+     * The driver is left talking to the first unit at its new rate.
+     * @return false if a unit was lost, the report then holds the rate it was last heard at
+     */
+    bool upgrade(tDiscoverReport &report);
+
+  private:
+    bool use_baud(uint32_t baud, tDiscoverReport &report);
+    TxnStatus probe(uint8_t address, uint32_t baud, uint16_t *identity, tDiscoverReport &report);
+    bool verify(const tDiscovered &device);
+    bool move(tDiscovered &device, uint32_t baud, tDiscoverReport &report);
+    bool locate(tDiscovered &device, tDiscoverReport &report);
+    void select(const tDiscovered &device, tDiscoverReport &report);
+
+    xy6020l *_psu;
+    BaudCallback _set_port_baud;
+    void *_ctx;
+    uint8_t _first_address = 1;
+    uint8_t _last_address = DISCOVER_LAST_ADDRESS;
+    uint8_t _expected = 1;
+    uint32_t _max_baud = 115200;
+    uint32_t _port_baud = 0;
+};
+
+#endif
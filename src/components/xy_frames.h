@@ -0,0 +1,49 @@
+/**
+ * @file xy_frames.h
+ * @brief Modbus RTU request frames with their CRC, built at compile time or once at runtime
+ *
+ * FC 0x03 reads and FC 0x06 writes are always 8 bytes: address, function code,
+ * two 16 bit fields and the CRC. When all fields are known the whole frame is a
+ * constant, so the builders are constexpr; the same functions fill the runtime
+ * cache of the driver when only the slave address is known late.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy_frames_h
+#define xy_frames_h
+
+#include <stdint.h>
+#include "crc16.h"
+
+#define REQUEST_FRAME_LEN   8
+
+typedef struct {
+    uint8_t bytes[REQUEST_FRAME_LEN];
+} tRequestFrame;
+
+constexpr tRequestFrame make_request_frame(uint8_t addr, uint8_t func_code, uint16_t field1, uint16_t field2){
+  tRequestFrame frame = {{addr, func_code, (uint8_t)(field1 >> 8), (uint8_t)(field1 & 0xFF),
+                          (uint8_t)(field2 >> 8), (uint8_t)(field2 & 0xFF), 0, 0}};
+  uint16_t crc = crc16_calc(frame.bytes, REQUEST_FRAME_LEN - 2);
+  frame.bytes[6] = crc & 0xFF;
+  frame.bytes[7] = crc >> 8;
+  return frame;
+}
+
+// FC 0x03, read count holding registers from start_reg
+constexpr tRequestFrame make_read_frame(uint8_t addr, uint16_t start_reg, uint16_t count){
+  return make_request_frame(addr, 0x03, start_reg, count);
+}
+
+// FC 0x06, write one holding register
+constexpr tRequestFrame make_write_single_frame(uint8_t addr, uint16_t reg, uint16_t value){
+  return make_request_frame(addr, 0x06, reg, value);
+}
+
+constexpr bool request_frame_intact(const tRequestFrame &frame){
+  return crc16_calc(frame.bytes, REQUEST_FRAME_LEN) == 0;
+}
+
+#endif
@@ -0,0 +1,367 @@
+#include "xy_gateway.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define MBAP_HEADER_LEN   7   // transaction, protocol, length, unit
+#define MB_FC_READ        0x03
+#define MB_FC_WRITE       0x06
+#define MB_FC_WRITE_MULTI 0x10
+
+static inline uint16_t get_be16(const uint8_t *p){
+  return (p[0] << 8) | p[1];
+}
+
+static inline void put_be16(uint8_t *p, uint16_t value){
+  p[0] = value >> 8;
+  p[1] = value & 0xFF;
+}
+
+static void set_non_blocking(int fd){
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+bool xy_gateway::begin(uint16_t port){
+  end();
+  for (uint8_t i = 0; i < GATEWAY_MAX_CLIENTS; i++){
+    _clients[i].fd = -1;
+    _clients[i].rxLen = 0;
+    _clients[i].generation = 0;
+  }
+  for (uint8_t i = 0; i < GATEWAY_MAX_REQUESTS; i++) _requests[i].used = false;
+  for (uint8_t i = 0; i < GATEWAY_MAX_INFLIGHT; i++) _inflight[i].state.store(SLOT_FREE);
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return false;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  socklen_t len = sizeof(addr);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, GATEWAY_MAX_CLIENTS) != 0 ||
+      getsockname(fd, (struct sockaddr *)&addr, &len) != 0){
+    close(fd);
+    return false;
+  }
+  set_non_blocking(fd);
+  _listen_fd = fd;
+  _port = ntohs(addr.sin_port);  // the one picked by the stack for port 0
+  return true;
+}
+
+void xy_gateway::end(){
+  if (_listen_fd < 0) return;
+  for (uint8_t i = 0; i < GATEWAY_MAX_CLIENTS; i++) drop_client(i);
+  close(_listen_fd);
+  _listen_fd = -1;
+
+  // transactions still queued in the driver point at _inflight, let them finish
+  for (uint8_t i = 0; i < GATEWAY_MAX_INFLIGHT; i++){
+    while (_inflight[i].state.load(std::memory_order_acquire) == SLOT_SUBMITTED) delay(1);
+  }
+}
+
+uint8_t xy_gateway::get_client_count(){
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < GATEWAY_MAX_CLIENTS; i++) if (_clients[i].fd >= 0) count++;
+  return count;
+}
+
+void xy_gateway::poll(uint32_t wait_ms){
+  if (_listen_fd < 0) return;
+
+  answer_inflight();
+  submit_inflight();
+
+  // answers come from another task, so do not sleep long while the bus works for us
+  for (uint8_t i = 0; i < GATEWAY_MAX_INFLIGHT; i++){
+    if (_inflight[i].state.load(std::memory_order_relaxed) != SLOT_FREE && wait_ms > 1) wait_ms = 1;
+  }
+
+  fd_set readable;
+  FD_ZERO(&readable);
+  FD_SET(_listen_fd, &readable);
+  int max_fd = _listen_fd;
+  for (uint8_t i = 0; i < GATEWAY_MAX_CLIENTS; i++){
+    if (_clients[i].fd < 0) continue;
+    FD_SET(_clients[i].fd, &readable);
+    if (_clients[i].fd > max_fd) max_fd = _clients[i].fd;
+  }
+  struct timeval tv = {(time_t)(wait_ms / 1000), (suseconds_t)((wait_ms % 1000) * 1000)};
+  if (select(max_fd + 1, &readable, nullptr, nullptr, &tv) <= 0) return;
+
+  if (FD_ISSET(_listen_fd, &readable)) accept_clients();
+  for (uint8_t i = 0; i < GATEWAY_MAX_CLIENTS; i++){
+    if (_clients[i].fd >= 0 && FD_ISSET(_clients[i].fd, &readable) && !read_client(i)) drop_client(i);
+  }
+
+  answer_inflight();  // reads that merged into one completing meanwhile
+  submit_inflight();
+}
+
+void xy_gateway::accept_clients(){
+  while (true){
+    int fd = accept(_listen_fd, nullptr, nullptr);
+    if (fd < 0) return;
+
+    int8_t slot = -1;
+    for (uint8_t i = 0; i < GATEWAY_MAX_CLIENTS && slot < 0; i++) if (_clients[i].fd < 0) slot = i;
+    if (slot < 0){
+      _stats.rejectedConnections++;
+      close(fd);
+      continue;
+    }
+
+    set_non_blocking(fd);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));  // replies are tiny, Nagle would hold them
+    _clients[slot].fd = fd;
+    _clients[slot].rxLen = 0;
+    _stats.connections++;
+  }
+}
+
+bool xy_gateway::read_client(uint8_t id){
+  tClient &client = _clients[id];
+
+  ssize_t n = recv(client.fd, client.rx + client.rxLen, sizeof(client.rx) - client.rxLen, 0);
+  if (n == 0) return false;
+  if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  client.rxLen += n;
+
+  // clients may pipeline, take every complete ADU in the buffer
+  while (client.fd >= 0 && client.rxLen >= MBAP_HEADER_LEN){
+    uint16_t protocol = get_be16(client.rx + 2);
+    uint16_t length = get_be16(client.rx + 4);
+    if (protocol != 0 || length < 2 || length > GATEWAY_ADU_MAX - 6){
+      _stats.protocolErrors++;
+      return false;
+    }
+    uint16_t adu_len = 6 + length;
+    if (client.rxLen < adu_len) break;
+
+    handle_adu(id, client.rx, adu_len);
+    if (client.fd < 0) break;  // dropped while answering
+    client.rxLen -= adu_len;
+    memmove(client.rx, client.rx + adu_len, client.rxLen);
+  }
+  return client.fd >= 0;
+}
+
+void xy_gateway::drop_client(uint8_t id){
+  if (_clients[id].fd < 0) return;
+  close(_clients[id].fd);
+  _clients[id].fd = -1;
+  _clients[id].rxLen = 0;
+  _clients[id].generation++;  // answers still on their way are thrown away
+}
+
+void xy_gateway::handle_adu(uint8_t id, const uint8_t *adu, uint16_t len){
+  uint16_t transaction = get_be16(adu);
+  uint8_t unit = adu[6];
+  const uint8_t *pdu = adu + MBAP_HEADER_LEN;
+  uint16_t pdu_len = len - MBAP_HEADER_LEN;
+  uint8_t func = pdu[0];
+  _stats.requests++;
+
+  uint16_t start = pdu_len >= 5 ? get_be16(pdu + 1) : 0;
+  uint16_t count = 0;
+  const uint8_t *values = nullptr;
+  switch (func){
+    case MB_FC_READ:
+      if (pdu_len != 5) return send_exception(id, transaction, unit, func, MB_EX_ILLEGAL_DATA_VALUE);
+      count = get_be16(pdu + 3);
+      if (count == 0 || count > GATEWAY_MAX_READ) return send_exception(id, transaction, unit, func, MB_EX_ILLEGAL_DATA_VALUE);
+      if (serve_from_snapshot(id, adu, start, count)) return;
+      break;
+
+    case MB_FC_WRITE:
+      if (pdu_len != 5) return send_exception(id, transaction, unit, func, MB_EX_ILLEGAL_DATA_VALUE);
+      count = 1;
+      values = pdu + 3;
+      break;
+
+    case MB_FC_WRITE_MULTI:
+      if (pdu_len < 6) return send_exception(id, transaction, unit, func, MB_EX_ILLEGAL_DATA_VALUE);
+      count = get_be16(pdu + 3);
+      if (count == 0 || count > GATEWAY_MAX_WRITE || pdu[5] != count * 2 || pdu_len != 6 + count * 2){
+        return send_exception(id, transaction, unit, func, MB_EX_ILLEGAL_DATA_VALUE);
+      }
+      values = pdu + 6;
+      break;
+
+    default:
+      return send_exception(id, transaction, unit, func, MB_EX_ILLEGAL_FUNCTION);
+  }
+
+  int8_t request = -1;
+  for (uint8_t i = 0; i < GATEWAY_MAX_REQUESTS && request < 0; i++) if (!_requests[i].used) request = i;
+  if (request < 0) return send_exception(id, transaction, unit, func, MB_EX_BUSY);
+
+  int8_t slot = func == MB_FC_READ ? find_inflight(start, count) : -1;
+  if (slot >= 0){
+    _stats.merged++;
+  } else {
+    slot = new_inflight(func, start, count, values);
+    if (slot < 0) return send_exception(id, transaction, unit, func, MB_EX_BUSY);
+  }
+
+  tRequest &req = _requests[request];
+  req.used = true;
+  req.client = id;
+  req.generation = _clients[id].generation;
+  req.transaction = transaction;
+  req.unit = unit;
+  req.inflight = slot;
+}
+
+bool xy_gateway::serve_from_snapshot(uint8_t id, const uint8_t *adu, uint16_t start, uint16_t count){
+  if (_max_age_ms == 0 || start + count > 30) return false;
+  for (uint16_t reg = start; reg < start + count; reg++){
+    if (_psu->get_reg_age(reg) > _max_age_ms) return false;
+  }
+
+  tSnapshot snap;
+  if (!_psu->get_snapshot(snap)) return false;
+
+  uint8_t pdu[2 + GATEWAY_MAX_READ * 2];
+  pdu[0] = MB_FC_READ;
+  pdu[1] = count * 2;
+  for (uint16_t i = 0; i < count; i++) put_be16(pdu + 2 + (i * 2), snap.regs[start + i]);
+  _stats.cacheHits++;
+  send_reply(id, get_be16(adu), adu[6], pdu, 2 + count * 2);
+  return true;
+}
+
+int8_t xy_gateway::find_inflight(uint16_t start, uint16_t count){
+  for (uint8_t i = 0; i < GATEWAY_MAX_INFLIGHT; i++){
+    tInflight &slot = _inflight[i];
+    uint8_t state = slot.state.load(std::memory_order_acquire);
+    // a read that completed already may be older than the request, only join it while it is pending
+    if ((state == SLOT_QUEUED || state == SLOT_SUBMITTED) && slot.funcCode == MB_FC_READ && slot.start == start && slot.count == count){
+      return i;
+    }
+  }
+  return -1;
+}
+
+int8_t xy_gateway::new_inflight(uint8_t func, uint16_t start, uint16_t count, const uint8_t *values){
+  for (uint8_t i = 0; i < GATEWAY_MAX_INFLIGHT; i++){
+    tInflight &slot = _inflight[i];
+    if (slot.state.load(std::memory_order_acquire) != SLOT_FREE) continue;
+    slot.gateway = this;
+    slot.funcCode = func;
+    slot.start = start;
+    slot.count = count;
+    if (values) memcpy(slot.values, values, count * 2);
+    slot.status = TXN_PENDING;
+    slot.exception = 0;
+    slot.state.store(SLOT_QUEUED, std::memory_order_release);
+    return i;
+  }
+  return -1;
+}
+
+void xy_gateway::submit_inflight(){
+  for (uint8_t i = 0; i < GATEWAY_MAX_INFLIGHT; i++){
+    tInflight &slot = _inflight[i];
+    if (slot.state.load(std::memory_order_acquire) != SLOT_QUEUED) continue;
+
+    // submitted first, the callback may run in the comm task before submit returns
+    slot.state.store(SLOT_SUBMITTED, std::memory_order_release);
+    bool queued;
+    switch (slot.funcCode){
+      case MB_FC_READ:  queued = _psu->submit_read(slot.start, slot.count, txn_done, &slot); break;
+      case MB_FC_WRITE: queued = _psu->submit_write_single(slot.start, get_be16(slot.values), txn_done, &slot); break;
+      default:          queued = _psu->submit_write_multiple(slot.start, slot.count, slot.values, txn_done, &slot); break;
+    }
+    if (queued){
+      if (slot.funcCode == MB_FC_READ) _stats.rtuReads++;
+      else _stats.rtuWrites++;
+      continue;
+    }
+
+    if (_psu->get_pending_transactions() >= TXN_QUEUE_SIZE - 1){
+      slot.state.store(SLOT_QUEUED, std::memory_order_release);  // queue full, try again on the next poll
+      return;
+    }
+    // refused although there was room, an output enable while the guard inhibits it
+    slot.status = TXN_EXCEPTION;
+    slot.exception = MB_EX_DEVICE_FAILURE;
+    slot.state.store(SLOT_DONE, std::memory_order_release);
+  }
+}
+
+void xy_gateway::txn_done(const tTxnResult &result, void *ctx){
+  tInflight *slot = (tInflight *)ctx;
+  slot->status = result.status;
+  slot->exception = result.exception;
+  if (result.status == TXN_OK && result.funcCode == MB_FC_READ && result.data && result.dataLen <= sizeof(slot->data)){
+    memcpy(slot->data, result.data, result.dataLen);
+  }
+  slot->state.store(SLOT_DONE, std::memory_order_release);
+}
+
+void xy_gateway::answer_inflight(){
+  for (uint8_t i = 0; i < GATEWAY_MAX_INFLIGHT; i++){
+    tInflight &slot = _inflight[i];
+    if (slot.state.load(std::memory_order_acquire) != SLOT_DONE) continue;
+
+    uint8_t pdu[2 + GATEWAY_MAX_READ * 2];
+    uint16_t pdu_len;
+    pdu[0] = slot.funcCode;
+    if (slot.funcCode == MB_FC_READ){
+      pdu[1] = slot.count * 2;
+      memcpy(pdu + 2, slot.data, slot.count * 2);
+      pdu_len = 2 + slot.count * 2;
+    } else {
+      // both writes echo the address and the value (0x06) or the count (0x10)
+      put_be16(pdu + 1, slot.start);
+      if (slot.funcCode == MB_FC_WRITE) memcpy(pdu + 3, slot.values, 2);
+      else put_be16(pdu + 3, slot.count);
+      pdu_len = 5;
+    }
+    uint8_t exception = 0;
+    if (slot.status == TXN_EXCEPTION) exception = slot.exception ? slot.exception : MB_EX_DEVICE_FAILURE;
+    else if (slot.status != TXN_OK) exception = MB_EX_TARGET_NO_RESPONSE;
+
+    for (uint8_t r = 0; r < GATEWAY_MAX_REQUESTS; r++){
+      tRequest &req = _requests[r];
+      if (!req.used || req.inflight != i) continue;
+      req.used = false;
+      if (_clients[req.client].fd < 0 || _clients[req.client].generation != req.generation) continue;
+      if (exception) send_exception(req.client, req.transaction, req.unit, slot.funcCode, exception);
+      else send_reply(req.client, req.transaction, req.unit, pdu, pdu_len);
+    }
+    slot.state.store(SLOT_FREE, std::memory_order_release);
+  }
+}
+
+void xy_gateway::send_reply(uint8_t id, uint16_t transaction, uint8_t unit, const uint8_t *pdu, uint16_t len){
+  tClient &client = _clients[id];
+  if (client.fd < 0) return;
+
+  uint8_t adu[GATEWAY_ADU_MAX];
+  put_be16(adu, transaction);
+  put_be16(adu + 2, 0);
+  put_be16(adu + 4, len + 1);
+  adu[6] = unit;
+  memcpy(adu + MBAP_HEADER_LEN, pdu, len);
+
+  // a client that does not read its answers until the socket buffer is full is not worth waiting for
+  ssize_t n = send(client.fd, adu, MBAP_HEADER_LEN + len, MSG_NOSIGNAL);
+  if (n != MBAP_HEADER_LEN + len) drop_client(id);
+}
+
+void xy_gateway::send_exception(uint8_t id, uint16_t transaction, uint8_t unit, uint8_t func, uint8_t code){
+  uint8_t pdu[2] = {(uint8_t)(func | 0x80), code};
+  _stats.exceptions++;
+  send_reply(id, transaction, unit, pdu, sizeof(pdu));
+}
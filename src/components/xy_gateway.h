@@ -0,0 +1,154 @@
+/**
+ * @file xy_gateway.h
+ * @brief Modbus TCP server in front of one xy6020l, many clients on one RTU bus
+ *
+ * Clients speak Modbus TCP (MBAP header, FC 0x03, 0x06 and 0x10) to a plain BSD
+ * socket server, lwIP on the ESP32 and the host stack elsewhere. Their requests
+ * reach the bus as little as possible:
+ *
+ *  - a read of holding registers that were all read from the device within
+ *    max_age_ms is answered from the driver snapshot without bus traffic;
+ *  - a read that has to go to the device joins an identical read (same start
+ *    and count) that is already queued or on the wire, one RTU transaction then
+ *    answers every client waiting on it;
+ *  - writes are queued through the driver like any other write and answered
+ *    once the device acknowledged them.
+ *
+ * poll() does all socket work without blocking and never calls process();
+ * whichever task drives the device (comm task, loop()) completes the RTU
+ * transactions, and the next poll() sends the answers. Bus errors become
+ * exception 0x0B (gateway target failed to respond), device exceptions are
+ * passed on.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy_gateway_h
+#define xy_gateway_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+#include <atomic>
+
+#ifndef GATEWAY_MAX_CLIENTS
+#define GATEWAY_MAX_CLIENTS     4       // lwIP has 10 sockets by default
+#endif
+#define GATEWAY_MAX_REQUESTS    16      // client requests waiting on the bus, all clients together
+#define GATEWAY_MAX_INFLIGHT    (TXN_QUEUE_SIZE - 1)
+#define GATEWAY_ADU_MAX         260     // MBAP header and the largest PDU
+#define GATEWAY_DEFAULT_AGE_MS  100
+#define GATEWAY_MAX_READ        30      // registers per read, the reply buffer of the driver
+#define GATEWAY_MAX_WRITE       14
+
+// Modbus exception codes sent by the gateway itself
+#define MB_EX_ILLEGAL_FUNCTION      0x01
+#define MB_EX_ILLEGAL_DATA_VALUE    0x03
+#define MB_EX_DEVICE_FAILURE        0x04
+#define MB_EX_BUSY                  0x06
+#define MB_EX_TARGET_NO_RESPONSE    0x0B
+
+typedef struct {
+    uint32_t connections;
+    uint32_t rejectedConnections;   // no free client slot
+    uint32_t requests;
+    uint32_t cacheHits;             // reads answered from the snapshot
+    uint32_t merged;                // reads that joined one already on its way
+    uint32_t rtuReads;
+    uint32_t rtuWrites;
+    uint32_t exceptions;
+    uint32_t protocolErrors;        // malformed MBAP, the client was dropped
+} tGatewayStats;
+
+/**
+ * @class xy_gateway
+ * @brief Modbus TCP to RTU gateway with a snapshot cache and read merging
+ */
+class xy_gateway
+{
+  public:
+    xy_gateway(xy6020l *psu) : _psu(psu) {}
+    ~xy_gateway(){end();}
+
+    /**
+     * @brief Listens on port, all interfaces, port 0 lets the stack pick one (see get_port())
+     * @return false if the socket could not be bound
+     */
+    bool begin(uint16_t port = 502);
+    /**
+     * @brief Closes every socket, waits for transactions still queued in the driver, so keep process() running
+     */
+    void end();
+    uint16_t get_port(){return _port;}
+
+    /**
+     * @brief Registers older than max_age_ms go to the device, 0 sends every read to the bus
+     */
+    void set_max_age(uint32_t max_age_ms){_max_age_ms = max_age_ms;}
+
+    /**
+     * @brief Accepts, reads requests, starts and answers transactions
+     * @param wait_ms how long to wait for socket activity when there is nothing to do
+     */
+    void poll(uint32_t wait_ms = 0);
+
+    void get_stats(tGatewayStats &stats){stats = _stats;}
+    uint8_t get_client_count();
+
+  private:
+    enum { SLOT_FREE, SLOT_QUEUED, SLOT_SUBMITTED, SLOT_DONE };
+
+    typedef struct {
+        int fd;                 // -1 for a free slot
+        uint16_t generation;    // tells answers for a dropped client from the current one
+        uint8_t rx[GATEWAY_ADU_MAX];
+        uint16_t rxLen;
+    } tClient;
+
+    typedef struct {
+        std::atomic<uint8_t> state;
+        xy_gateway *gateway;
+        uint8_t funcCode;
+        uint16_t start;
+        uint16_t count;
+        uint8_t values[GATEWAY_MAX_WRITE * 2];  // of a write
+        uint8_t status;                         // TxnStatus once done
+        uint8_t exception;
+        uint8_t data[GATEWAY_MAX_READ * 2];     // of a read
+    } tInflight;
+
+    typedef struct {
+        bool used;
+        uint8_t client;
+        uint16_t generation;
+        uint16_t transaction;
+        uint8_t unit;
+        int8_t inflight;
+    } tRequest;
+
+    static void txn_done(const tTxnResult &result, void *ctx);
+
+    void accept_clients();
+    bool read_client(uint8_t id);
+    void drop_client(uint8_t id);
+    void handle_adu(uint8_t id, const uint8_t *adu, uint16_t len);
+    bool serve_from_snapshot(uint8_t id, const uint8_t *adu, uint16_t start, uint16_t count);
+    int8_t find_inflight(uint16_t start, uint16_t count);
+    int8_t new_inflight(uint8_t func, uint16_t start, uint16_t count, const uint8_t *values);
+    void submit_inflight();
+    void answer_inflight();
+    void send_reply(uint8_t id, uint16_t transaction, uint8_t unit, const uint8_t *pdu, uint16_t len);
+    void send_exception(uint8_t id, uint16_t transaction, uint8_t unit, uint8_t func, uint8_t code);
+
+    xy6020l *_psu;
+    int _listen_fd = -1;
+    uint16_t _port = 0;
+    uint32_t _max_age_ms = GATEWAY_DEFAULT_AGE_MS;
+
+    tClient _clients[GATEWAY_MAX_CLIENTS];
+    tRequest _requests[GATEWAY_MAX_REQUESTS] = {};
+    tInflight _inflight[GATEWAY_MAX_INFLIGHT];
+    tGatewayStats _stats = {};
+};
+
+#endif
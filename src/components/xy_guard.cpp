@@ -0,0 +1,136 @@
+#include "xy_guard.h"
+
+int8_t xy_guard::add_rule(GuardRuleType type, GuardChannel channel, uint32_t limit){
+  if (_state != GUARD_DISARMED || _rule_count >= GUARD_MAX_RULES || type == GUARD_CALLBACK) return -1;
+
+  tGuardRule &rule = _rules[_rule_count];
+  rule.type = type;
+  rule.channel = channel;
+  rule.limit = limit;
+  rule.check = nullptr;
+  rule.ctx = nullptr;
+  return _rule_count++;
+}
+
+int8_t xy_guard::add_check(GuardCheck check, void *ctx){
+  if (_state != GUARD_DISARMED || _rule_count >= GUARD_MAX_RULES || !check) return -1;
+
+  tGuardRule &rule = _rules[_rule_count];
+  rule.type = GUARD_CALLBACK;
+  rule.channel = 0;
+  rule.limit = 0;
+  rule.check = check;
+  rule.ctx = ctx;
+  return _rule_count++;
+}
+
+bool xy_guard::arm(){
+  if (_state == GUARD_TRIPPED) return false;
+  if (_state == GUARD_ARMED) return true;
+
+  _have_last = false;
+  _stats.state = GUARD_ARMED;
+  _stats.tripRule = GUARD_NO_TRIP;
+  _stats_lock.publish(_stats);
+
+  _state = GUARD_ARMED;
+  // a read from the previous arming may still be in flight, its completion carries on
+  return _sampling || submit_sample();
+}
+
+bool xy_guard::rearm(){
+  _psu->release_output();
+  _state = GUARD_DISARMED;
+  return arm();
+}
+
+bool xy_guard::trip(){
+  // measured from the call, there is no violating sample
+  _trip_detect_us = micros();
+  _state = GUARD_TRIPPED;
+  if (!_psu->trip_output(trip_done, this)) return false;
+
+  _stats.state = GUARD_TRIPPED;
+  _stats.tripRule = GUARD_NO_TRIP;
+  _stats_lock.publish(_stats);
+  return true;
+}
+
+bool xy_guard::submit_sample(){
+  _sampling = true;
+  if (_psu->submit_priority_read(HREG_IDX_ACT_V, 3, sample_done, this)) return true;
+  _sampling = false;
+  return false;
+}
+
+int8_t xy_guard::violated(const tGuardSample &sample){
+  for (uint8_t i = 0; i < _rule_count; i++){
+    const tGuardRule &rule = _rules[i];
+    uint16_t value = sample.value[rule.channel];
+
+    switch (rule.type){
+      case GUARD_ABOVE:
+        if (value > rule.limit) return i;
+        break;
+      case GUARD_BELOW:
+        if (value < rule.limit) return i;
+        break;
+      case GUARD_RISE_RATE: {
+        if (!_have_last || value <= _last.value[rule.channel]) break;
+        uint32_t dt = sample.us - _last.us;
+        uint64_t rise = (uint64_t)(value - _last.value[rule.channel]) * 1000000UL;
+        if (dt && rise / dt > rule.limit) return i;
+        break;
+      }
+      case GUARD_CALLBACK:
+        if (rule.check(sample, rule.ctx)) return i;
+        break;
+    }
+  }
+  return GUARD_NO_TRIP;
+}
+
+void xy_guard::sample_done(const tTxnResult &result, void *ctx){
+  xy_guard *self = (xy_guard *) ctx;
+  self->_sampling = false;
+  if (self->_state != GUARD_ARMED) return;
+
+  if (result.status == TXN_OK){
+    tGuardSample sample;
+    sample.us = micros();
+    for (uint8_t ch = 0; ch < 3; ch++) sample.value[ch] = (result.data[ch * 2] << 8) | result.data[(ch * 2) + 1];
+
+    tGuardStats &stats = self->_stats;
+    int8_t rule = self->violated(sample);
+    if (rule != GUARD_NO_TRIP){
+      self->_trip_detect_us = sample.us;
+      self->_state = GUARD_TRIPPED;
+      self->_psu->trip_output(trip_done, self);
+      stats.state = GUARD_TRIPPED;
+      stats.tripRule = rule;
+      stats.tripSample = sample;
+    }
+
+    if (stats.samples == 0) self->_first_sample_us = sample.us;
+    else stats.samplePeriodUs = (sample.us - self->_first_sample_us) / stats.samples;
+    stats.samples++;
+    self->_last = sample;
+    self->_have_last = true;
+    self->_stats_lock.publish(stats);
+  }
+
+  if (self->_state == GUARD_ARMED) self->submit_sample();
+}
+
+void xy_guard::trip_done(const tTxnResult &result, void *ctx){
+  xy_guard *self = (xy_guard *) ctx;
+  tGuardStats &stats = self->_stats;
+  uint32_t now = micros();
+
+  uint32_t detect = self->_trip_detect_us;
+  stats.trips++;
+  stats.lastTripUs = now - detect;
+  stats.lastTripWaitUs = (now - result.latencyUs) - detect;
+  if (stats.lastTripUs > stats.worstTripUs) stats.worstTripUs = stats.lastTripUs;
+  self->_stats_lock.publish(stats);
+}
@@ -0,0 +1,133 @@
+/**
+ * @file xy_guard.h
+ * @brief Software protection: fast V/I/P polling, user rules, output trip
+ *
+ * While armed the guard keeps one priority read of HREG_IDX_ACT_V..ACT_P (3
+ * registers, 11 byte reply) in flight and submits the next one from the
+ * completion of the previous, so the values are sampled as fast as the link
+ * allows; polling reads wait behind it. A read that finds the queue full is
+ * retried by process(). Rules are checked inside that completion, in the task
+ * driving the device, and a violation calls xy6020l::trip_output(): the pre-built OUTPUT_ON = 0 frame goes
+ * out right after the transaction currently on the wire.
+ *
+ * The trip latency is measured from the completion of the violating sample to
+ * the acknowledgement of the trip frame.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy_guard_h
+#define xy_guard_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+#include "seqlock.h"
+
+#define GUARD_MAX_RULES     8
+#define GUARD_NO_TRIP       -1
+
+enum GuardRuleType {
+    GUARD_ABOVE,        // value > limit
+    GUARD_BELOW,        // value < limit
+    GUARD_RISE_RATE,    // rise between two samples > limit per second
+    GUARD_CALLBACK      // check() returns true
+};
+enum GuardChannel { GUARD_VOLT, GUARD_CURRENT, GUARD_POWER };
+enum GuardState { GUARD_DISARMED, GUARD_ARMED, GUARD_TRIPPED };
+
+typedef struct {
+    uint16_t value[3];      // indexed by GuardChannel, raw register values
+    uint32_t us;            // micros() when the reply completed
+} tGuardSample;
+
+typedef bool (*GuardCheck)(const tGuardSample &sample, void *ctx);
+
+typedef struct {
+    uint8_t type;
+    uint8_t channel;
+    uint32_t limit;         // raw units, per second for GUARD_RISE_RATE
+    GuardCheck check;
+    void *ctx;
+} tGuardRule;
+
+typedef struct {
+    uint8_t state;          // GuardState
+    int8_t tripRule;        // index of the rule that tripped, GUARD_NO_TRIP if none
+    uint32_t samples;
+    uint32_t samplePeriodUs;    // average time between two samples
+    uint32_t trips;
+    uint32_t lastTripUs;        // violating sample to trip acknowledged
+    uint32_t worstTripUs;
+    uint32_t lastTripWaitUs;    // violating sample to trip frame on the wire
+    tGuardSample tripSample;
+} tGuardStats;
+
+/**
+ * @class xy_guard
+ * @brief Trips the output of one xy6020l when a rule is violated
+ */
+class xy_guard
+{
+  public:
+    xy_guard(xy6020l *psu) : _psu(psu) {}
+
+    /**
+     * @brief Rules can only be changed while disarmed
+     * @return rule index, -1 if no slot is free or the guard is armed
+     */
+    int8_t add_rule(GuardRuleType type, GuardChannel channel, uint32_t limit);
+    int8_t add_check(GuardCheck check, void *ctx = nullptr);
+    void clear_rules(){if (_state == GUARD_DISARMED) _rule_count = 0;}
+
+    /**
+     * @brief Starts sampling, the first read is queued immediately
+     */
+    bool arm();
+
+    /**
+     * @brief Stops sampling after the read in flight, a trip frame already queued still goes out
+     */
+    void disarm(){_state = GUARD_DISARMED;}
+
+    /**
+     * @brief Leaves the tripped state and allows the output to be switched on again, then arms
+     */
+    bool rearm();
+
+    /**
+     * @brief Trips from outside the rules, i.e. from the task reading an external sensor
+     * Should be called from the task driving the device, like the rules.
+     */
+    bool trip();
+
+    /**
+     * @brief Resubmits the sample read when the queue was full, call it next to xy6020l::process()
+     */
+    void process(){if (_state == GUARD_ARMED && !_sampling) submit_sample();}
+
+    GuardState get_state(){return (GuardState) _state;}
+    void get_stats(tGuardStats &stats){_stats_lock.read(stats);}
+
+  private:
+    static void sample_done(const tTxnResult &result, void *ctx);
+    static void trip_done(const tTxnResult &result, void *ctx);
+    int8_t violated(const tGuardSample &sample);
+    bool submit_sample();
+
+    xy6020l *_psu;
+    tGuardRule _rules[GUARD_MAX_RULES];
+    uint8_t _rule_count = 0;
+    volatile uint8_t _state = GUARD_DISARMED;
+    volatile bool _sampling = false;
+
+    tGuardSample _last = {};
+    bool _have_last = false;
+    uint32_t _first_sample_us = 0;
+    uint32_t _trip_detect_us = 0;
+
+    tGuardStats _stats = {};
+    xy_seqlock<tGuardStats> _stats_lock;
+};
+
+#endif
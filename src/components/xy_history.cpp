@@ -0,0 +1,91 @@
+#include "xy_history.h"
+
+void xy_history::reset(){
+  _raw.reset();
+  _seconds.reset();
+  _minutes.reset();
+  _second_acc.count = 0;
+  _minute_acc.count = 0;
+}
+
+void xy_history::accumulate(tHistAccumulator &acc, uint32_t start_ms, const uint16_t *min, const uint16_t *max, const uint32_t *sum, uint32_t count){
+  if (acc.count == 0){
+    acc.startMs = start_ms;
+    for (uint8_t ch = 0; ch < HISTORY_CHANNELS; ch++){
+      acc.min[ch] = min[ch];
+      acc.max[ch] = max[ch];
+      acc.sum[ch] = 0;
+    }
+  }
+
+  for (uint8_t ch = 0; ch < HISTORY_CHANNELS; ch++){
+    if (min[ch] < acc.min[ch]) acc.min[ch] = min[ch];
+    if (max[ch] > acc.max[ch]) acc.max[ch] = max[ch];
+    acc.sum[ch] += sum[ch];
+  }
+  acc.count += count;
+}
+
+void xy_history::finish(const tHistAccumulator &acc, tHistBucket &bucket){
+  bucket.startMs = acc.startMs;
+  bucket.count = acc.count > UINT16_MAX ? UINT16_MAX : acc.count;
+  for (uint8_t ch = 0; ch < HISTORY_CHANNELS; ch++){
+    bucket.min[ch] = acc.min[ch];
+    bucket.max[ch] = acc.max[ch];
+    bucket.mean[ch] = (acc.sum[ch] + (acc.count / 2)) / acc.count;
+  }
+}
+
+void xy_history::add(uint32_t ms, const uint16_t *values){
+  tHistSample sample;
+  sample.ms = ms;
+  memcpy(sample.value, values, sizeof(sample.value));
+  _raw.push(sample);
+
+  uint32_t second = ms - (ms % 1000);
+  if (_second_acc.count && _second_acc.startMs != second) close_second();
+
+  uint32_t sum[HISTORY_CHANNELS];
+  for (uint8_t ch = 0; ch < HISTORY_CHANNELS; ch++) sum[ch] = values[ch];
+  accumulate(_second_acc, second, values, values, sum, 1);
+}
+
+void xy_history::close_second(){
+  tHistBucket bucket;
+  finish(_second_acc, bucket);
+  _seconds.push(bucket);
+
+  uint32_t minute = _second_acc.startMs - (_second_acc.startMs % 60000);
+  if (_minute_acc.count && _minute_acc.startMs != minute) close_minute();
+  accumulate(_minute_acc, minute, _second_acc.min, _second_acc.max, _second_acc.sum, _second_acc.count);
+
+  _second_acc.count = 0;
+}
+
+void xy_history::close_minute(){
+  tHistBucket bucket;
+  finish(_minute_acc, bucket);
+  _minutes.push(bucket);
+  _minute_acc.count = 0;
+}
+
+bool xy_history::get_open_bucket(HistoryResolution resolution, tHistBucket &bucket) const {
+  if (resolution == HIST_RAW) return false;
+
+  if (resolution == HIST_SECOND){
+    if (!_second_acc.count) return false;
+    finish(_second_acc, bucket);
+    return true;
+  }
+
+  // the open minute still lacks the open second
+  tHistAccumulator acc = _minute_acc;
+  if (_second_acc.count){
+    uint32_t minute = _second_acc.startMs - (_second_acc.startMs % 60000);
+    if (acc.count && acc.startMs != minute) acc.count = 0;
+    accumulate(acc, minute, _second_acc.min, _second_acc.max, _second_acc.sum, _second_acc.count);
+  }
+  if (!acc.count) return false;
+  finish(acc, bucket);
+  return true;
+}
@@ -0,0 +1,207 @@
+/**
+ * @file xy_history.h
+ * @brief Fixed size telemetry history at raw, 1 s and 1 min resolution
+ *
+ * Every sample goes into the raw ring and into the open 1 s bucket. When a
+ * sample belongs to the next second the bucket is closed into the seconds ring
+ * and folded into the open 1 min bucket, which is closed the same way. Each
+ * sample costs a constant amount of work and the rings never allocate, the
+ * whole store is HISTORY_RAM_BYTES.
+ *
+ * One task adds samples (the one driving the device); queries from other tasks
+ * get spans pointing into the rings. A span stays valid until the ring wraps
+ * over it, which span_intact() tells after the data was used.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy_history_h
+#define xy_history_h
+
+#include "Arduino.h"
+#include <atomic>
+
+// override with -D to trade history depth for RAM
+#ifndef HISTORY_RAW_LEN
+#define HISTORY_RAW_LEN     256   // 12.8 s at the 20 Hz telemetry poll
+#endif
+#ifndef HISTORY_SECOND_LEN
+#define HISTORY_SECOND_LEN  240   // 4 min
+#endif
+#ifndef HISTORY_MINUTE_LEN
+#define HISTORY_MINUTE_LEN  240   // 4 h
+#endif
+
+#define HISTORY_CHANNELS    5
+
+enum HistoryChannel { HIST_VOLT, HIST_CURRENT, HIST_POWER, HIST_TEMP, HIST_TEMP_EXT };
+enum HistoryResolution { HIST_RAW, HIST_SECOND, HIST_MINUTE };
+
+typedef struct {
+    uint32_t ms;
+    uint16_t value[HISTORY_CHANNELS];
+} tHistSample;
+
+typedef struct {
+    uint32_t startMs;
+    uint16_t count;                   // samples folded into the bucket
+    uint16_t min[HISTORY_CHANNELS];
+    uint16_t max[HISTORY_CHANNELS];
+    uint16_t mean[HISTORY_CHANNELS];
+} tHistBucket;
+
+typedef struct {
+    uint32_t startMs;
+    uint32_t count;
+    uint16_t min[HISTORY_CHANNELS];
+    uint16_t max[HISTORY_CHANNELS];
+    uint32_t sum[HISTORY_CHANNELS];
+} tHistAccumulator;
+
+inline uint32_t history_time(const tHistSample &sample){return sample.ms;}
+inline uint32_t history_time(const tHistBucket &bucket){return bucket.startMs;}
+
+/**
+ * @brief Oldest to newest entries of a query, at most two contiguous pieces of a ring
+ */
+template <typename T>
+struct tHistSpan {
+    const T *first;
+    uint16_t firstLen;
+    const T *second;
+    uint16_t secondLen;
+    uint32_t firstSeq;    // running number of the oldest entry, see span_intact()
+
+    uint16_t size() const {return firstLen + secondLen;}
+    const T &operator[](uint16_t i) const {return i < firstLen ? first[i] : second[i - firstLen];}
+};
+
+template <typename T, uint16_t N>
+class xy_history_ring
+{
+  public:
+    void push(const T &value){
+      _buf[_head] = value;
+      _head = _head + 1 == N ? 0 : _head + 1;
+      _written.store(_written.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    uint16_t size() const {
+      uint32_t written = _written.load(std::memory_order_acquire);
+      return written < N ? written : N;
+    }
+
+    uint32_t written() const {return _written.load(std::memory_order_acquire);}
+
+    void reset(){
+      _head = 0;
+      _written.store(0, std::memory_order_release);
+    }
+
+    /**
+     * @brief Entries with from_ms <= time <= to_ms, found by binary search
+     */
+    tHistSpan<T> range(uint32_t from_ms, uint32_t to_ms) const {
+      tHistSpan<T> span = {_buf, 0, _buf, 0, 0};
+      uint32_t written = _written.load(std::memory_order_acquire);
+      uint16_t count = written < N ? written : N;
+      if (count == 0) return span;
+
+      uint16_t oldest = written < N ? 0 : written % N;
+      // times relative to the oldest entry are monotonic across the millis() wrap
+      uint32_t base = history_time(_buf[oldest]);
+      uint16_t lo = lower_bound(oldest, count, base, (int32_t)(from_ms - base) < 0 ? 0 : from_ms - base, false);
+      uint16_t hi = lower_bound(oldest, count, base, to_ms - base, true);
+      if ((int32_t)(to_ms - base) < 0 || hi <= lo) return span;
+
+      uint16_t start = (oldest + lo) % N;
+      uint16_t len = hi - lo;
+      span.first = &_buf[start];
+      span.firstLen = start + len <= N ? len : N - start;
+      span.secondLen = len - span.firstLen;
+      span.firstSeq = (written - count) + lo;
+      return span;
+    }
+
+    bool intact(uint32_t first_seq) const {
+      // one more slot of margin for a push in progress
+      return first_seq + N > _written.load(std::memory_order_acquire) + 1;
+    }
+
+  private:
+    // first entry with relative time >= key (or > key when upper)
+    uint16_t lower_bound(uint16_t oldest, uint16_t count, uint32_t base, uint32_t key, bool upper) const {
+      uint16_t lo = 0, hi = count;
+      while (lo < hi){
+        uint16_t mid = (lo + hi) / 2;
+        uint32_t t = history_time(_buf[(oldest + mid) % N]) - base;
+        if (upper ? t <= key : t < key) lo = mid + 1;
+        else hi = mid;
+      }
+      return lo;
+    }
+
+    T _buf[N];
+    uint16_t _head = 0;
+    std::atomic<uint32_t> _written{0};
+};
+
+/**
+ * @class xy_history
+ * @brief Telemetry store fed by xy6020l after every read of the actual values
+ */
+class xy_history
+{
+  public:
+    xy_history(){reset();}
+
+    /**
+     * @brief Adds a sample, O(1)
+     * @param values one raw value per HistoryChannel
+     */
+    void add(uint32_t ms, const uint16_t *values);
+
+    tHistSpan<tHistSample> query_raw(uint32_t from_ms, uint32_t to_ms) const {return _raw.range(from_ms, to_ms);}
+
+    /**
+     * @brief Closed buckets starting in [from_ms, to_ms], HIST_SECOND or HIST_MINUTE
+     */
+    tHistSpan<tHistBucket> query(HistoryResolution resolution, uint32_t from_ms, uint32_t to_ms) const {
+      return resolution == HIST_MINUTE ? _minutes.range(from_ms, to_ms) : _seconds.range(from_ms, to_ms);
+    }
+
+    /**
+     * @brief The bucket still collecting samples, false if it is empty
+     * Only from the task that adds samples.
+     */
+    bool get_open_bucket(HistoryResolution resolution, tHistBucket &bucket) const;
+
+    /**
+     * @brief True if none of the entries of span was overwritten since the query
+     */
+    bool span_intact(const tHistSpan<tHistSample> &span) const {return _raw.intact(span.firstSeq);}
+    bool span_intact(HistoryResolution resolution, const tHistSpan<tHistBucket> &span) const {
+      return resolution == HIST_MINUTE ? _minutes.intact(span.firstSeq) : _seconds.intact(span.firstSeq);
+    }
+
+    uint32_t get_sample_count() const {return _raw.written();}
+
+    void reset();
+
+  private:
+    static void accumulate(tHistAccumulator &acc, uint32_t start_ms, const uint16_t *min, const uint16_t *max, const uint32_t *sum, uint32_t count);
+    static void finish(const tHistAccumulator &acc, tHistBucket &bucket);
+    void close_second();
+    void close_minute();
+
+    xy_history_ring<tHistSample, HISTORY_RAW_LEN> _raw;
+    xy_history_ring<tHistBucket, HISTORY_SECOND_LEN> _seconds;
+    xy_history_ring<tHistBucket, HISTORY_MINUTE_LEN> _minutes;
+    tHistAccumulator _second_acc;
+    tHistAccumulator _minute_acc;
+};
+
+#define HISTORY_RAM_BYTES   sizeof(xy_history)
+
+#endif
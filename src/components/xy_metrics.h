@@ -0,0 +1,184 @@
+/**
+ * @file xy_metrics.h
+ * @brief Transaction metrics of an xy6020l: latency histograms, error counters, wire usage
+ *
+ * Transactions are completed by one task at a time (the one driving the device
+ * or holding the bus), so recording is a relaxed load and store per 32 bit
+ * atomic: no locks and no read-modify-write, cheap enough to stay enabled in
+ * production. Any task may take a snapshot or reset them; a transaction
+ * completing during a reset may be half counted.
+ *
+ * Latencies go into log-linear histograms per function code: exact below 4 us,
+ * then four buckets per power of two (at most 25% wide), saturating at about 1 s.
+ *
+ * Define XY6020L_NO_METRICS to compile all of it out, the snapshot then
+ * reports zeros.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy_metrics_h
+#define xy_metrics_h
+
+#include "Arduino.h"
+#include <atomic>
+
+#define METRICS_LATENCY_BUCKETS   80
+#define METRICS_FUNC_CODES        3     // FC 0x03, 0x06, 0x10
+#define METRICS_STATUS_COUNT      8     // TxnStatus values
+#define METRICS_EXCEPTION_COUNT   11    // XY6020L_EXCEPTIONS values, 0 counts unknown codes
+
+enum MetricsFunc { METRICS_FC_READ, METRICS_FC_WRITE_SINGLE, METRICS_FC_WRITE_MULTIPLE };
+
+typedef struct {
+    uint32_t count;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint32_t bucket[METRICS_LATENCY_BUCKETS];
+} tLatencyHist;
+
+typedef struct {
+    tLatencyHist latency[METRICS_FUNC_CODES];
+    uint32_t status[METRICS_STATUS_COUNT];          // indexed by TxnStatus
+    uint32_t exception[METRICS_EXCEPTION_COUNT];    // indexed by exception code
+    uint32_t bytesTx;
+    uint32_t bytesRx;
+    uint32_t busyMs;                                // wire time of requests and replies
+    uint32_t windowMs;                              // time since the last reset
+} tMetricsSnapshot;
+
+inline uint8_t metrics_bucket(uint32_t us){
+  if (us < 4) return us;
+  uint8_t msb = 31 - __builtin_clz(us);
+  uint16_t bucket = ((msb - 1) * 4) + ((us >> (msb - 2)) & 3);
+  return bucket < METRICS_LATENCY_BUCKETS ? bucket : METRICS_LATENCY_BUCKETS - 1;
+}
+
+// smallest latency that falls into the bucket
+inline uint32_t metrics_bucket_floor(uint8_t bucket){
+  if (bucket < 4) return bucket;
+  uint8_t msb = (bucket / 4) + 1;
+  return (uint32_t)(4 + (bucket % 4)) << (msb - 2);
+}
+
+/**
+ * @brief Latency below which pct percent of the transactions completed, from the histogram
+ * @return upper bound of the bucket holding the percentile, 0 without samples
+ */
+inline uint32_t metrics_percentile(const tLatencyHist &hist, uint8_t pct){
+  if (hist.count == 0) return 0;
+  uint32_t target = ((uint64_t) hist.count * pct + 99) / 100;
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < METRICS_LATENCY_BUCKETS; i++){
+    seen += hist.bucket[i];
+    if (seen >= target){
+      uint32_t upper = i + 1 < METRICS_LATENCY_BUCKETS ? metrics_bucket_floor(i + 1) - 1 : hist.maxUs;
+      return upper < hist.maxUs ? upper : hist.maxUs;
+    }
+  }
+  return hist.maxUs;
+}
+
+// share of the window the wire was busy, in 0.1 %
+inline uint16_t metrics_utilization(const tMetricsSnapshot &snapshot){
+  return snapshot.windowMs ? (uint16_t)(((uint64_t) snapshot.busyMs * 1000) / snapshot.windowMs) : 0;
+}
+
+#ifndef XY6020L_NO_METRICS
+
+class xy_metrics
+{
+  public:
+    xy_metrics(){reset();}
+
+    /**
+     * @brief Records a finished transaction, called by the completing task only
+     */
+    void record(uint8_t func, uint8_t status, uint8_t exception, uint32_t latency_us, uint16_t tx_bytes, uint16_t rx_bytes, uint32_t busy_us){
+      add(_status[status < METRICS_STATUS_COUNT ? status : 0], 1);
+      if (exception) add(_exception[exception < METRICS_EXCEPTION_COUNT ? exception : 0], 1);
+      add(_bytes_tx, tx_bytes);
+      add(_bytes_rx, rx_bytes);
+
+      // whole milliseconds are published, the remainder stays with the writer
+      _busy_rem_us += busy_us;
+      if (_busy_rem_us >= 1000){
+        add(_busy_ms, _busy_rem_us / 1000);
+        _busy_rem_us %= 1000;
+      }
+
+      if (func >= METRICS_FUNC_CODES) return;
+      tAtomicHist &hist = _latency[func];
+      add(hist.count, 1);
+      add(hist.bucket[metrics_bucket(latency_us)], 1);
+      if (latency_us < hist.minUs.load(std::memory_order_relaxed)) hist.minUs.store(latency_us, std::memory_order_relaxed);
+      if (latency_us > hist.maxUs.load(std::memory_order_relaxed)) hist.maxUs.store(latency_us, std::memory_order_relaxed);
+    }
+
+    void snapshot(tMetricsSnapshot &out) const {
+      for (uint8_t fc = 0; fc < METRICS_FUNC_CODES; fc++){
+        const tAtomicHist &hist = _latency[fc];
+        out.latency[fc].count = hist.count.load(std::memory_order_relaxed);
+        out.latency[fc].minUs = out.latency[fc].count ? hist.minUs.load(std::memory_order_relaxed) : 0;
+        out.latency[fc].maxUs = hist.maxUs.load(std::memory_order_relaxed);
+        for (uint8_t i = 0; i < METRICS_LATENCY_BUCKETS; i++) out.latency[fc].bucket[i] = hist.bucket[i].load(std::memory_order_relaxed);
+      }
+      for (uint8_t i = 0; i < METRICS_STATUS_COUNT; i++) out.status[i] = _status[i].load(std::memory_order_relaxed);
+      for (uint8_t i = 0; i < METRICS_EXCEPTION_COUNT; i++) out.exception[i] = _exception[i].load(std::memory_order_relaxed);
+      out.bytesTx = _bytes_tx.load(std::memory_order_relaxed);
+      out.bytesRx = _bytes_rx.load(std::memory_order_relaxed);
+      out.busyMs = _busy_ms.load(std::memory_order_relaxed);
+      out.windowMs = millis() - _reset_ms.load(std::memory_order_relaxed);
+    }
+
+    void reset(){
+      for (tAtomicHist &hist : _latency){
+        hist.count.store(0, std::memory_order_relaxed);
+        hist.minUs.store(UINT32_MAX, std::memory_order_relaxed);
+        hist.maxUs.store(0, std::memory_order_relaxed);
+        for (std::atomic<uint32_t> &bucket : hist.bucket) bucket.store(0, std::memory_order_relaxed);
+      }
+      for (std::atomic<uint32_t> &counter : _status) counter.store(0, std::memory_order_relaxed);
+      for (std::atomic<uint32_t> &counter : _exception) counter.store(0, std::memory_order_relaxed);
+      _bytes_tx.store(0, std::memory_order_relaxed);
+      _bytes_rx.store(0, std::memory_order_relaxed);
+      _busy_ms.store(0, std::memory_order_relaxed);
+      _reset_ms.store(millis(), std::memory_order_relaxed);
+    }
+
+  private:
+    static void add(std::atomic<uint32_t> &counter, uint32_t value){
+      counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    typedef struct {
+        std::atomic<uint32_t> count;
+        std::atomic<uint32_t> minUs;
+        std::atomic<uint32_t> maxUs;
+        std::atomic<uint32_t> bucket[METRICS_LATENCY_BUCKETS];
+    } tAtomicHist;
+
+    tAtomicHist _latency[METRICS_FUNC_CODES];
+    std::atomic<uint32_t> _status[METRICS_STATUS_COUNT];
+    std::atomic<uint32_t> _exception[METRICS_EXCEPTION_COUNT];
+    std::atomic<uint32_t> _bytes_tx;
+    std::atomic<uint32_t> _bytes_rx;
+    std::atomic<uint32_t> _busy_ms;
+    std::atomic<uint32_t> _reset_ms;
+    uint32_t _busy_rem_us = 0;
+};
+
+#else
+
+class xy_metrics
+{
+  public:
+    void record(uint8_t, uint8_t, uint8_t, uint32_t, uint16_t, uint16_t, uint32_t){}
+    void snapshot(tMetricsSnapshot &out) const {memset(&out, 0, sizeof(out));}
+    void reset(){}
+};
+
+#endif
+
+#endif
@@ -0,0 +1,127 @@
+#include "xy_persist.h"
+#include <Preferences.h>
+#include <stddef.h>
+
+uint16_t xy_persist::image_crc(const tPersistImage &image){
+  return crc16_calc((const uint8_t *) &image, offsetof(tPersistImage, crc));
+}
+
+bool xy_persist::load(tPersistImage &image){
+  Preferences prefs;
+  if (!prefs.begin(_name, true)) return false;
+  size_t len = prefs.getBytes(PERSIST_KEY, &image, sizeof(image));
+  prefs.end();
+
+  return len == sizeof(image) && image.magic == PERSIST_MAGIC && image.version == PERSIST_VERSION &&
+         image.size == sizeof(image) && image.crc == image_crc(image);
+}
+
+bool xy_persist::restore(tBootReport &report){
+  report = {};
+  uint32_t start = millis();
+
+  tPersistImage image;
+  report.imageValid = load(image);
+  if (report.imageValid){
+    _stored = image;
+    _stored_valid = true;
+  }
+
+  // identity, setpoints and the loaded preset in one frame
+  report.reads++;
+  if (!_psu->get_all_hold_regs()) return false;
+  tSnapshot snap;
+  _psu->get_snapshot(snap);
+  report.identityMatch = report.imageValid && snap.regs[HREG_IDX_MODEL] == image.model && snap.regs[HREG_IDX_VERSION] == image.fwVersion;
+
+  if (report.identityMatch && image.presetValid){
+    // the front panel edits the loaded preset, so that is the one to compare
+    uint8_t check = snap.regs[HREG_IDX_MEMORY];
+    if (check >= PRESET_COUNT || !(image.presetValid & (1 << check))){
+      for (check = 0; !(image.presetValid & (1 << check)); check++);
+    }
+    tMemory preset;
+    preset.num = check;
+    uint8_t words[MEM_REGS * 2];
+    _psu->invalidate_presets(check);
+    report.reads++;
+    if (!_psu->fetch_preset(preset)) return false;
+    report.presetsTrusted = _psu->get_preset_words(check, words) && memcmp(words, image.presets[check], sizeof(words)) == 0;
+
+    for (uint8_t num = 0; report.presetsTrusted && num < PRESET_COUNT; num++){
+      if (num == check || !(image.presetValid & (1 << num))) continue;
+      _psu->restore_preset(num, image.presets[num]);
+      report.presetsRestored++;
+    }
+  }
+  if (!report.presetsTrusted){
+    report.reads += (PRESET_COUNT + 1) / 2;
+    if (!_psu->load_presets()) return false;
+  }
+
+  // setpoints the device lost or never had, nothing else is written
+  if (report.identityMatch){
+    if (snap.regs[HREG_IDX_CV] != image.setVolt && _psu->set_volt(image.setVolt)) report.writes++;
+    if (snap.regs[HREG_IDX_CC] != image.setCurrent && _psu->set_current(image.setCurrent)) report.writes++;
+    if (report.writes && !_psu->flush_writes(true)) return false;
+  }
+
+  report.readyMs = millis() - start;
+  return true;
+}
+
+bool xy_persist::capture(tPersistImage &image){
+  tSnapshot snap;
+  if (!_psu->get_snapshot(snap) || !_psu->get_reg_timestamp(HREG_IDX_MODEL)) return false;
+
+  memset(&image, 0, sizeof(image));
+  image.magic = PERSIST_MAGIC;
+  image.version = PERSIST_VERSION;
+  image.size = sizeof(image);
+  image.model = snap.regs[HREG_IDX_MODEL];
+  image.fwVersion = snap.regs[HREG_IDX_VERSION];
+  image.slaveAddress = snap.regs[HREG_IDX_SLAVE_ADD];
+  image.baudCode = snap.regs[HREG_IDX_BAUDRATE];
+  image.setVolt = snap.regs[HREG_IDX_CV];
+  image.setCurrent = snap.regs[HREG_IDX_CC];
+
+  bool same_device = _stored_valid && _stored.model == image.model && _stored.fwVersion == image.fwVersion;
+  for (uint8_t num = 0; num < PRESET_COUNT; num++){
+    if (_psu->get_preset_words(num, image.presets[num])){
+      image.presetValid |= 1 << num;
+    } else if (same_device && (_stored.presetValid & (1 << num))){
+      // not loaded (or staged) right now, the stored copy is still the best known one
+      memcpy(image.presets[num], _stored.presets[num], sizeof(image.presets[num]));
+      image.presetValid |= 1 << num;
+    }
+  }
+  image.crc = image_crc(image);
+  return true;
+}
+
+bool xy_persist::save(){
+  tPersistImage image;
+  if (!capture(image)) return false;
+  // flash wears with every write, an unchanged image is not written again
+  if (_stored_valid && memcmp(&image, &_stored, sizeof(image)) == 0) return true;
+
+  Preferences prefs;
+  if (!prefs.begin(_name, false)) return false;
+  bool ok = prefs.putBytes(PERSIST_KEY, &image, sizeof(image)) == sizeof(image);
+  prefs.end();
+  if (!ok) return false;
+
+  _stored = image;
+  _stored_valid = true;
+  _saves++;
+  return true;
+}
+
+bool xy_persist::erase(){
+  Preferences prefs;
+  if (!prefs.begin(_name, false)) return false;
+  bool ok = prefs.remove(PERSIST_KEY);
+  prefs.end();
+  _stored_valid = false;
+  return ok;
+}
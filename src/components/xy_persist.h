@@ -0,0 +1,101 @@
+/**
+ * @file xy_persist.h
+ * @brief Boot image in NVS: device identity, presets and the last applied setpoints
+ *
+ * save() takes the identity registers and setpoints from the driver snapshot
+ * and the presets from its cache, and writes them as one versioned, CRC
+ * protected blob through Preferences, only when something changed. On the host
+ * the Preferences stand-in keeps it in a file.
+ *
+ * restore() replaces the full scan of a cold boot (all holding registers, five
+ * preset reads, every setpoint written again) with a reconcile:
+ *  - one read of the holding register block, for identity, setpoints and the
+ *    loaded preset;
+ *  - with a valid image of the same model and firmware, one read of the loaded
+ *    preset as a spot check. If it matches, all presets come from flash; if
+ *    not, they were edited on the front panel and are read from the device;
+ *  - setpoints are only written where the device differs from the image.
+ * Without a usable image it falls back to the full scan. restore() blocks, so
+ * call it from setup() before polling or the comm task start.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy_persist_h
+#define xy_persist_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+
+#define PERSIST_MAGIC       0x58594250  // "XYBP"
+#define PERSIST_VERSION     1           // bump with every change of tPersistImage, old images are ignored
+#define PERSIST_NAMESPACE   "xy6020l"
+#define PERSIST_KEY         "boot"
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;              // sizeof(tPersistImage)
+    uint16_t model;             // identity of the device the image was taken from
+    uint16_t fwVersion;
+    uint16_t slaveAddress;
+    uint16_t baudCode;
+    uint16_t setVolt;           // last applied setpoints
+    uint16_t setCurrent;
+    uint16_t presetValid;       // bit per preset held in presets
+    uint8_t presets[PRESET_COUNT][MEM_REGS * 2];
+    uint16_t crc;               // CRC-16/MODBUS over everything before it
+} tPersistImage;
+
+typedef struct {
+    bool imageValid;
+    bool identityMatch;
+    bool presetsTrusted;        // the spot check matched
+    uint8_t presetsRestored;    // taken from flash
+    uint8_t reads;
+    uint8_t writes;
+    uint32_t readyMs;
+} tBootReport;
+
+/**
+ * @class xy_persist
+ * @brief Persisted boot image of one xy6020l
+ */
+class xy_persist
+{
+  public:
+    xy_persist(xy6020l *psu, const char *name = PERSIST_NAMESPACE) : _psu(psu), _name(name) {}
+
+    /**
+     * @brief Brings the driver and the device in line with the stored image, blocking
+     * @return false if the device did not answer
+     */
+    bool restore(tBootReport &report);
+
+    /**
+     * @brief Stores the current state if it differs from the stored one
+     * @return false if nothing is known about the device yet or the write failed
+     */
+    bool save();
+    bool erase();
+
+    /**
+     * @brief Reads the stored image, false if there is none or it fails magic, version, size or CRC
+     */
+    bool load(tPersistImage &image);
+
+    uint32_t get_saves(){return _saves;}
+
+  private:
+    bool capture(tPersistImage &image);
+    static uint16_t image_crc(const tPersistImage &image);
+
+    xy6020l *_psu;
+    const char *_name;
+    tPersistImage _stored;
+    bool _stored_valid = false;
+    uint32_t _saves = 0;
+};
+
+#endif
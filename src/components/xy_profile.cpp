@@ -0,0 +1,187 @@
+#include "xy_profile.h"
+
+bool xy_profile::load(const tProfileStep *steps, uint8_t count){
+  if (_state == PROFILE_RUNNING || count == 0 || count > PROFILE_MAX_STEPS) return false;
+
+  memcpy(_steps, steps, count * sizeof(tProfileStep));
+  _step_count = count;
+  return true;
+}
+
+bool xy_profile::start(uint16_t tick_ms){
+  if (_step_count == 0 || _state == PROFILE_RUNNING || _task_alive || tick_ms == 0) return false;
+
+  _tick_ms = tick_ms;
+  _step = 0;
+  _step_started = false;
+  _read_pending = false;
+  _last_seq = 0;
+
+  // ramps of the first step start from the setpoints the device reports
+  tSnapshot snapshot;
+  if (_psu->get_snapshot(snapshot)){
+    _volt = snapshot.regs[HREG_IDX_CV];
+    _current = snapshot.regs[HREG_IDX_CC];
+  }
+
+  _write_errors_at_start = _psu->get_write_errors();
+  memset(&_stats, 0, sizeof(_stats));
+  _stats.state = PROFILE_RUNNING;
+  publish_stats();
+
+  _state = PROFILE_RUNNING;
+  _running = true;
+  _task_alive = true;
+  if (xTaskCreatePinnedToCore(task_main, "xy_profile", PROFILE_TASK_STACK, this, PROFILE_TASK_PRIORITY, &_task, PROFILE_TASK_CORE) != pdPASS){
+    _running = false;
+    _task_alive = false;
+    _state = PROFILE_IDLE;
+    return false;
+  }
+  return true;
+}
+
+void xy_profile::stop(){
+  _running = false;
+  while (_task_alive) vTaskDelay(1);
+}
+
+void xy_profile::task_main(void *param){
+  xy_profile *self = (xy_profile *) param;
+  tProfileStats &stats = self->_stats;
+
+  // line up with a tick boundary so due times are measured from a wake up
+  TickType_t last_wake = xTaskGetTickCount();
+  vTaskDelayUntil(&last_wake, 1);
+  uint32_t period_us = self->_tick_ms * 1000UL;
+  uint32_t base_us = micros();
+  bool switched_on = self->_psu->set_switch_state(true) && self->_psu->flush_writes();
+  bool more = switched_on;
+
+  while (more && self->_running){
+    uint32_t due_us = base_us + (stats.ticks * period_us);
+    uint32_t wake_us = micros();
+    uint32_t latency = (int32_t)(wake_us - due_us) > 0 ? wake_us - due_us : 0;
+
+    more = self->tick(millis());
+
+    uint32_t busy = micros() - due_us;
+    if ((int32_t) busy > (int32_t) period_us) stats.deadlineMisses++;
+    if (latency > stats.worstLatencyUs) stats.worstLatencyUs = latency;
+    if ((int32_t) busy > (int32_t) stats.worstTickUs) stats.worstTickUs = busy;
+    stats.ticks++;
+    stats.step = self->_step;
+    self->publish_stats();
+
+    if (more) vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(self->_tick_ms));
+  }
+
+  if (switched_on && !more){
+    if (self->_output_off_at_end){
+      self->_psu->set_switch_state(false);
+      self->_psu->flush_writes();
+    }
+    self->_state = PROFILE_DONE;
+  } else {
+    self->_state = PROFILE_ABORTED;
+  }
+  stats.state = self->_state;
+  self->publish_stats();
+
+  self->_task = nullptr;
+  self->_task_alive = false;
+  vTaskDelete(nullptr);
+}
+
+void xy_profile::read_done(const tTxnResult &, void *ctx){
+  ((xy_profile *) ctx)->_read_pending = false;
+}
+
+bool xy_profile::tick(uint32_t now_ms){
+  // a finished step hands over to the next one within the same tick
+  while (_step < _step_count){
+    const tProfileStep &step = _steps[_step];
+    if (!_step_started){
+      _step_started = true;
+      _step_start_ms = now_ms;
+      _from_volt = _volt;
+      _from_current = _current;
+      _tapering = false;
+    }
+
+    bool finished = step_finished(step, now_ms);
+    _stats.writeFailures = _psu->get_write_errors() - _write_errors_at_start;
+    if (!finished) return true;
+    _step++;
+    _step_started = false;
+  }
+  return false;
+}
+
+bool xy_profile::step_finished(const tProfileStep &step, uint32_t now_ms){
+  uint32_t elapsed = now_ms - _step_start_ms;
+
+  if (step.type == PROFILE_RAMP && step.durationMs && elapsed < step.durationMs){
+    int32_t volt = _from_volt + (((int32_t) step.volt - _from_volt) * (int32_t) elapsed) / (int32_t) step.durationMs;
+    int32_t current = _from_current + (((int32_t) step.current - _from_current) * (int32_t) elapsed) / (int32_t) step.durationMs;
+    apply(volt, current);
+    return false;
+  }
+
+  apply(step.volt, step.current);
+  if (step.type != PROFILE_CC_CV) return elapsed >= step.durationMs;
+
+  // closed loop: keep one read of the actual values in flight
+  if (!_read_pending){
+    _read_pending = true;
+    if (_psu->submit_read(HREG_IDX_ACT_V, 3, read_done, this)) _stats.reads++;
+    else _read_pending = false;
+  }
+
+  tSnapshot snapshot;
+  if (_psu->get_snapshot(snapshot) && snapshot.seq != _last_seq){
+    _last_seq = snapshot.seq;
+    if ((int32_t)(snapshot.timestampMs - (_step_start_ms + PROFILE_SETTLE_MS)) >= 0){
+      if (snapshot.regs[HREG_IDX_ACT_C] >= step.taperCurrent){
+        _tapering = false;
+      } else if (!_tapering){
+        _tapering = true;
+        _taper_since_ms = snapshot.timestampMs;
+      } else if (snapshot.timestampMs - _taper_since_ms >= step.taperMs){
+        return true;
+      }
+    }
+  }
+
+  return step.durationMs && elapsed >= step.durationMs;
+}
+
+void xy_profile::apply(uint16_t volt, uint16_t current){
+  if (volt != _volt || current != _current){
+    // a full ring leaves the old values, the next tick tries again
+    if (!_psu->set_volt(volt) || !_psu->set_current(current)) return;
+    _volt = volt;
+    _current = current;
+    _stats.writes++;
+  }
+
+  // one setpoint frame at a time, CV and CC adjacent as one FC 0x10; what is not taken stays in the ring
+  if (_psu->get_queued_writes() && !_psu->write_in_flight(HREG_IDX_CV)) _psu->flush_writes();
+}
+
+uint8_t xy_profile::make_staircase(tProfileStep *steps, uint8_t max_steps, uint16_t from_volt, uint16_t to_volt,
+                                   uint8_t stairs, uint32_t dwell_ms, uint16_t current){
+  if (stairs == 0) return 0;
+  if (stairs > max_steps) stairs = max_steps;
+
+  for (uint8_t i = 0; i < stairs; i++){
+    tProfileStep &step = steps[i];
+    step.type = PROFILE_HOLD;
+    step.volt = stairs == 1 ? to_volt : from_volt + (((int32_t) to_volt - from_volt) * i) / (stairs - 1);
+    step.current = current;
+    step.durationMs = dwell_ms;
+    step.taperCurrent = 0;
+    step.taperMs = 0;
+  }
+  return stairs;
+}
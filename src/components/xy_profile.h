@@ -0,0 +1,143 @@
+/**
+ * @file xy_profile.h
+ * @brief Setpoint profiles (holds, ramps, staircases, CC-CV charging) on a fixed tick
+ *
+ * The engine runs in its own FreeRTOS task woken by vTaskDelayUntil, so the
+ * setpoint timing does not depend on what loop() does. Each tick it computes the
+ * setpoints of the current step and queues them in the coalescing write ring. The
+ * ring is flushed, ahead of queued telemetry reads, once the previous setpoint
+ * frame completed; until then newer values replace the queued ones, so a short
+ * tick on a slow link sends the latest setpoints instead of a backlog. CC-CV steps also
+ * submit a read of the actual values every tick and end on the current taper,
+ * judged from the register snapshot so the engine never waits on the bus.
+ *
+ * The engine only submits work: another task (or the bus) must keep calling
+ * process() of the device.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy_profile_h
+#define xy_profile_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+#include "seqlock.h"
+
+#define PROFILE_TICK_MS         10
+#define PROFILE_MAX_STEPS       16
+#define PROFILE_SETTLE_MS       500     // CC-CV ignores the taper until the output had time to rise
+#define PROFILE_TASK_PRIORITY   10      // above loop(), below the WiFi and lwIP tasks
+#define PROFILE_TASK_CORE       1
+#define PROFILE_TASK_STACK      4096
+
+enum ProfileStepType { PROFILE_HOLD, PROFILE_RAMP, PROFILE_CC_CV };
+enum ProfileState { PROFILE_IDLE, PROFILE_RUNNING, PROFILE_DONE, PROFILE_ABORTED };
+
+typedef struct {
+    uint8_t type;
+    uint16_t volt;            // 0.01 V, end value of a ramp
+    uint16_t current;         // 0.01 A, end value of a ramp
+    uint32_t durationMs;      // hold and ramp time, CC-CV timeout (0 waits for the taper)
+    uint16_t taperCurrent;    // CC-CV ends once the output current stayed below it...
+    uint16_t taperMs;         // ...for this long
+} tProfileStep;
+
+typedef struct {
+    uint8_t state;            // ProfileState
+    uint8_t step;             // index of the running step
+    uint32_t ticks;
+    uint32_t deadlineMisses;  // ticks whose work ended after the next tick was due
+    uint32_t worstLatencyUs;  // latest wake up after the tick was due
+    uint32_t worstTickUs;     // longest time from due to the end of the tick's work
+    uint32_t writes;          // setpoint changes queued
+    uint32_t writeFailures;   // write frames the device did not acknowledge or the ring had to drop
+    uint32_t reads;           // telemetry reads submitted
+} tProfileStats;
+
+/**
+ * @class xy_profile
+ * @brief Runs a list of setpoint steps against one xy6020l
+ */
+class xy_profile
+{
+  public:
+    xy_profile(xy6020l *psu) : _psu(psu) {}
+    ~xy_profile(){stop();}
+
+    /**
+     * @brief Copies the steps, only while no profile runs
+     */
+    bool load(const tProfileStep *steps, uint8_t count);
+
+    /**
+     * @brief Switches the output on and starts the engine task
+     * @return false if no steps are loaded, a profile runs or the task could not be created
+     */
+    bool start(uint16_t tick_ms = PROFILE_TICK_MS);
+
+    /**
+     * @brief Aborts a running profile and waits for the task to end, the setpoints stay as they are
+     */
+    void stop();
+
+    /**
+     * @brief One tick of work, called by the engine task
+     * Public so a profile can also be stepped from an existing periodic task.
+     * @return false when the last step finished
+     */
+    bool tick(uint32_t now_ms);
+
+    void set_output_off_at_end(bool off){_output_off_at_end = off;}
+
+    /**
+     * @brief Consistent statistics, from any task
+     */
+    void get_stats(tProfileStats &stats){_stats_lock.read(stats);}
+    ProfileState get_state(){return (ProfileState) _state;}
+
+    /**
+     * @brief Fills steps with a staircase of holds from from_volt to to_volt
+     * @return number of steps written
+     */
+    static uint8_t make_staircase(tProfileStep *steps, uint8_t max_steps, uint16_t from_volt, uint16_t to_volt,
+                                  uint8_t stairs, uint32_t dwell_ms, uint16_t current);
+
+  private:
+    static void task_main(void *param);
+    static void read_done(const tTxnResult &result, void *ctx);
+    bool step_finished(const tProfileStep &step, uint32_t now_ms);
+    void apply(uint16_t volt, uint16_t current);
+    void publish_stats(){_stats_lock.publish(_stats);}
+
+    xy6020l *_psu;
+    tProfileStep _steps[PROFILE_MAX_STEPS];
+    uint8_t _step_count = 0;
+
+    // engine task state
+    TaskHandle_t _task = nullptr;
+    volatile bool _running = false;
+    volatile bool _task_alive = false;
+    volatile uint8_t _state = PROFILE_IDLE;
+    volatile bool _read_pending = false;
+    uint16_t _tick_ms = PROFILE_TICK_MS;
+    bool _output_off_at_end = false;
+
+    uint8_t _step = 0;
+    bool _step_started = false;
+    uint32_t _step_start_ms = 0;
+    uint16_t _from_volt = 0;
+    uint16_t _from_current = 0;
+    uint16_t _volt = 0;
+    uint16_t _current = 0;
+    uint32_t _last_seq = 0;
+    uint32_t _write_errors_at_start = 0;
+    uint32_t _taper_since_ms = 0;
+    bool _tapering = false;
+
+    tProfileStats _stats = {};
+    xy_seqlock<tProfileStats> _stats_lock;
+};
+
+#endif
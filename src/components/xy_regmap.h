@@ -0,0 +1,138 @@
+/**
+ * @file xy_regmap.h
+ * @brief Table driven decoding of Modbus register blocks into typed structs
+ *
+ * A register map is a constexpr array of tRegDesc, one entry per value: its
+ * register offset inside the block, width (one register, or two with the low
+ * word first), access rights, scale and the struct member it decodes into. The
+ * decoder walks the map once per received range and stores plain integers, so
+ * reading a value afterwards is a field load. Maps are checked at compile time
+ * with regmap_valid().
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy_regmap_h
+#define xy_regmap_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define REG_RO    0
+#define REG_RW    1
+
+#define REG_NOT_FOUND   -1
+
+typedef struct {
+    uint8_t reg;          // offset inside the register block
+    uint8_t width;        // 1 register (16 bit) or 2 (32 bit, low word first)
+    uint8_t access;       // REG_RO or REG_RW
+    uint16_t scale;       // raw counts per unit, 100 for a value in 0.01 V
+    uint8_t field;        // offsetof the member, uint16_t for width 1, uint32_t for width 2
+    const char *name;
+    const char *unit;
+} tRegDesc;
+
+#define REG_DESC(type, member, reg, width, access, scale, unit) \
+  {(reg), (width), (access), (scale), (uint8_t) offsetof(type, member), #member, (unit)}
+
+/**
+ * @brief Checks a map against its struct and block size: sorted by register, no overlaps,
+ * every field inside the struct with the size its width implies
+ */
+template <typename T, size_t N>
+constexpr bool regmap_valid(const tRegDesc (&map)[N], uint8_t block_regs){
+  for (size_t i = 0; i < N; i++){
+    const tRegDesc &desc = map[i];
+    if (desc.width != 1 && desc.width != 2) return false;
+    if (desc.scale == 0) return false;
+    if (desc.reg + desc.width > block_regs) return false;
+    if ((size_t)(desc.field + (desc.width * 2)) > sizeof(T)) return false;
+    if (desc.field % (desc.width * 2) != 0) return false;
+    if (i > 0 && map[i - 1].reg + map[i - 1].width > desc.reg) return false;
+  }
+  return true;
+}
+
+template <size_t N>
+constexpr int regmap_find(const tRegDesc (&map)[N], uint8_t reg){
+  for (size_t i = 0; i < N; i++){
+    if (reg >= map[i].reg && reg < map[i].reg + map[i].width) return i;
+  }
+  return REG_NOT_FOUND;
+}
+
+template <size_t N>
+int regmap_find_name(const tRegDesc (&map)[N], const char *name){
+  for (size_t i = 0; i < N; i++){
+    if (strcmp(map[i].name, name) == 0) return i;
+  }
+  return REG_NOT_FOUND;
+}
+
+template <size_t N>
+constexpr bool regmap_writable(const tRegDesc (&map)[N], uint8_t reg){
+  int idx = regmap_find(map, reg);
+  return idx != REG_NOT_FOUND && map[idx].access == REG_RW;
+}
+
+/**
+ * @brief Decodes the values touched by registers [first, end) into dest
+ * @param words the whole block as received, big endian words starting at register 0
+ * A 32 bit value is decoded if either half is in the range, the other half comes from words.
+ */
+template <typename T, size_t N>
+void regmap_decode(const tRegDesc (&map)[N], const uint8_t *words, uint8_t first, uint8_t end, T &dest){
+  uint8_t *base = (uint8_t *) &dest;
+
+  for (size_t i = 0; i < N; i++){
+    const tRegDesc &desc = map[i];
+    if (desc.reg >= end) break;
+    if (desc.reg + desc.width <= first) continue;
+
+    const uint8_t *word = &words[desc.reg * 2];
+    uint16_t low = (word[0] << 8) | word[1];
+    if (desc.width == 1){
+      memcpy(base + desc.field, &low, sizeof(low));
+    } else {
+      uint32_t value = ((uint32_t)((word[2] << 8) | word[3]) << 16) | low;
+      memcpy(base + desc.field, &value, sizeof(value));
+    }
+  }
+}
+
+/**
+ * @brief Encodes every value of src into big endian words, registers without an entry are left as they are
+ */
+template <typename T, size_t N>
+void regmap_encode(const tRegDesc (&map)[N], const T &src, uint8_t *words){
+  const uint8_t *base = (const uint8_t *) &src;
+
+  for (size_t i = 0; i < N; i++){
+    const tRegDesc &desc = map[i];
+    uint8_t *word = &words[desc.reg * 2];
+    uint32_t value = 0;
+    if (desc.width == 1){
+      uint16_t low;
+      memcpy(&low, base + desc.field, sizeof(low));
+      value = low;
+    } else {
+      memcpy(&value, base + desc.field, sizeof(value));
+      word[2] = (value >> 24) & 0xFF;
+      word[3] = (value >> 16) & 0xFF;
+    }
+    word[0] = (value >> 8) & 0xFF;
+    word[1] = value & 0xFF;
+  }
+}
+
+/**
+ * @brief Raw value of a decoded field in its unit, 1234 with scale 100 is 12.34
+ */
+inline float regmap_units(const tRegDesc &desc, uint32_t raw){
+  return (float) raw / desc.scale;
+}
+
+#endif
@@ -0,0 +1,368 @@
+#include "xy_stream.h"
+
+#define STREAM_CREDIT_UNIT    1000000ULL   // credit is kept in byte microseconds, no rounding loss per poll
+
+static const uint16_t ZERO_IMAGE[STREAM_REGS] = {0};
+
+static uint8_t put_varint(uint8_t *dest, uint32_t value){
+  uint8_t n = 0;
+  while (value >= 0x80){
+    dest[n++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  dest[n++] = value;
+  return n;
+}
+
+static bool get_varint(const uint8_t *buf, uint16_t len, uint16_t &pos, uint32_t &value){
+  value = 0;
+  for (uint8_t shift = 0; shift < 35; shift += 7){
+    if (pos >= len) return false;
+    uint8_t byte = buf[pos++];
+    value |= (uint32_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+static uint16_t zigzag(uint16_t next, uint16_t ref){
+  int16_t delta = (int16_t)(next - ref);
+  return (uint16_t)((delta << 1) ^ (delta >> 15));
+}
+
+static uint16_t unzigzag(uint16_t ref, uint16_t value){
+  return ref + (uint16_t)((value >> 1) ^ -(value & 1));
+}
+
+// COBS, dest takes len + len / 254 + 1 bytes, the delimiter is not written
+static uint16_t cobs_encode(const uint8_t *src, uint16_t len, uint8_t *dest){
+  uint16_t code_at = 0;
+  uint16_t out = 1;
+  uint8_t code = 1;
+
+  for (uint16_t i = 0; i < len; i++){
+    if (src[i]){
+      dest[out++] = src[i];
+      code++;
+    }
+    if (!src[i] || code == 0xFF){
+      dest[code_at] = code;
+      code_at = out++;
+      code = 1;
+    }
+  }
+  dest[code_at] = code;
+  return out;
+}
+
+// in place, returns the decoded length or -1
+static int16_t cobs_decode(uint8_t *buf, uint16_t len){
+  uint16_t in = 0;
+  uint16_t out = 0;
+
+  while (in < len){
+    uint8_t code = buf[in++];
+    if (!code) return -1;
+    for (uint8_t i = 1; i < code; i++){
+      if (in >= len) return -1;
+      buf[out++] = buf[in++];
+    }
+    if (code != 0xFF && in < len) buf[out++] = 0;
+  }
+  return out;
+}
+
+void xy_stream::add_registers(uint16_t start_reg, uint16_t count, const uint8_t *data, uint32_t stamp){
+  if (!_enabled || start_reg + count > STREAM_REGS) return;
+
+  tRecord record;
+  record.stamp = stamp;
+  record.kind = RECORD_REGISTERS;
+  record.start = start_reg;
+  record.count = count;
+  record.status = 0;
+  memcpy(record.data, data, count * 2);
+  if (!_records.push(record)) _dropped_samples++;
+}
+
+void xy_stream::add_frame(bool reply, uint8_t status, const uint8_t *data, uint8_t len, uint32_t stamp){
+  if (!frames_enabled() || len > STREAM_FRAME_MAX) return;
+
+  // raw frames leave half of the queue to the registers
+  if (_records.size() >= _records.capacity() / 2){
+    _dropped_frames++;
+    return;
+  }
+
+  tRecord record;
+  record.stamp = stamp;
+  record.kind = RECORD_FRAME;
+  record.start = reply;
+  record.count = len;
+  record.status = status;
+  memcpy(record.data, data, len);
+  if (!_records.push(record)) _dropped_frames++;
+}
+
+void xy_stream::poll(){
+  uint32_t now_us = micros();
+  uint64_t rate = ((uint64_t) _link_bytes_per_s * STREAM_LINK_SHARE) / 100;
+  if (_budget_us){
+    // a burst of up to two packets is fine, the port buffers that much
+    _budget += (uint64_t)(now_us - _budget_us) * rate;
+    if (_budget > 2 * STREAM_MAX_ENCODED * STREAM_CREDIT_UNIT) _budget = 2 * STREAM_MAX_ENCODED * STREAM_CREDIT_UNIT;
+  }
+  _budget_us = now_us ? now_us : 1;
+
+  // the decoder may have missed anything while the port was used for text
+  if (_enabled && !_was_enabled) _keyframe_sent = false;
+  _was_enabled = _enabled;
+  write_out();
+
+  tRecord record;
+  while (STREAM_OUT_SIZE - _out_len >= STREAM_MAX_ENCODED && _records.pop(record)){
+    if (record.kind == RECORD_REGISTERS){
+      encode_registers(record);
+    } else if (_out_len > STREAM_MAX_ENCODED){
+      _stats.droppedFrames++;
+    } else {
+      encode_frame(record);
+    }
+  }
+
+  uint32_t now = millis();
+  for (tPacket *packet : {&_samples, &_frames}){
+    if (packet->len && now - packet->openedMs >= STREAM_BATCH_MS && STREAM_OUT_SIZE - _out_len >= STREAM_MAX_ENCODED) close_packet(*packet);
+  }
+  write_out();
+}
+
+void xy_stream::get_stats(tStreamStats &stats){
+  stats = _stats;
+  stats.droppedSamples += _dropped_samples;
+  stats.droppedFrames += _dropped_frames;
+}
+
+void xy_stream::encode_registers(const tRecord &record){
+  uint16_t next[STREAM_REGS];
+  memcpy(next, _image, sizeof(next));
+  for (uint8_t i = 0; i < record.count; i++) next[record.start + i] = (record.data[i * 2] << 8) | record.data[(i * 2) + 1];
+
+  // a keyframe always starts its own packet
+  bool keyframe = !_keyframe_sent || record.stamp - _keyframe_ms >= STREAM_KEYFRAME_MS;
+  if (keyframe){
+    if (_samples.len) close_packet(_samples);
+    open_packet(_samples, STREAM_PKT_KEYFRAME, millis());
+    _keyframe_ms = record.stamp;
+    _keyframe_sent = true;
+    _stats.keyframes++;
+  } else if (!_samples.len){
+    open_packet(_samples, STREAM_PKT_SAMPLES, millis());
+  }
+
+  uint8_t encoded[5 + 5 + (STREAM_REGS * 3)];
+  bool first = _samples.len == 2;
+  const uint16_t *ref = first && keyframe ? ZERO_IMAGE : _image;
+  uint8_t len = build_sample(encoded, next, ref, record.stamp, first, _samples.lastStamp);
+
+  if (_samples.len + len > STREAM_MAX_PAYLOAD + 2){
+    close_packet(_samples);
+    open_packet(_samples, STREAM_PKT_SAMPLES, millis());
+    len = build_sample(encoded, next, _image, record.stamp, true, 0);
+  }
+
+  memcpy(&_samples.buf[_samples.len], encoded, len);
+  _samples.len += len;
+  _samples.lastStamp = record.stamp;
+  memcpy(_image, next, sizeof(_image));
+  _stats.samples++;
+}
+
+void xy_stream::encode_frame(const tRecord &record){
+  if (!_frames.len) open_packet(_frames, STREAM_PKT_FRAMES, millis());
+
+  for (uint8_t attempt = 0; attempt < 2; attempt++){
+    bool first = _frames.len == 2;
+    uint8_t head[7];
+    uint8_t len = put_varint(head, first ? record.stamp : record.stamp - _frames.lastStamp);
+    head[len++] = (record.start ? 1 : 0) | (record.status << 1);
+    head[len++] = record.count;
+
+    if (_frames.len + len + record.count > STREAM_MAX_PAYLOAD + 2){
+      close_packet(_frames);
+      open_packet(_frames, STREAM_PKT_FRAMES, millis());
+      continue;
+    }
+
+    memcpy(&_frames.buf[_frames.len], head, len);
+    memcpy(&_frames.buf[_frames.len + len], record.data, record.count);
+    _frames.len += len + record.count;
+    _frames.lastStamp = record.stamp;
+    _stats.frames++;
+    return;
+  }
+}
+
+uint8_t xy_stream::build_sample(uint8_t *dest, const uint16_t *next, const uint16_t *ref, uint32_t stamp, bool first, uint32_t last_stamp){
+  uint32_t mask = 0;
+  for (uint8_t reg = 0; reg < STREAM_REGS; reg++){
+    if (next[reg] != ref[reg]) mask |= 1UL << reg;
+  }
+
+  uint8_t len = put_varint(dest, first ? stamp : stamp - last_stamp);
+  len += put_varint(&dest[len], mask);
+  for (uint8_t reg = 0; mask; reg++, mask >>= 1){
+    if (mask & 1) len += put_varint(&dest[len], zigzag(next[reg], ref[reg]));
+  }
+  return len;
+}
+
+void xy_stream::open_packet(tPacket &packet, uint8_t type, uint32_t now){
+  packet.buf[0] = type;
+  packet.len = 2;
+  packet.openedMs = now;
+  packet.lastStamp = 0;
+}
+
+void xy_stream::close_packet(tPacket &packet){
+  // samples and keyframes count in one sequence, frames in another
+  uint8_t &seq = _seq[packet.buf[0] == STREAM_PKT_FRAMES];
+  packet.buf[1] = seq++;
+  uint16_t crc = crc16_calc(packet.buf, packet.len);
+  packet.buf[packet.len] = crc & 0xFF;
+  packet.buf[packet.len + 1] = crc >> 8;
+
+  if (_out_head + _out_len + STREAM_MAX_ENCODED > STREAM_OUT_SIZE){
+    memmove(_outbuf, &_outbuf[_out_head], _out_len);
+    _out_head = 0;
+  }
+  uint8_t *dest = &_outbuf[_out_head + _out_len];
+  uint16_t len = cobs_encode(packet.buf, packet.len + 2, dest);
+  dest[len++] = 0;
+  _out_len += len;
+  packet.len = 0;
+  _stats.packets++;
+}
+
+void xy_stream::write_out(){
+  uint32_t allowed = _budget / STREAM_CREDIT_UNIT;
+  uint16_t len = _out_len < allowed ? _out_len : allowed;
+  if (!len) return;
+
+  size_t written = _out->write(&_outbuf[_out_head], len);
+  _out_head += written;
+  _out_len -= written;
+  if (!_out_len) _out_head = 0;
+  _budget -= written * STREAM_CREDIT_UNIT;
+  _stats.bytes += written;
+}
+
+void xy_stream_decoder::feed(const uint8_t *data, size_t len){
+  for (size_t i = 0; i < len; i++){
+    if (data[i]){
+      if (_len < sizeof(_buf)) _buf[_len++] = data[i];
+      else _overflow = true;
+      continue;
+    }
+
+    if (_overflow) _stats.badPackets++;
+    else if (_len) packet(_buf, _len);
+    _len = 0;
+    _overflow = false;
+  }
+}
+
+void xy_stream_decoder::packet(uint8_t *buf, uint16_t len){
+  int16_t decoded = cobs_decode(buf, len);
+  if (decoded < 4 || crc16_calc(buf, decoded) != 0){
+    _stats.badPackets++;
+    return;
+  }
+
+  uint8_t type = buf[0];
+  if (type < STREAM_PKT_SAMPLES || type > STREAM_PKT_FRAMES){
+    _stats.badPackets++;
+    return;
+  }
+  _stats.packets++;
+
+  uint8_t channel = type == STREAM_PKT_FRAMES;
+  if (_have_seq[channel] && buf[1] != (uint8_t)(_seq[channel] + 1)){
+    _stats.lostPackets += (uint8_t)(buf[1] - _seq[channel] - 1);
+    if (!channel) _synced = false;
+  }
+  _seq[channel] = buf[1];
+  _have_seq[channel] = true;
+
+  const uint8_t *payload = &buf[2];
+  uint16_t payload_len = decoded - 4;
+  bool ok = true;
+  if (type == STREAM_PKT_FRAMES) ok = frames(payload, payload_len);
+  else if (type == STREAM_PKT_KEYFRAME || _synced) ok = samples(payload, payload_len, type == STREAM_PKT_KEYFRAME);
+  else _stats.skippedPackets++;
+
+  if (!ok){
+    _stats.badPackets++;
+    if (type != STREAM_PKT_FRAMES) _synced = false;
+  }
+}
+
+bool xy_stream_decoder::samples(const uint8_t *buf, uint16_t len, bool keyframe){
+  uint16_t pos = 0;
+  uint32_t stamp = 0;
+
+  for (bool first = true; pos < len; first = false){
+    uint32_t time, mask;
+    if (!get_varint(buf, len, pos, time) || !get_varint(buf, len, pos, mask) || mask >> STREAM_REGS) return false;
+    stamp = first ? time : stamp + time;
+
+    if (first && keyframe) memset(_sample.regs, 0, sizeof(_sample.regs));
+    for (uint8_t reg = 0; reg < STREAM_REGS; reg++){
+      if (!(mask & (1UL << reg))) continue;
+      uint32_t value;
+      if (!get_varint(buf, len, pos, value) || value > 0xFFFF) return false;
+      _sample.regs[reg] = unzigzag(_sample.regs[reg], value);
+    }
+    if (first && keyframe) _synced = true;
+
+    _sample.timestampMs = stamp;
+    _sample.changed = mask;
+    _stats.samples++;
+    if (_sample_cb) _sample_cb(_sample, _sample_ctx);
+  }
+  return true;
+}
+
+bool xy_stream_decoder::frames(const uint8_t *buf, uint16_t len){
+  uint16_t pos = 0;
+  uint32_t stamp = 0;
+  tStreamFrame frame;
+
+  for (bool first = true; pos < len; first = false){
+    uint32_t time;
+    if (!get_varint(buf, len, pos, time) || pos + 2 > len) return false;
+    stamp = first ? time : stamp + time;
+
+    frame.timestampMs = stamp;
+    frame.reply = buf[pos] & 1;
+    frame.status = buf[pos] >> 1;
+    frame.len = buf[pos + 1];
+    pos += 2;
+    if (frame.len > STREAM_FRAME_MAX || pos + frame.len > len) return false;
+    memcpy(frame.data, &buf[pos], frame.len);
+    pos += frame.len;
+
+    _stats.frames++;
+    if (_frame_cb) _frame_cb(frame, _frame_ctx);
+  }
+  return true;
+}
+
+void xy_stream_decoder::to_telemetry(const tStreamSample &sample, tTelemetry &telemetry){
+  uint8_t words[STREAM_REGS * 2];
+  for (uint8_t reg = 0; reg < STREAM_REGS; reg++){
+    words[reg * 2] = sample.regs[reg] >> 8;
+    words[(reg * 2) + 1] = sample.regs[reg] & 0xFF;
+  }
+  regmap_decode(XY_HOLD_REG_MAP, words, 0, STREAM_REGS, telemetry);
+}
@@ -0,0 +1,216 @@
+/**
+ * @file xy_stream.h
+ * @brief Compact binary telemetry stream for the console port, and its decoder
+ *
+ * Attached with xy6020l::set_stream(), the stream receives every holding
+ * register frame the driver accepts and, when enabled, the raw Modbus frames on
+ * the bus. The driver side only copies them into a lock-free record queue; the
+ * application calls poll() to encode, batch and write them, so the comm task
+ * never waits on the console.
+ *
+ * A packet is COBS encoded and ends with a 0x00 delimiter:
+ *
+ *   type | seq | payload | crc16 (Modbus, low byte first)
+ *
+ * A samples packet holds the register frames of up to STREAM_BATCH_MS. Each
+ * record is a varint timestamp (absolute ms in the first record, a delta after
+ * it), a varint mask of the registers that changed and one zigzag varint delta
+ * per set bit, against the register image of the previous record. A keyframe
+ * packet is the same, except its first record is taken against an all zero
+ * image; one is sent every STREAM_KEYFRAME_MS so a decoder that starts late or
+ * lost a packet resynchronises. A frames packet holds raw bus frames as a varint
+ * timestamp, a flag byte (bit 0 reply, the TxnStatus above it), a length byte
+ * and the bytes.
+ *
+ * The stream uses at most STREAM_LINK_SHARE percent of the link. Once more than
+ * a packet is waiting for the link raw frames are dropped first, then records
+ * wait in the queue and the newest ones are dropped when it is full.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy_stream_h
+#define xy_stream_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+#include "spsc_queue.h"
+#include <atomic>
+
+#define STREAM_REGS             30      // holding registers HREG_IDX_CV..HREG_IDX_MEMORY
+#define STREAM_RECORD_QUEUE     32      // ring size, one slot less is usable
+#define STREAM_FRAME_MAX        72      // longest raw frame carried, write multiple of 30 registers with crc
+#define STREAM_MAX_PAYLOAD      200     // packet bytes before crc and COBS
+#define STREAM_MAX_ENCODED      (STREAM_MAX_PAYLOAD + 2 + 2 + 2 + 1)    // header, crc, COBS overhead, delimiter
+#define STREAM_OUT_SIZE         (STREAM_MAX_ENCODED * 3)
+#define STREAM_BATCH_MS         50
+#define STREAM_KEYFRAME_MS      1000
+#ifndef STREAM_LINK_SHARE
+#define STREAM_LINK_SHARE       50      // percent of the link the stream may use
+#endif
+
+enum StreamPacketType {
+    STREAM_PKT_SAMPLES = 1,
+    STREAM_PKT_KEYFRAME = 2,
+    STREAM_PKT_FRAMES = 3
+};
+
+typedef struct {
+    uint32_t timestampMs;
+    uint32_t changed;       // bit per register that changed with this record
+    uint16_t regs[STREAM_REGS];
+} tStreamSample;
+
+typedef struct {
+    uint32_t timestampMs;
+    bool reply;             // false for the request
+    uint8_t status;         // TxnStatus of the transaction
+    uint8_t len;
+    uint8_t data[STREAM_FRAME_MAX];
+} tStreamFrame;
+
+typedef struct {
+    uint32_t samples;
+    uint32_t frames;
+    uint32_t droppedSamples;    // record queue was full
+    uint32_t droppedFrames;     // queue over half full or link busy
+    uint32_t packets;
+    uint32_t keyframes;
+    uint32_t bytes;             // written to the link
+} tStreamStats;
+
+typedef struct {
+    uint32_t packets;
+    uint32_t badPackets;        // COBS, crc or format error
+    uint32_t lostPackets;       // gaps in the sequence
+    uint32_t skippedPackets;    // deltas without a keyframe to apply them to
+    uint32_t samples;
+    uint32_t frames;
+} tStreamDecodeStats;
+
+/**
+ * @class xy_stream
+ * @brief Encoder side, fed by the driver and drained by poll()
+ */
+class xy_stream
+{
+  public:
+    /**
+     * @param link_baud nominal rate of out, the budget is STREAM_LINK_SHARE percent of it
+     */
+    xy_stream(Stream *out, uint32_t link_baud = 115200) : _out(out), _link_bytes_per_s(link_baud / 10) {}
+
+    /**
+     * @brief Stops taking records while the port is used for something else
+     * The first packet after enabling again is a keyframe.
+     */
+    void set_enabled(bool enable){_enabled = enable;}
+    bool is_enabled(){return _enabled;}
+
+    void set_frames(bool enable){_frames_enabled = enable;}
+    bool frames_enabled(){return _enabled && _frames_enabled;}
+
+    // producer side, called by the driver from the task running process()
+    void add_registers(uint16_t start_reg, uint16_t count, const uint8_t *data, uint32_t stamp);
+    void add_frame(bool reply, uint8_t status, const uint8_t *data, uint8_t len, uint32_t stamp);
+
+    /**
+     * @brief Encodes queued records and writes what the link budget allows, never blocks
+     * Call from one application task, at least every STREAM_BATCH_MS.
+     */
+    void poll();
+
+    void get_stats(tStreamStats &stats);
+
+  private:
+    enum { RECORD_REGISTERS, RECORD_FRAME };
+
+    typedef struct {
+        uint32_t stamp;
+        uint8_t kind;
+        uint8_t start;          // first register, or the reply flag of a frame
+        uint8_t count;          // registers, or frame length
+        uint8_t status;
+        uint8_t data[STREAM_FRAME_MAX];
+    } tRecord;
+
+    typedef struct {
+        uint8_t buf[STREAM_MAX_PAYLOAD + 4];
+        uint8_t len;            // 0 while no packet is open
+        uint32_t lastStamp;
+        uint32_t openedMs;
+    } tPacket;
+
+    void encode_registers(const tRecord &record);
+    void encode_frame(const tRecord &record);
+    uint8_t build_sample(uint8_t *dest, const uint16_t *next, const uint16_t *ref, uint32_t stamp, bool first, uint32_t last_stamp);
+    void open_packet(tPacket &packet, uint8_t type, uint32_t now);
+    void close_packet(tPacket &packet);
+    void write_out();
+
+    Stream *_out;
+    uint32_t _link_bytes_per_s;
+    volatile bool _enabled = true;
+    volatile bool _frames_enabled = false;
+    xy_spsc_queue<tRecord, STREAM_RECORD_QUEUE> _records;
+    std::atomic<uint32_t> _dropped_samples{0};
+    std::atomic<uint32_t> _dropped_frames{0};
+
+    // application side
+    uint16_t _image[STREAM_REGS] = {0};
+    tPacket _samples = {};
+    tPacket _frames = {};
+    uint32_t _keyframe_ms = 0;
+    bool _keyframe_sent = false;
+    bool _was_enabled = true;
+    uint8_t _seq[2] = {0};            // samples and keyframes, frames
+    uint8_t _outbuf[STREAM_OUT_SIZE];
+    uint16_t _out_head = 0;
+    uint16_t _out_len = 0;
+    uint64_t _budget = 0;             // byte microseconds the link still allows
+    uint32_t _budget_us = 0;
+    tStreamStats _stats = {};
+};
+
+/**
+ * @class xy_stream_decoder
+ * @brief Host side of the stream, portable, fed with whatever the port delivered
+ */
+class xy_stream_decoder
+{
+  public:
+    typedef void (*SampleCallback)(const tStreamSample &sample, void *ctx);
+    typedef void (*FrameCallback)(const tStreamFrame &frame, void *ctx);
+
+    void on_sample(SampleCallback callback, void *ctx){_sample_cb = callback; _sample_ctx = ctx;}
+    void on_frame(FrameCallback callback, void *ctx){_frame_cb = callback; _frame_ctx = ctx;}
+
+    void feed(const uint8_t *data, size_t len);
+    void get_stats(tStreamDecodeStats &stats){stats = _stats;}
+
+    /**
+     * @brief Decodes the register image of a sample like the driver does
+     */
+    static void to_telemetry(const tStreamSample &sample, tTelemetry &telemetry);
+
+  private:
+    void packet(uint8_t *buf, uint16_t len);
+    bool samples(const uint8_t *buf, uint16_t len, bool keyframe);
+    bool frames(const uint8_t *buf, uint16_t len);
+
+    uint8_t _buf[STREAM_MAX_ENCODED];
+    uint16_t _len = 0;
+    bool _overflow = false;
+    bool _synced = false;
+    bool _have_seq[2] = {false};
+    uint8_t _seq[2] = {0};
+    tStreamSample _sample = {};
+    SampleCallback _sample_cb = nullptr;
+    void *_sample_ctx = nullptr;
+    FrameCallback _frame_cb = nullptr;
+    void *_frame_ctx = nullptr;
+    tStreamDecodeStats _stats = {};
+};
+
+#endif
@@ -0,0 +1,137 @@
+#include "xy_watch.h"
+
+int8_t xy_watch::subscribe(uint8_t reg, QueueHandle_t queue, uint16_t deadband){
+  tSubscription sub = {};
+  sub.queue = queue;
+  sub.reg = reg;
+  sub.level = false;
+  sub.band = deadband;
+  return add(sub);
+}
+
+int8_t xy_watch::subscribe_level(uint8_t reg, uint16_t level, uint16_t hysteresis, QueueHandle_t queue){
+  tSubscription sub = {};
+  sub.queue = queue;
+  sub.reg = reg;
+  sub.level = true;
+  sub.threshold = level;
+  sub.band = hysteresis;
+  return add(sub);
+}
+
+int8_t xy_watch::add(tSubscription sub){
+  if (!sub.queue || sub.reg >= WATCH_REGS) return -1;
+
+  portENTER_CRITICAL(&_lock);
+  for (uint8_t id = 0; id < WATCH_MAX_SUBS; id++){
+    if (_subs[id].queue) continue;
+
+    // both kinds start from the current value once the register was seen
+    bool seen = _valid & (1UL << sub.reg);
+    sub.primed = sub.level || seen;
+    sub.reported = _words[sub.reg];
+    sub.above = seen && _words[sub.reg] >= sub.threshold;
+    _subs[id] = sub;
+    _interest |= 1UL << sub.reg;
+    portEXIT_CRITICAL(&_lock);
+    return id;
+  }
+  portEXIT_CRITICAL(&_lock);
+  return -1;
+}
+
+bool xy_watch::unsubscribe(int8_t sub){
+  if (sub < 0 || sub >= WATCH_MAX_SUBS) return false;
+
+  portENTER_CRITICAL(&_lock);
+  bool active = _subs[sub].queue != nullptr;
+  _subs[sub].queue = nullptr;
+  _interest = 0;
+  for (const tSubscription &other : _subs){
+    if (other.queue) _interest |= 1UL << other.reg;
+  }
+  portEXIT_CRITICAL(&_lock);
+  return active;
+}
+
+bool xy_watch::evaluate(uint8_t id, tSubscription &sub, uint16_t value, uint32_t stamp, tWatchEvent &event){
+  if (!sub.primed){
+    sub.primed = true;
+    sub.reported = value;
+    return false;
+  }
+
+  if (sub.level){
+    if (!sub.above && value >= sub.threshold){
+      sub.above = true;
+      event.kind = WATCH_RISE;
+    } else if (sub.above && (uint32_t) value + sub.band < sub.threshold){
+      sub.above = false;
+      event.kind = WATCH_FALL;
+    } else {
+      return false;
+    }
+  } else {
+    uint16_t diff = value > sub.reported ? value - sub.reported : sub.reported - value;
+    if (diff <= sub.band) return false;
+    event.kind = WATCH_CHANGE;
+  }
+
+  event.sub = id;
+  event.reg = sub.reg;
+  event.value = value;
+  event.previous = sub.reported;
+  event.timestampMs = stamp;
+  sub.reported = value;
+  return true;
+}
+
+void xy_watch::update(uint16_t start_reg, uint16_t count, const uint8_t *data, uint32_t stamp){
+  if (start_reg >= WATCH_REGS) return;
+  uint16_t end = start_reg + count < WATCH_REGS ? start_reg + count : WATCH_REGS;
+
+  tWatchEvent events[WATCH_MAX_SUBS];
+  QueueHandle_t queues[WATCH_MAX_SUBS];
+  uint8_t pending = 0;
+
+  portENTER_CRITICAL(&_lock);
+  _stats.frames++;
+  uint32_t changed = 0;
+  for (uint16_t reg = start_reg; reg < end; reg++){
+    uint16_t word = (data[(reg - start_reg) * 2] << 8) | data[((reg - start_reg) * 2) + 1];
+    uint32_t bit = 1UL << reg;
+    if ((_valid & bit) && _words[reg] == word) continue;
+    if (_valid & bit) _stats.changedWords++;
+    _words[reg] = word;
+    _valid |= bit;
+    changed |= bit;
+  }
+
+  // only subscriptions of changed registers are looked at
+  if (changed & _interest){
+    for (uint8_t id = 0; id < WATCH_MAX_SUBS; id++){
+      tSubscription &sub = _subs[id];
+      if (!sub.queue || !(changed & (1UL << sub.reg))) continue;
+      if (evaluate(id, sub, _words[sub.reg], stamp, events[pending])) queues[pending++] = sub.queue;
+    }
+  }
+  portEXIT_CRITICAL(&_lock);
+
+  // queues are fed outside the critical section and never waited on
+  uint8_t dropped = 0;
+  for (uint8_t i = 0; i < pending; i++){
+    if (xQueueSend(queues[i], &events[i], 0) != pdTRUE) dropped++;
+  }
+  if (!pending) return;
+
+  portENTER_CRITICAL(&_lock);
+  _stats.events += pending - dropped;
+  _stats.dropped += dropped;
+  portEXIT_CRITICAL(&_lock);
+}
+
+void xy_watch::get_stats(tWatchStats &stats){
+  portENTER_CRITICAL(&_lock);
+  stats = _stats;
+  portEXIT_CRITICAL(&_lock);
+}
@@ -0,0 +1,111 @@
+/**
+ * @file xy_watch.h
+ * @brief Change notifications on holding registers, delivered through FreeRTOS queues
+ *
+ * Attached with xy6020l::set_watch(), the watch sees every holding register
+ * frame the driver accepts (poll replies and acknowledged writes), diffs it word
+ * by word against the previous one and only looks at the subscriptions of the
+ * registers that changed. Matching events are copied into the subscriber's queue
+ * without waiting, so the latency of an event is the arrival of the frame and
+ * application tasks can block in xQueueReceive instead of spinning on getters.
+ *
+ * Subscriptions either report changes, optionally beyond a deadband measured
+ * from the last reported value, or the crossings of a level with hysteresis.
+ * The derived conditions (protection trip, CV/CC, output) are level crossings;
+ * a subscription made before the first frame reports a level that is already
+ * reached as a rise.
+ * A full queue drops the event and counts it.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy_watch_h
+#define xy_watch_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+
+#define WATCH_MAX_SUBS      16
+#define WATCH_REGS          30      // holding registers HREG_IDX_CV..HREG_IDX_MEMORY
+
+enum WatchKind {
+    WATCH_CHANGE,       // value moved by more than the deadband since the last event
+    WATCH_RISE,         // value reached the level
+    WATCH_FALL          // value dropped below the level minus the hysteresis
+};
+
+typedef struct {
+    uint8_t sub;            // subscription id
+    uint8_t reg;            // HREG_IDX_*
+    uint8_t kind;           // WatchKind
+    uint16_t value;
+    uint16_t previous;      // value of the last event, or of the first frame
+    uint32_t timestampMs;   // arrival of the frame
+} tWatchEvent;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t changedWords;
+    uint32_t events;
+    uint32_t dropped;       // events lost to full queues
+} tWatchStats;
+
+/**
+ * @class xy_watch
+ * @brief Subscriptions on the holding registers of one xy6020l
+ */
+class xy_watch
+{
+  public:
+    /**
+     * @brief Reports every change of reg beyond deadband (raw units, 0 for any change)
+     * @param queue created with xQueueCreate(n, sizeof(tWatchEvent))
+     * @return subscription id, -1 if no slot is free or reg is not a holding register
+     */
+    int8_t subscribe(uint8_t reg, QueueHandle_t queue, uint16_t deadband = 0);
+
+    /**
+     * @brief Reports WATCH_RISE when reg reaches level and WATCH_FALL when it drops below level - hysteresis
+     */
+    int8_t subscribe_level(uint8_t reg, uint16_t level, uint16_t hysteresis, QueueHandle_t queue);
+
+    // derived conditions, RISE on entering and FALL on leaving
+    int8_t watch_protection(QueueHandle_t queue){return subscribe_level(HREG_IDX_PROTECT, 1, 0, queue);}
+    int8_t watch_constant_current(QueueHandle_t queue){return subscribe_level(HREG_IDX_CVCC, 1, 0, queue);}
+    int8_t watch_output(QueueHandle_t queue){return subscribe_level(HREG_IDX_OUTPUT_ON, 1, 0, queue);}
+
+    bool unsubscribe(int8_t sub);
+
+    /**
+     * @brief Called by the driver with each accepted frame of registers start_reg..start_reg + count - 1
+     * @param data big endian words as on the wire
+     */
+    void update(uint16_t start_reg, uint16_t count, const uint8_t *data, uint32_t stamp);
+
+    void get_stats(tWatchStats &stats);
+
+  private:
+    typedef struct {
+        QueueHandle_t queue;    // nullptr marks a free slot
+        uint8_t reg;
+        bool level;             // level crossings instead of changes
+        uint16_t threshold;
+        uint16_t band;          // deadband of a change subscription, hysteresis of a level one
+        uint16_t reported;
+        bool primed;            // reported holds a value
+        bool above;
+    } tSubscription;
+
+    int8_t add(tSubscription sub);
+    bool evaluate(uint8_t id, tSubscription &sub, uint16_t value, uint32_t stamp, tWatchEvent &event);
+
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+    tSubscription _subs[WATCH_MAX_SUBS] = {};
+    uint32_t _interest = 0;         // bit per register with at least one subscription
+    uint16_t _words[WATCH_REGS] = {0};
+    uint32_t _valid = 0;            // bit per register seen at least once
+    tWatchStats _stats = {};
+};
+
+#endif
@@ -0,0 +1,138 @@
+/**
+ * @file fuzz_main.cpp
+ * @brief Runs the reply harness without libFuzzer: corpus files, or mutations of valid replies
+ *
+ * Usage: fuzz_reply [-runs=N] [-seed=S] [file ...]
+ *
+ * With files every one of them is run once (crash reproduction, regression
+ * corpus). Otherwise N inputs (100000 by default) are made from the replies of
+ * a well behaved slave, exception replies included, by flipping bits, cutting,
+ * inserting and overwriting bytes; half of them get their CRC repaired by the
+ * harness. Built with -DXY_LIBFUZZER this file is left out in favour of the
+ * libFuzzer main.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef XY_LIBFUZZER
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../components/xy6020l.h"
+
+#define FUZZ_INPUT_MAX    160
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+extern uint32_t fuzz_status_counts[TXN_BAD_FRAME + 1];
+
+static const char *const STATUS_NAMES[] = {"pending", "ok", "timeout", "short frame", "crc error", "exception", "tx error", "bad frame"};
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(){
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+// control bytes and the reply a correct slave would send to that request
+static size_t make_seed(uint8_t *input){
+  uint8_t kind = rng() % 3;
+  uint8_t count_seed = rng();
+  input[0] = kind | (rng() & 0xF4);
+  input[1] = count_seed;
+  uint8_t *reply = input + 2;
+  uint8_t len;
+
+  uint8_t func = kind == 1 ? FUNC_CODE_WRITE_SINGLE_HOLD_REG : kind == 2 ? FUNC_CODE_WRITE_MULTIPLE_HOLD_REG : FUNC_CODE_READ_HOLD_REG;
+  reply[0] = DEFAULT_SLAVE_ADDRESS;
+  if (rng() % 4 == 0){
+    reply[1] = func | 0x80;
+    reply[2] = 1 + (rng() % 4);
+    len = 5;
+  } else if (func == FUNC_CODE_READ_HOLD_REG){
+    uint8_t count = 1 + (count_seed % 30);
+    reply[1] = func;
+    reply[2] = count * 2;
+    for (uint8_t i = 0; i < count * 2; i++) reply[3 + i] = rng();
+    len = (count * 2) + 5;
+  } else {
+    // the echo the harness expects: start HREG_IDX_CV, value or count derived from the seed
+    uint8_t count = func == FUNC_CODE_WRITE_MULTIPLE_HOLD_REG ? 1 + (count_seed % 14) : 1;
+    reply[1] = func;
+    reply[2] = 0;
+    reply[3] = HREG_IDX_CV;
+    reply[4] = func == FUNC_CODE_WRITE_MULTIPLE_HOLD_REG ? 0 : count_seed;
+    reply[5] = func == FUNC_CODE_WRITE_MULTIPLE_HOLD_REG ? count : (uint8_t)(count_seed + 1);
+    len = 8;
+  }
+  uint16_t crc = crc16_calc(reply, len - 2);
+  reply[len - 2] = crc & 0xFF;
+  reply[len - 1] = crc >> 8;
+  return len + 2;
+}
+
+static size_t mutate(uint8_t *input, size_t size){
+  uint8_t edits = rng() % 4;
+  for (uint8_t e = 0; e < edits; e++){
+    size_t pos = 2 + (size > 2 ? rng() % (size - 2) : 0);
+    switch (rng() % 5){
+      case 0: if (pos < size) input[pos] ^= 1 << (rng() % 8); break;
+      case 1: if (pos < size) input[pos] = rng(); break;
+      case 2: size = pos; break;
+      case 3:
+        if (size < FUZZ_INPUT_MAX){
+          memmove(input + pos + 1, input + pos, size - pos);
+          input[pos] = rng();
+          size++;
+        }
+        break;
+      default: if (size + 4 <= FUZZ_INPUT_MAX) for (uint8_t i = 0; i < 4; i++) input[size++] = rng(); break;
+    }
+  }
+  return size;
+}
+
+static int run_file(const char *path){
+  FILE *f = fopen(path, "rb");
+  if (!f){
+    fprintf(stderr, "cannot open %s\n", path);
+    return 1;
+  }
+  uint8_t input[4096];
+  size_t size = fread(input, 1, sizeof(input), f);
+  fclose(f);
+  LLVMFuzzerTestOneInput(input, size);
+  return 0;
+}
+
+int main(int argc, char **argv){
+  uint32_t runs = 100000;
+  int files = 0;
+  for (int i = 1; i < argc; i++){
+    if (strncmp(argv[i], "-runs=", 6) == 0) runs = strtoul(argv[i] + 6, nullptr, 0);
+    else if (strncmp(argv[i], "-seed=", 6) == 0) rng_state = strtoul(argv[i] + 6, nullptr, 0) | 1;
+    else if (run_file(argv[i]) == 0) files++;
+  }
+
+  uint32_t start = millis();
+  if (!files){
+    uint8_t input[FUZZ_INPUT_MAX];
+    for (uint32_t run = 0; run < runs; run++){
+      size_t size = make_seed(input);
+      if (run % 8) size = mutate(input, size);
+      LLVMFuzzerTestOneInput(input, size);
+    }
+  }
+  uint32_t elapsed_ms = millis() - start;
+
+  printf("%u inputs in %u ms, through the driver:", files ? files : runs, elapsed_ms);
+  for (uint8_t s = TXN_OK; s <= TXN_BAD_FRAME; s++) if (fuzz_status_counts[s]) printf(" %s %u,", STATUS_NAMES[s], fuzz_status_counts[s]);
+  printf(" no invariant violated\n");
+  return 0;
+}
+
+#endif
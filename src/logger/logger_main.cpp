@@ -0,0 +1,95 @@
+/**
+ * @file logger_main.cpp
+ * @brief Linux data logger: the unchanged driver on a USB-RS485 adapter, CSV on stdout
+ *
+ * Usage: logger <tty|--sim> [baud] [period_ms]
+ *
+ * Polls the actual V/I/P every period_ms (20 by default), the status every
+ * 50 ms and the setpoints and input side every second, and prints one line per
+ * reply that changed the snapshot. --sim puts the simulated slave behind a pty
+ * instead of a real port. Ctrl-C ends the run and prints the link metrics on
+ * stderr.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../components/xy6020l.h"
+#include "../posix/posix_link.h"
+#include "../sim/xy6020l_sim.h"
+#include "../sim/xy6020l_sim_link.h"
+
+static volatile sig_atomic_t running = 1;
+
+static void on_signal(int){
+  running = 0;
+}
+
+int main(int argc, char **argv){
+  if (argc < 2){
+    fprintf(stderr, "usage: %s <tty|--sim> [baud] [period_ms]\n", argv[0]);
+    return 2;
+  }
+  uint32_t baud = argc > 2 ? strtoul(argv[2], nullptr, 0) : 115200;
+  uint32_t period_ms = argc > 3 ? strtoul(argv[3], nullptr, 0) : 20;
+
+  posix_serial port;
+  fd_stream master;
+  xy6020l_sim sim;
+  xy6020l_sim_link link(&sim);
+  if (strcmp(argv[1], "--sim") == 0){
+    char path[64];
+    tSimConfig config = xy6020l_sim::default_config();
+    config.baud = baud;
+    sim.set_config(config);
+    if (!open_pty(master, path, sizeof(path)) || !port.begin(path, baud)){
+      fprintf(stderr, "cannot open a pty\n");
+      return 1;
+    }
+    link.start(&master);
+  } else if (!port.begin(argv[1], baud)){
+    fprintf(stderr, "cannot open %s at %u baud\n", argv[1], baud);
+    return 1;
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  xy6020l psu(&port);
+  psu.begin(baud);
+  psu.add_poll_group(HREG_IDX_ACT_V, 3, period_ms);
+  psu.add_poll_group(HREG_IDX_PROTECT, 3, 50);
+  psu.add_poll_group(HREG_IDX_CV, 2, 1000);
+  psu.add_poll_group(HREG_IDX_IN_V, 10, 1000);
+  psu.start_polling();
+
+  printf("ms,set_v,set_a,v,a,w,in_v,cvcc,output,protect,temp\n");
+  uint32_t last_seq = 0;
+  while (running){
+    psu.process();
+
+    uint32_t seq = psu.get_snapshot_sequence();
+    if (seq != last_seq){
+      last_seq = seq;
+      tSnapshot snap;
+      if (psu.get_snapshot(snap)){
+        printf("%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n", snap.timestampMs, snap.regs[HREG_IDX_CV], snap.regs[HREG_IDX_CC],
+               snap.regs[HREG_IDX_ACT_V], snap.regs[HREG_IDX_ACT_C], snap.regs[HREG_IDX_ACT_P], snap.regs[HREG_IDX_IN_V],
+               snap.regs[HREG_IDX_CVCC], snap.regs[HREG_IDX_OUTPUT_ON], snap.regs[HREG_IDX_PROTECT], snap.regs[HREG_IDX_TEMP]);
+      }
+    }
+    if (psu.get_rx_state() == IDLE) delayMicroseconds(200);
+  }
+  link.stop();
+
+  tMetricsSnapshot metrics;
+  psu.get_metrics(metrics);
+  const tLatencyHist &reads = metrics.latency[METRICS_FC_READ];
+  fprintf(stderr, "%u reads in %u ms, p50 %u us p99 %u us, %u timeouts %u crc errors\n", reads.count, metrics.windowMs,
+          metrics_percentile(reads, 50), metrics_percentile(reads, 99), metrics.status[TXN_TIMEOUT], metrics.status[TXN_CRC_ERROR]);
+  return 0;
+}
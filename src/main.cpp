@@ -1,132 +1,71 @@
 #include <Arduino.h>
 #include "components/xy6020l.h"
-
-
-uint16_t calculateCRC(uint8_t *data, uint8_t length) {
-    uint16_t crc = 0xFFFF;
-    
-    for (uint8_t i = 0; i < length; i++) {
-        crc ^= data[i];
-        
-        for (uint8_t j = 0; j < 8; j++) {
-            if (crc & 0x0001) {
-                crc >>= 1;
-                crc ^= 0xA001;
-            } else {
-                crc >>= 1;
-            }
-        }
-    }
-    
-    return crc;
-}
-
-
-void data_to_modbus_framing_03(Stream *serialHandle, uint16_t register_start_add, uint16_t no_of_register){
-  uint8_t txDataBuf[6];
-  serialHandle->setTimeout(100);
-
-  txDataBuf[0] = DEFAULT_SLAVE_ADDRESS;
-  txDataBuf[1] = 0x3; //fucntion code to read register
-  txDataBuf[2] = register_start_add >> 8;
-  txDataBuf[3] = register_start_add & 0xFF;
-  txDataBuf[4] = no_of_register >> 8;
-  txDataBuf[5] = no_of_register & 0xFF;
-
-  uint16_t crc16 = calculateCRC(txDataBuf, sizeof(txDataBuf));
-  uint8_t expectedRxBytes = (no_of_register * 2) + 5;
-
-  Serial.print("DATA TO BE SENT IS: ");
-  for(int i = 0; i < 6; i++){
-    Serial.printf("[0x%d] ", txDataBuf[i]);
-  }
-  Serial.printf("[0x%d]", crc16);
-  //Serial.printf("[0x%d] \n", crc16 & 0xFF);
-
-  size_t txBufSent = serialHandle->write(txDataBuf, sizeof(txDataBuf));
-  size_t crcSent = serialHandle->write(crc16 & 0xFF);
-  size_t crcSent1 = serialHandle->write(crc16 >> 8);
-
-  Serial.printf("Sent txBuf: %d          Sent crc %d and %d\n", txBufSent, crcSent, crcSent1);
-  
-  Serial.println("DATA SENT");
-  uint8_t dataBuf[65];
-  uint32_t previousTime = millis();
-  serialHandle->readBytes(dataBuf, expectedRxBytes);
-  Serial.printf("It took %d ms", (millis() - previousTime));
-  int count = 0;
-  while(count < expectedRxBytes){
-      Serial.printf("[0x"); Serial.print(dataBuf[count], HEX); Serial.printf("] ");
-      count ++;
-  }
-}
-
-void write_a_single_register(Stream *serialHandle, uint16_t reg_address, uint16_t value){
-  serialHandle->setTimeout(100);
-
-  uint8_t expectedRxBytes = 8;
-  uint8_t response_temp_buf[70];
-
-  uint8_t txDataBuf[8];
-  txDataBuf[0] = DEFAULT_SLAVE_ADDRESS;
-  txDataBuf[1] = FUNC_CODE_WRITE_SINGLE_HOLD_REG;
-  txDataBuf[2] = reg_address >> 8;
-  txDataBuf[3] = reg_address & 0xFF;
-  txDataBuf[4] = value >> 8;
-  txDataBuf[5] = value & 0xFF;
-
-  uint16_t crc16 = calculateCRC(txDataBuf, 6);
-
-  txDataBuf[6] = crc16 & 0xFF;
-  txDataBuf[7] = crc16 >> 8;
-
-  uint32_t previousTime = millis();
-  size_t txDataSent = serialHandle->write(txDataBuf, sizeof(txDataBuf));
-  if(txDataSent != sizeof(txDataBuf)) {
-    Serial.println("The amount of data succesfully sent is not equal to data fed to serial");
-    return;
-  }
-  
-  size_t bytesRead = serialHandle->readBytes(response_temp_buf, expectedRxBytes);
-
-  Serial.printf("It took exactly %dms for the operation \n", millis() - previousTime);
-
-  for(int i = 0; i < expectedRxBytes; i++){
-    Serial.printf("[0x%d] ", response_temp_buf[i]);
-  }
-
-  if (response_temp_buf[1] & 0x80){
-    Serial.println("EXCEPTION OCCURED!!!!");
-    return;
-  }
-
-  if (bytesRead != expectedRxBytes){
-    Serial.println("Bytes received from serial is not equal to expected bytes ");
-    return;
-  }
-  uint16_t rxCRC16 = (response_temp_buf[expectedRxBytes - 1] << 8) | (response_temp_buf[expectedRxBytes - 2]);
-
-  if(calculateCRC(response_temp_buf, expectedRxBytes - 2) != rxCRC16){
-    Serial.println("Received checksum is not equalt to tx checksum");
-    return;
-  }
-
-  Serial.println("Tx succesfully completed");
-
+#include "components/xy_capture.h"
+#include "components/xy_comm.h"
+#include "components/xy_console.h"
+#include "components/xy_discover.h"
+#include "components/xy_persist.h"
+#include "components/xy_stream.h"
+
+#define CONSOLE_BAUD    115200
+#define LOOP_PERIOD_MS  10
+#define SAVE_PERIOD_MS  10000   // boot image check, flash is only written when it changed
+#define UPGRADE_LINK    0       // 1 moves the unit to the fastest rate it keeps up with, rewrites its BAUDRATE register
+
+xy6020l psu(&Serial2);
+xy_comm comm(&psu);
+xy_stream stream(&Serial, CONSOLE_BAUD);
+xy_console console(&Serial, &comm, &psu);
+xy_capture capture;
+xy_persist persist(&psu);
+uint32_t last_save_ms = 0;
+
+static bool uart_baud(uint32_t baud, void *ctx){
+  ((HardwareSerial *) ctx)->updateBaudRate(baud);
+  return true;
 }
+xy_discover discover(&psu, uart_baud, &Serial2);
 
 void setup(){
-  Serial.begin(115200);
+  Serial.begin(CONSOLE_BAUD);
   Serial2.begin(115200, SERIAL_8N1, 16, 17);
-  delay(1000);
-  write_a_single_register(&Serial2, HREG_IDX_CV, 20);
+  psu.begin(115200);
+
+  // whatever rate and address the unit was left at, optionally moved to the fastest link it keeps up with
+  tDiscoverReport found;
+  if (discover.scan(found) && UPGRADE_LINK) discover.upgrade(found);
+
+  // identity, presets and setpoints from flash, checked against the device with a few reads
+  tBootReport boot;
+  bool ready = persist.restore(boot);
+
+  // the console owns the port until 'stream on'
+  stream.set_enabled(false);
+  psu.set_stream(&stream);
+  console.set_stream(&stream);
+  // bus capture stays off until 'capture on' or 'capture freeze <n>'
+  psu.set_capture(&capture);
+  console.set_capture(&capture);
+
+  psu.use_default_poll_plan();
+  psu.start_polling();
+  comm.start();
+  console.print("xy6020l console, type help\n");
+  if (!found.count) console.print("no xy6020l on addresses 1..%u at any rate, %u ms, staying at %u baud, address %u\n",
+                                  DISCOVER_LAST_ADDRESS, (unsigned) found.scanMs, (unsigned) psu.get_link_baud(), psu.get_slave_address());
+  else console.print("%04X v%02X at address %u: %u -> %u baud, found in %u ms, upgraded in %u ms\n", found.devices[0].model,
+                     found.devices[0].fwVersion, found.devices[0].address, (unsigned) found.devices[0].foundBaud,
+                     (unsigned) found.devices[0].baud, (unsigned) found.scanMs, (unsigned) found.upgradeMs);
+  if (!ready) console.print("device not answering at boot\n");
+  else console.print("ready in %u ms: %u reads, %u writes, %u presets from flash%s\n", (unsigned) boot.readyMs, boot.reads,
+                     boot.writes, boot.presetsRestored, boot.imageValid ? "" : " (no stored image)");
 }
 
 void loop(){
-  if (Serial.available()){
-    uint16_t voltage = Serial.parseInt();
-    Serial.printf("start register set to %d volt \n", voltage);
-    data_to_modbus_framing_03(&Serial2, voltage, 30 - voltage);
+  console.poll();
+  if (millis() - last_save_ms >= SAVE_PERIOD_MS){
+    last_save_ms = millis();
+    persist.save();
   }
-  delay(50);
-}
\ No newline at end of file
+  delay(LOOP_PERIOD_MS);
+}
@@ -0,0 +1,153 @@
+#include "posix_link.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
+void fd_stream::attach(int fd){
+  close();
+  _fd = fd;
+  _rx_pos = 0;
+  _rx_len = 0;
+  if (_fd >= 0) fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+}
+
+void fd_stream::close(){
+  if (_fd >= 0) ::close(_fd);
+  _fd = -1;
+}
+
+bool fd_stream::fill(){
+  if (_rx_pos < _rx_len) return true;
+  if (_fd < 0) return false;
+
+  ssize_t n = ::read(_fd, _rx, sizeof(_rx));
+  if (n <= 0) return false;
+  _rx_pos = 0;
+  _rx_len = n;
+  return true;
+}
+
+int fd_stream::available(){
+  fill();
+  return _rx_len - _rx_pos;
+}
+
+int fd_stream::read(){
+  return fill() ? _rx[_rx_pos++] : -1;
+}
+
+int fd_stream::peek(){
+  return fill() ? _rx[_rx_pos] : -1;
+}
+
+size_t fd_stream::write(const uint8_t *buf, size_t size){
+  size_t sent = 0;
+  uint32_t start = millis();
+
+  while (_fd >= 0 && sent < size){
+    ssize_t n = ::write(_fd, buf + sent, size - sent);
+    if (n > 0){
+      sent += n;
+      continue;
+    }
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) break;
+    if (millis() - start >= FD_STREAM_WRITE_MS) break;
+
+    // the descriptor is full, wait until it drains a bit
+    struct pollfd pfd = {_fd, POLLOUT, 0};
+    ::poll(&pfd, 1, 1);
+  }
+  return sent;
+}
+
+void fd_stream::flush(){
+  if (_fd >= 0 && isatty(_fd)) tcdrain(_fd);
+}
+
+static speed_t termios_speed(uint32_t baud){
+  switch (baud){
+    case 2400:    return B2400;
+    case 4800:    return B4800;
+    case 9600:    return B9600;
+    case 19200:   return B19200;
+    case 38400:   return B38400;
+    case 57600:   return B57600;
+    case 115200:  return B115200;
+    case 230400:  return B230400;
+    default:      return 0;
+  }
+}
+
+bool posix_serial::begin(const char *path, uint32_t baud){
+  speed_t speed = termios_speed(baud);
+  if (!speed) return false;
+
+  int fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0) return false;
+
+  struct termios tio;
+  if (tcgetattr(fd, &tio) != 0){
+    ::close(fd);
+    return false;
+  }
+  cfmakeraw(&tio);
+  tio.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+  tio.c_cflag |= CLOCAL | CREAD | CS8;
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  if (tcsetattr(fd, TCSANOW, &tio) != 0){
+    ::close(fd);
+    return false;
+  }
+  tcflush(fd, TCIOFLUSH);
+
+#ifdef __linux__
+  // USB serial drivers batch received bytes for up to 16 ms unless asked not to
+  struct serial_struct serial;
+  if (ioctl(fd, TIOCGSERIAL, &serial) == 0){
+    serial.flags |= ASYNC_LOW_LATENCY;
+    ioctl(fd, TIOCSSERIAL, &serial);
+  }
+#endif
+
+  attach(fd);
+  _baud = baud;
+  return true;
+}
+
+bool open_pty(fd_stream &master, char *slave_path, size_t path_len){
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (fd < 0) return false;
+  if (grantpt(fd) != 0 || unlockpt(fd) != 0 || ptsname_r(fd, slave_path, path_len) != 0){
+    ::close(fd);
+    return false;
+  }
+
+  // raw on the master side too, the line discipline must not touch Modbus bytes
+  struct termios tio;
+  if (tcgetattr(fd, &tio) == 0){
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  master.attach(fd);
+  return true;
+}
+
+bool open_socket_pair(fd_stream &a, fd_stream &b){
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return false;
+  a.attach(fds[0]);
+  b.attach(fds[1]);
+  return true;
+}
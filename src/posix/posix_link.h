@@ -0,0 +1,91 @@
+/**
+ * @file posix_link.h
+ * @brief Stream backends on POSIX file descriptors: serial ports, ptys and socket pairs
+ *
+ * The driver only needs a Stream for the link and the Arduino clock functions;
+ * on a Linux host the latter come from host/Arduino.h, so these classes are the
+ * whole port. fd_stream puts any non-blocking descriptor behind the Stream
+ * interface with a small receive buffer, so available() costs one read() when
+ * the buffer is empty and none otherwise. posix_serial opens a tty (USB-RS485
+ * adapters included) raw at 8N1 and asks the driver for low latency, which
+ * makes FTDI style adapters hand over bytes after 1 ms instead of 16 ms.
+ *
+ * open_pty() and open_socket_pair() give the two ends of a link without any
+ * hardware, for tests against the simulator (see xy6020l_sim_link).
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef posix_link_h
+#define posix_link_h
+
+#include "Arduino.h"
+
+#define FD_STREAM_RX_SIZE     256
+#define FD_STREAM_WRITE_MS    100     // how long write() waits for a full descriptor to drain
+
+/**
+ * @class fd_stream
+ * @brief Stream over a non-blocking file descriptor, takes ownership of it
+ */
+class fd_stream : public Stream
+{
+  public:
+    fd_stream(int fd = -1){attach(fd);}
+    ~fd_stream(){close();}
+
+    /**
+     * @brief Uses fd from now on and switches it to non-blocking, an open one is closed first
+     */
+    void attach(int fd);
+    void close();
+    bool is_open(){return _fd >= 0;}
+    int fd(){return _fd;}
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t data) override {return write(&data, 1);}
+    size_t write(const uint8_t *buf, size_t size) override;
+    void flush() override;
+
+  private:
+    bool fill();
+
+    int _fd = -1;
+    uint8_t _rx[FD_STREAM_RX_SIZE];
+    uint16_t _rx_pos = 0;
+    uint16_t _rx_len = 0;
+};
+
+/**
+ * @class posix_serial
+ * @brief Serial port through termios, raw 8N1 without flow control
+ */
+class posix_serial : public fd_stream
+{
+  public:
+    /**
+     * @param path i.e. /dev/ttyUSB0, or the slave side of a pty
+     * @return false if the port cannot be opened or the baud rate has no termios constant
+     */
+    bool begin(const char *path, uint32_t baud);
+    uint32_t get_baud(){return _baud;}
+
+  private:
+    uint32_t _baud = 0;
+};
+
+/**
+ * @brief Pseudo terminal pair, the master stays with the caller and the slave is opened by path
+ * @param slave_path receives the path of the slave side, at least 64 bytes
+ */
+bool open_pty(fd_stream &master, char *slave_path, size_t path_len);
+
+/**
+ * @brief Connected unix socket pair, lower overhead than a pty and no line discipline at all
+ */
+bool open_socket_pair(fd_stream &a, fd_stream &b);
+
+#endif
@@ -0,0 +1,86 @@
+#include "xy6020l_replay.h"
+
+bool xy6020l_replay::add(const tCaptureRecord &record){
+  if (_count == REPLAY_MAX_RECORDS) return false;
+  _records[_count++] = record;
+  return true;
+}
+
+bool xy6020l_replay::load_line(const char *line){
+  tCaptureRecord record;
+  return xy_capture::parse(line, record) && add(record);
+}
+
+void xy6020l_replay::rewind(){
+  _cursor = 0;
+  _in_request = false;
+  _rx_pos = 0;
+  _rx_len = 0;
+  _stats = {};
+}
+
+bool xy6020l_replay::finished(){
+  if (_in_request) return false;
+  for (uint16_t i = _cursor; i < _count; i++) if (_records[i].dir == CAPTURE_TX) return false;
+  return true;
+}
+
+int xy6020l_replay::available(){
+  uint32_t now = micros();
+  uint16_t ready = 0;
+  while (_rx_pos + ready < _rx_len && (int32_t)(now - _rx_due_us[_rx_pos + ready]) >= 0) ready++;
+  return ready;
+}
+
+int xy6020l_replay::read(){
+  if (!available()) return -1;
+  uint8_t data = _rx[_rx_pos++];
+  if (_rx_pos == _rx_len) _rx_pos = _rx_len = 0;
+  return data;
+}
+
+int xy6020l_replay::peek(){
+  return available() ? _rx[_rx_pos] : -1;
+}
+
+size_t xy6020l_replay::write(uint8_t data){
+  if (!_in_request && !begin_request()){
+    _stats.unexpected++;
+    return 1;
+  }
+
+  const tCaptureRecord &request = _records[_cursor];
+  if (_req_pos >= request.len || request.data[_req_pos] != data) _mismatch = true;
+  if (++_req_pos >= request.len) end_request();
+  return 1;
+}
+
+bool xy6020l_replay::begin_request(){
+  while (_cursor < _count && _records[_cursor].dir != CAPTURE_TX) _cursor++;
+  if (_cursor == _count) return false;
+
+  _in_request = true;
+  _mismatch = false;
+  _req_pos = 0;
+  _req_start_us = micros();
+  _stats.requests++;
+  return true;
+}
+
+void xy6020l_replay::end_request(){
+  const tCaptureRecord &request = _records[_cursor];
+  uint32_t now = micros();
+  if (_mismatch) _stats.mismatched++;
+  _in_request = false;
+
+  // everything up to the next request was the answer to this one
+  for (_cursor++; _cursor < _count && _records[_cursor].dir != CAPTURE_TX; _cursor++){
+    const tCaptureRecord &reply = _records[_cursor];
+    uint32_t due = _timed ? _req_start_us + (reply.timestampUs - request.timestampUs) : now;
+    for (uint8_t i = 0; i < reply.len && _rx_len < REPLAY_RX_SIZE; i++){
+      _rx[_rx_len] = reply.data[i];
+      _rx_due_us[_rx_len++] = due;
+      _stats.bytesOut++;
+    }
+  }
+}
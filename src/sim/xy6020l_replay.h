@@ -0,0 +1,81 @@
+/**
+ * @file xy6020l_replay.h
+ * @brief Stream that plays a bus capture back to the driver, for reproducing field problems on the host
+ *
+ * Loaded with the records of an xy_capture (or the text lines of its dump),
+ * the replay waits for the driver to send the next recorded request and then
+ * hands over the replies and stray bytes recorded after it, at the same offset
+ * from the request as on the original bus when timed (the default), or at once.
+ * Requests that differ from the recording are counted but answered all the
+ * same, so the driver walks through the recorded conversation either way.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy6020l_replay_h
+#define xy6020l_replay_h
+
+#include "Arduino.h"
+#include "../components/xy_capture.h"
+
+#define REPLAY_MAX_RECORDS  512
+#define REPLAY_RX_SIZE      512
+
+typedef struct {
+    uint32_t requests;      // recorded requests the driver sent
+    uint32_t mismatched;    // of those, with bytes that differ from the recording
+    uint32_t unexpected;    // request bytes after the end of the recording
+    uint32_t bytesOut;
+} tReplayStats;
+
+/**
+ * @class xy6020l_replay
+ * @brief Answers the driver from a recorded conversation
+ */
+class xy6020l_replay : public Stream
+{
+  public:
+    /**
+     * @return false if the recording is full
+     */
+    bool add(const tCaptureRecord &record);
+    /**
+     * @brief Adds a line of xy_capture::dump(), false if it is not a record
+     */
+    bool load_line(const char *line);
+
+    void set_timed(bool timed){_timed = timed;}
+    void rewind();
+    uint16_t get_record_count(){return _count;}
+    bool finished();
+    const tReplayStats &stats(){return _stats;}
+
+    // Stream interface
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t data) override;
+    using Stream::write;
+
+  private:
+    bool begin_request();
+    void end_request();
+
+    tCaptureRecord _records[REPLAY_MAX_RECORDS];
+    uint16_t _count = 0;
+    uint16_t _cursor = 0;       // the recorded request being sent, or where to look for the next one
+    bool _in_request = false;
+    bool _mismatch = false;
+    uint8_t _req_pos = 0;
+    uint32_t _req_start_us = 0;
+    bool _timed = true;
+
+    uint8_t _rx[REPLAY_RX_SIZE];
+    uint32_t _rx_due_us[REPLAY_RX_SIZE];
+    uint16_t _rx_pos = 0;
+    uint16_t _rx_len = 0;
+    tReplayStats _stats = {};
+};
+
+#endif
@@ -0,0 +1,310 @@
+#include "xy6020l_sim.h"
+#include "../components/crc16.h"
+
+xy6020l_sim::xy6020l_sim(uint8_t addr) : _address(addr)
+{
+  memset(_regs, 0, sizeof(_regs));
+  memset(&_stats, 0, sizeof(_stats));
+  _req_len = 0;
+  _req_last_us = 0;
+  _reply_len = 0;
+  _reply_pos = 0;
+
+  _regs[HREG_IDX_CV] = 500;
+  _regs[HREG_IDX_CC] = 100;
+  _regs[HREG_IDX_IN_V] = 2400;
+  _regs[HREG_IDX_TEMP] = 250;
+  _regs[HREG_IDX_TEMP_EXD] = 240;
+  _regs[HREG_IDX_BB] = 5;
+  _regs[HREG_IDX_MODEL] = 0x6020;
+  _regs[HREG_IDX_VERSION] = 0x71;
+  _regs[HREG_IDX_SLAVE_ADD] = addr;
+  _regs[HREG_IDX_BAUDRATE] = 6;
+
+  for (uint8_t preset = 0; preset < 10; preset++){
+    uint16_t *mem = &_regs[HREG_IDX_M0 + (preset * HREG_IDX_M_OFFSET)];
+    mem[HREG_IDX_M_VSET] = 500 + (preset * 100);
+    mem[HREG_IDX_M_ISET] = 100;
+    mem[HREG_IDX_M_SLVP] = 1000;
+    mem[HREG_IDX_M_SOVP] = 6200;
+    mem[HREG_IDX_M_SOCP] = 2100;
+    mem[HREG_IDX_M_SOPP] = 12500;
+    mem[HREG_IDX_M_SOTP] = 800;
+  }
+
+  set_config(default_config());
+  update_outputs();
+}
+
+tSimConfig xy6020l_sim::default_config(){
+  tSimConfig config;
+  config.baud = 115200;
+  config.responseLatencyUs = 2000;
+  config.byteGapUs = 0;
+  config.dropBytePpm = 0;
+  config.crcCorruptPpm = 0;
+  config.loadMilliOhm = 10000;
+  config.maxBaud = 0;
+  config.seed = 1;
+  return config;
+}
+
+void xy6020l_sim::set_config(const tSimConfig &config){
+  _config = config;
+  if (_config.baud == 0) _config.baud = 115200;
+  for (uint16_t code = 0; code < BAUD_CODE_COUNT; code++){
+    if (XY_BAUD_RATES[code] == _config.baud) _regs[HREG_IDX_BAUDRATE] = code;
+  }
+  _rng = config.seed ? config.seed : 1;
+}
+
+void xy6020l_sim::set_register(uint16_t reg, uint16_t value){
+  if (reg >= SIM_REG_COUNT) return;
+  _regs[reg] = value;
+  update_outputs();
+}
+
+bool xy6020l_sim::chance(uint32_t ppm){
+  if (ppm == 0) return false;
+  // xorshift32, reproducible for a given seed
+  _rng ^= _rng << 13;
+  _rng ^= _rng >> 17;
+  _rng ^= _rng << 5;
+  return (_rng % 1000000UL) < ppm;
+}
+
+void xy6020l_sim::update_outputs(){
+  uint16_t volt = 0, current = 0;
+
+  if (_regs[HREG_IDX_OUTPUT_ON]){
+    volt = _regs[HREG_IDX_CV];
+    if (_config.loadMilliOhm){
+      uint32_t load_current = (1000UL * volt) / _config.loadMilliOhm;
+      if (load_current > _regs[HREG_IDX_CC]){
+        current = _regs[HREG_IDX_CC];
+        volt = ((uint32_t) current * _config.loadMilliOhm) / 1000UL;
+      } else {
+        current = load_current;
+      }
+    }
+  }
+
+  _regs[HREG_IDX_ACT_V] = volt;
+  _regs[HREG_IDX_ACT_C] = current;
+  _regs[HREG_IDX_ACT_P] = ((uint32_t) volt * current) / 1000UL;
+  _regs[HREG_IDX_CVCC] = current && current == _regs[HREG_IDX_CC];
+}
+
+uint16_t xy6020l_sim::expected_request_length(){
+  if (_req_len < 2) return 0;
+  if (_req_buf[1] != FUNC_CODE_WRITE_MULTIPLE_HOLD_REG) return 8;
+  if (_req_len < 7) return 0;
+  return 9 + _req_buf[6];
+}
+
+size_t xy6020l_sim::write(uint8_t data){
+  uint64_t now = host_clock_us();
+  // requests take the wire time of the sender's rate, whether the unit understands them or not
+  uint32_t char_us = _port_baud ? 10000000UL / _port_baud : char_time_us();
+
+  // 3.5 characters of silence end a frame, stale partial requests are dropped
+  if (_req_len && now > _req_last_us + ((7 * char_us) / 2)) _req_len = 0;
+
+  // the master talking over a reply cuts it off, the rest never reaches the wire
+  if (_req_len == 0){
+    while (_reply_len > _reply_pos && _reply_due_us[_reply_len - 1] > now){
+      _reply_len--;
+      _stats.busTimeUs -= char_us;
+    }
+  }
+
+  // the byte is on the wire after the previous one left
+  _req_last_us = (now > _req_last_us ? now : _req_last_us) + char_us;
+  _stats.bytesIn++;
+  _stats.busTimeUs += char_us;
+
+  if (_req_len >= SIM_FRAME_SIZE) _req_len = 0;
+  _req_buf[_req_len++] = data;
+
+  uint16_t expected = expected_request_length();
+  if (expected && _req_len >= expected){
+    handle_request();
+    _req_len = 0;
+  }
+  return 1;
+}
+
+void xy6020l_sim::handle_request(){
+  uint16_t length = _req_len;
+  bool garbled = _port_baud && _port_baud != _config.baud;
+  if (garbled || crc16_calc(_req_buf, length) != 0 || (_req_buf[0] != _address && _req_buf[0] != 0)){
+    _stats.ignored++;
+    return;
+  }
+  _stats.requests++;
+
+  uint8_t funcCode = _req_buf[1];
+  uint16_t start = (_req_buf[2] << 8) | _req_buf[3];
+  uint16_t value = (_req_buf[4] << 8) | _req_buf[5];
+  uint8_t reply[SIM_FRAME_SIZE];
+
+  switch (funcCode){
+    case FUNC_CODE_READ_HOLD_REG: {
+      if (value == 0 || value > 125){
+        send_exception(funcCode, ILLEGAL_DATA_VALUE);
+        return;
+      }
+      if (start + value > SIM_REG_COUNT){
+        send_exception(funcCode, ILLEGAL_DATA_ADDRESS);
+        return;
+      }
+      reply[0] = _address;
+      reply[1] = funcCode;
+      reply[2] = value * 2;
+      for (uint16_t i = 0; i < value; i++){
+        reply[3 + (i * 2)] = _regs[start + i] >> 8;
+        reply[4 + (i * 2)] = _regs[start + i] & 0xFF;
+      }
+      send_reply(reply, 3 + (value * 2));
+      break;
+    }
+
+    case FUNC_CODE_WRITE_SINGLE_HOLD_REG: {
+      if (start >= SIM_REG_COUNT){
+        send_exception(funcCode, ILLEGAL_DATA_ADDRESS);
+        return;
+      }
+      _regs[start] = value;
+      update_outputs();
+      send_reply(_req_buf, 6);
+      break;
+    }
+
+    case FUNC_CODE_WRITE_MULTIPLE_HOLD_REG: {
+      if (value == 0 || value > 123 || _req_buf[6] != value * 2){
+        send_exception(funcCode, ILLEGAL_DATA_VALUE);
+        return;
+      }
+      if (start + value > SIM_REG_COUNT){
+        send_exception(funcCode, ILLEGAL_DATA_ADDRESS);
+        return;
+      }
+      for (uint16_t i = 0; i < value; i++){
+        _regs[start + i] = (_req_buf[7 + (i * 2)] << 8) | _req_buf[8 + (i * 2)];
+      }
+      update_outputs();
+      send_reply(_req_buf, 6);
+      break;
+    }
+
+    default:
+      send_exception(funcCode, ILLEGAL_FUNCTION);
+      return;
+  }
+
+  // address changes apply after the acknowledge went out with the old one
+  if (_regs[HREG_IDX_SLAVE_ADD] != _address) _address = _regs[HREG_IDX_SLAVE_ADD];
+  // so do baud rate changes, unknown codes are kept in the register but not applied
+  uint16_t code = _regs[HREG_IDX_BAUDRATE];
+  if (code < BAUD_CODE_COUNT) _config.baud = XY_BAUD_RATES[code];
+}
+
+void xy6020l_sim::send_exception(uint8_t funcCode, uint8_t code){
+  uint8_t reply[3] = {_address, (uint8_t)(funcCode | 0x80), code};
+  _stats.exceptions++;
+  send_reply(reply, sizeof(reply));
+}
+
+void xy6020l_sim::send_reply(const uint8_t *frame, uint8_t length){
+  // broadcasts are never answered
+  if (_req_buf[0] == 0) return;
+
+  uint8_t buf[SIM_FRAME_SIZE];
+  memcpy(buf, frame, length);
+  uint16_t crc16 = crc16_calc(buf, length);
+  buf[length] = crc16 & 0xFF;
+  buf[length + 1] = crc16 >> 8;
+  length += 2;
+
+  // past its rate limit the unit still answers, but the bits no longer line up
+  if (chance(_config.crcCorruptPpm) || (_config.maxBaud && _config.baud > _config.maxBaud)){
+    buf[length - 1] ^= 0x01;
+    _stats.corruptedReplies++;
+  }
+
+  // a new request aborts whatever was still queued from an earlier reply
+  _reply_len = 0;
+  _reply_pos = 0;
+
+  uint32_t char_us = char_time_us();
+  uint64_t due = _req_last_us + _config.responseLatencyUs;
+  for (uint8_t i = 0; i < length; i++){
+    due += char_us;
+    _stats.busTimeUs += char_us;
+    if (chance(_config.dropBytePpm)){
+      _stats.droppedBytes++;
+    } else {
+      _reply_buf[_reply_len] = buf[i];
+      _reply_due_us[_reply_len] = due;
+      _reply_len++;
+    }
+    due += _config.byteGapUs;
+  }
+
+  _stats.replies++;
+  _stats.bytesOut += length;
+}
+
+int xy6020l_sim::available(){
+  uint64_t now = host_clock_us();
+  uint16_t pos = _reply_pos;
+  while (pos < _reply_len && _reply_due_us[pos] <= now) pos++;
+  return pos - _reply_pos;
+}
+
+int xy6020l_sim::peek(){
+  if (!available()) return -1;
+  return _reply_buf[_reply_pos];
+}
+
+int xy6020l_sim::read(){
+  if (!available()) return -1;
+  return _reply_buf[_reply_pos++];
+}
+
+bool xy6020l_sim_bus::add(xy6020l_sim *slave){
+  if (_slave_count >= SIM_BUS_MAX_SLAVES) return false;
+  _slaves[_slave_count++] = slave;
+  return true;
+}
+
+xy6020l_sim *xy6020l_sim_bus::talking(){
+  for (uint8_t i = 0; i < _slave_count; i++){
+    if (_slaves[i]->available()) return _slaves[i];
+  }
+  return nullptr;
+}
+
+void xy6020l_sim_bus::set_port_baud(uint32_t baud){
+  for (uint8_t i = 0; i < _slave_count; i++) _slaves[i]->set_port_baud(baud);
+}
+
+int xy6020l_sim_bus::available(){
+  xy6020l_sim *slave = talking();
+  return slave ? slave->available() : 0;
+}
+
+int xy6020l_sim_bus::read(){
+  xy6020l_sim *slave = talking();
+  return slave ? slave->read() : -1;
+}
+
+int xy6020l_sim_bus::peek(){
+  xy6020l_sim *slave = talking();
+  return slave ? slave->peek() : -1;
+}
+
+size_t xy6020l_sim_bus::write(uint8_t data){
+  for (uint8_t i = 0; i < _slave_count; i++) _slaves[i]->write(data);
+  return 1;
+}
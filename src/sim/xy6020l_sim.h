@@ -0,0 +1,136 @@
+/**
+ * @file xy6020l_sim.h
+ * @brief Software XY6020L slave behind a Stream, for host builds
+ *
+ * Whatever the driver writes is parsed as a Modbus RTU request, answered from a
+ * register file holding the 31 holding registers and the ten memory presets, and
+ * the reply bytes become readable as they would arrive on the wire: after a
+ * response latency, spaced by the character time of the configured baud rate plus
+ * an optional gap. Bytes can be dropped and replies corrupted to exercise the
+ * error paths of the driver.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy6020l_sim_h
+#define xy6020l_sim_h
+
+#include "Arduino.h"
+#include "../components/xy6020l.h"
+
+#define SIM_REG_COUNT       (HREG_IDX_M0 + (10 * HREG_IDX_M_OFFSET))
+#define SIM_FRAME_SIZE      256
+
+typedef struct {
+    uint32_t baud;
+    uint32_t responseLatencyUs;   // from the end of the request to the first reply byte
+    uint32_t byteGapUs;           // extra silence between reply bytes
+    uint32_t dropBytePpm;         // chance per reply byte to be lost
+    uint32_t crcCorruptPpm;       // chance per reply to carry a wrong crc
+    uint32_t loadMilliOhm;        // resistive load on the output, 0 = open
+    uint32_t maxBaud;             // fastest rate the unit keeps up with, replies above it are garbled; 0 = any
+    uint32_t seed;
+} tSimConfig;
+
+typedef struct {
+    uint32_t requests;
+    uint32_t replies;
+    uint32_t exceptions;
+    uint32_t ignored;             // bad crc or foreign address
+    uint32_t bytesIn;
+    uint32_t bytesOut;
+    uint32_t droppedBytes;
+    uint32_t corruptedReplies;
+    uint64_t busTimeUs;           // wire time of all requests and replies
+} tSimStats;
+
+/**
+ * @class xy6020l_sim
+ * @brief Simulated XY6020L, pass it to xy6020l in place of the serial port
+ */
+class xy6020l_sim : public Stream
+{
+  public:
+    xy6020l_sim(uint8_t addr = DEFAULT_SLAVE_ADDRESS);
+
+    static tSimConfig default_config();
+    void set_config(const tSimConfig &config);
+    tSimConfig &config(){return _config;}
+
+    uint16_t get_register(uint16_t reg){return reg < SIM_REG_COUNT ? _regs[reg] : 0;}
+    void set_register(uint16_t reg, uint16_t value);
+
+    const tSimStats &stats(){return _stats;}
+    void reset_stats(){memset(&_stats, 0, sizeof(_stats));}
+
+    uint32_t char_time_us(){return 10000000UL / _config.baud;}
+
+    /**
+     * @brief Rate the master's UART runs at, 0 follows the unit
+     * Requests at any other rate than the unit's arrive as framing garbage and are ignored.
+     * Writing HREG_IDX_BAUDRATE moves the unit to the new rate once the acknowledge went out.
+     */
+    void set_port_baud(uint32_t baud){_port_baud = baud;}
+
+    // Stream interface
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t data) override;
+    using Stream::write;
+
+  private:
+    void handle_request();
+    void send_reply(const uint8_t *frame, uint8_t length);
+    void send_exception(uint8_t funcCode, uint8_t code);
+    void update_outputs();
+    bool chance(uint32_t ppm);
+    uint16_t expected_request_length();
+
+  private:
+    tSimConfig _config;
+    tSimStats _stats;
+    uint8_t _address;
+    uint32_t _port_baud = 0;
+    uint16_t _regs[SIM_REG_COUNT];
+
+    uint8_t _req_buf[SIM_FRAME_SIZE];
+    uint16_t _req_len;
+    uint64_t _req_last_us;
+
+    uint8_t _reply_buf[SIM_FRAME_SIZE];
+    uint64_t _reply_due_us[SIM_FRAME_SIZE];
+    uint16_t _reply_len;
+    uint16_t _reply_pos;
+
+    uint32_t _rng;
+};
+
+#define SIM_BUS_MAX_SLAVES  8
+
+/**
+ * @class xy6020l_sim_bus
+ * @brief Several simulated slaves on one wire: requests reach all of them, the addressed one answers
+ */
+class xy6020l_sim_bus : public Stream
+{
+  public:
+    bool add(xy6020l_sim *slave);
+    void set_port_baud(uint32_t baud);
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t data) override;
+    using Stream::write;
+
+  private:
+    xy6020l_sim *talking();
+
+  private:
+    xy6020l_sim *_slaves[SIM_BUS_MAX_SLAVES];
+    uint8_t _slave_count = 0;
+};
+
+#endif
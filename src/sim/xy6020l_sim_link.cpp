@@ -0,0 +1,43 @@
+#include "xy6020l_sim_link.h"
+#include "xy6020l_sim.h"
+
+bool xy6020l_sim_link::start(Stream *port){
+  if (_running) return false;
+
+  _port = port;
+  _running = true;
+  _thread = std::thread(&xy6020l_sim_link::run, this);
+  return true;
+}
+
+void xy6020l_sim_link::stop(){
+  _running = false;
+  if (_thread.joinable()) _thread.join();
+}
+
+void xy6020l_sim_link::run(){
+  uint8_t buf[SIM_FRAME_SIZE];
+
+  while (_running){
+    bool moved = false;
+
+    // the simulator stamps each request byte with its own wire time
+    while (_port->available() > 0){
+      int c = _port->read();
+      if (c < 0) break;
+      _slave->write((uint8_t) c);
+      _bytes_in++;
+      moved = true;
+    }
+
+    uint16_t len = 0;
+    while (len < sizeof(buf) && _slave->available() > 0) buf[len++] = _slave->read();
+    if (len){
+      _port->write(buf, len);
+      _bytes_out += len;
+      moved = true;
+    }
+
+    if (!moved) delayMicroseconds(SIM_LINK_IDLE_US);
+  }
+}
@@ -0,0 +1,54 @@
+/**
+ * @file xy6020l_sim_link.h
+ * @brief Puts a simulated slave (or a bus of them) behind a real link, in its own thread
+ *
+ * The thread moves request bytes from the port into the simulator as they
+ * arrive and reply bytes from the simulator into the port once their wire time
+ * has come, so the driver on the other end of a pty, socket pair or null modem
+ * sees the byte timing of the configured baud rate plus the delays of the
+ * kernel path in between. The simulator must not be touched by anyone else
+ * while the link runs.
+ *
+ * @author 0xoluwa
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy6020l_sim_link_h
+#define xy6020l_sim_link_h
+
+#include "Arduino.h"
+#include <atomic>
+
+#define SIM_LINK_IDLE_US    50      // sleep of the thread when no byte moved
+
+/**
+ * @class xy6020l_sim_link
+ * @brief Pumps bytes between a port and a simulated slave
+ */
+class xy6020l_sim_link
+{
+  public:
+    /**
+     * @param slave xy6020l_sim or xy6020l_sim_bus
+     */
+    xy6020l_sim_link(Stream *slave) : _slave(slave) {}
+    ~xy6020l_sim_link(){stop();}
+
+    bool start(Stream *port);
+    void stop();
+
+    uint32_t get_bytes_in(){return _bytes_in;}
+    uint32_t get_bytes_out(){return _bytes_out;}
+
+  private:
+    void run();
+
+    Stream *_slave;
+    Stream *_port = nullptr;
+    std::thread _thread;
+    std::atomic<bool> _running{false};
+    std::atomic<uint32_t> _bytes_in{0};
+    std::atomic<uint32_t> _bytes_out{0};
+};
+
+#endif